@@ -8,12 +8,18 @@
 
 #include "yybench_def.h"
 #include "yybench_cpu.h"
+#include "yybench_topo.h"
 #include "yybench_env.h"
 #include "yybench_str.h"
 #include "yybench_time.h"
 #include "yybench_file.h"
 #include "yybench_rand.h"
 #include "yybench_perf.h"
+#include "yybench_sym.h"
 #include "yybench_chart.h"
+#include "yybench_metric.h"
+#include "yybench_stats.h"
+#include "yybench_bench.h"
+#include "yybench_mem.h"
 
 #endif
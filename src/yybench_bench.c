@@ -0,0 +1,1105 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_bench.h"
+#include "yybench_cpu.h"
+#include "yybench_time.h"
+#include "yybench_str.h"
+#include "yybench_stats.h"
+#include "yybench_env.h"
+#include "yybench_file.h"
+#include "yybench_thread.h"
+
+/* A repetition should be at least this times of the timer overhead (or one
+   tick), so the error of the timer is less than 0.1%. */
+#define BENCH_TIMER_FACTOR 1000
+
+/* Max growth of the iteration count in one calibration step. */
+#define BENCH_MAX_GROWTH 10
+
+/* Baseline file header and default regression threshold. */
+#define BENCH_BASELINE_MAGIC "yybench baseline 1"
+#define BENCH_DEF_THRESHOLD 0.03
+
+/* Alignment of the data written by each thread, 128 bytes to avoid false
+   sharing with adjacent line prefetch and 128-byte cache lines. */
+#define BENCH_CACHE_LINE 128
+
+/* Scaling runs every thread count up to this, then powers of 2. */
+#define BENCH_SCALING_LINEAR_MAX 8
+
+
+
+/*==============================================================================
+ * Runner
+ *============================================================================*/
+
+void yy_bench_options_init(yy_bench_options *op) {
+    if (!op) return;
+    memset(op, 0, sizeof(yy_bench_options));
+    op->min_time = 0.01;
+    op->warmup = 2;
+    op->repetitions = 30;
+}
+
+/* Run one repetition, returns the elapsed ticks. */
+static u64 bench_run_once(yy_bench_func func, void *ctx, u64 iters) {
+    u64 t1 = yy_time_get_ticks_begin();
+    func(ctx, iters);
+    u64 t2 = yy_time_get_ticks_end();
+    return yy_time_ticks_elapsed(t1, t2);
+}
+
+/* Find the iteration count of one repetition that takes at least min_ticks. */
+static u64 bench_calibrate(yy_bench_func func, void *ctx, u64 min_ticks) {
+    u64 iters = 1;
+    while (true) {
+        u64 ticks = bench_run_once(func, ctx, iters);
+        if (ticks >= min_ticks) return iters;
+
+        /* grow by the estimated ratio with a margin, but not too fast,
+           since the first runs may be slowed down by cold cache */
+        f64 growth = ticks ? (f64)min_ticks / (f64)ticks * 1.2 : BENCH_MAX_GROWTH;
+        if (growth > BENCH_MAX_GROWTH) growth = BENCH_MAX_GROWTH;
+        if (growth < 1.5) growth = 1.5;
+        f64 next = (f64)iters * growth;
+        if (next >= (f64)((u64)1 << 62)) return iters;
+        iters = (u64)next;
+    }
+}
+
+/* Summary of the samples in ticks per repetition. */
+static bool bench_summarize(const u64 *samples, u32 count, yy_bench_summary *sum) {
+    sum->min = yy_stats_percentile(samples, count, 0.0);
+    sum->median = yy_stats_median(samples, count);
+    sum->mean = yy_stats_mean(samples, count);
+    sum->p90 = yy_stats_percentile(samples, count, 0.9);
+    sum->p99 = yy_stats_percentile(samples, count, 0.99);
+    return !isnan(sum->min) && !isnan(sum->median) &&
+           !isnan(sum->p90) && !isnan(sum->p99);
+}
+
+static void bench_summary_scale(const yy_bench_summary *src, f64 scale,
+                                yy_bench_summary *dst) {
+    dst->min = src->min * scale;
+    dst->median = src->median * scale;
+    dst->mean = src->mean * scale;
+    dst->p90 = src->p90 * scale;
+    dst->p99 = src->p99 * scale;
+}
+
+bool yy_bench_run(const char *name, yy_bench_func func, void *ctx,
+                  const yy_bench_options *op, yy_bench_result *result) {
+    yy_bench_options def;
+    yy_bench_summary ticks;
+    yy_stats_ci ci;
+    yy_stats_outliers outliers;
+
+    if (!result) return false;
+    memset(result, 0, sizeof(yy_bench_result));
+    if (!name || !func) return false;
+    if (!op) {
+        yy_bench_options_init(&def);
+        op = &def;
+    }
+    if (op->repetitions == 0) return false;
+    if (yy_cpu_get_tick_per_sec() == 0) yy_cpu_measure_freq_fast(NULL);
+
+    result->name = yy_str_copy(name);
+    result->samples = (u64 *)calloc(op->repetitions, sizeof(u64));
+    if (!result->name || !result->samples) {
+        yy_bench_result_release(result);
+        return false;
+    }
+
+    /* calibrate */
+    u64 iters = op->iters;
+    if (iters == 0) {
+        f64 tick_per_sec = (f64)yy_cpu_get_tick_per_sec();
+        u64 min_ticks = (u64)(op->min_time * tick_per_sec);
+        u64 timer_ticks = BENCH_TIMER_FACTOR * (yy_time_get_ticks_overhead() + 1);
+        if (min_ticks < timer_ticks) min_ticks = timer_ticks;
+        iters = bench_calibrate(func, ctx, min_ticks);
+    }
+
+    /* warmup and measure */
+    for (u32 i = 0; i < op->warmup; i++) {
+        bench_run_once(func, ctx, iters);
+    }
+    for (u32 i = 0; i < op->repetitions; i++) {
+        result->samples[i] = bench_run_once(func, ctx, iters);
+    }
+    result->iters = iters;
+    result->sample_count = op->repetitions;
+
+    /* convert ticks per repetition to ns and cycles per iteration */
+    if (!bench_summarize(result->samples, result->sample_count, &ticks) ||
+        !yy_stats_bootstrap_median(result->samples, result->sample_count,
+                                   0.95, 0, &ci) ||
+        !yy_stats_classify_outliers(result->samples, result->sample_count,
+                                    0, &outliers, NULL)) {
+        yy_bench_result_release(result);
+        return false;
+    }
+    f64 ns_per_tick = 1e9 / (f64)yy_cpu_get_tick_per_sec();
+    f64 cycle_per_tick = yy_cpu_get_cycle_per_tick();
+    bench_summary_scale(&ticks, ns_per_tick / (f64)iters, &result->ns);
+    bench_summary_scale(&ticks, cycle_per_tick / (f64)iters, &result->cycles);
+    result->median_ci.estimate = ci.estimate * ns_per_tick / (f64)iters;
+    result->median_ci.low = ci.low * ns_per_tick / (f64)iters;
+    result->median_ci.high = ci.high * ns_per_tick / (f64)iters;
+    result->median_ci.confidence = ci.confidence;
+    result->outlier_count = outliers.low_count + outliers.high_count;
+    return true;
+}
+
+void yy_bench_result_release(yy_bench_result *result) {
+    if (!result) return;
+    if (result->name) free(result->name);
+    if (result->samples) free(result->samples);
+    memset(result, 0, sizeof(yy_bench_result));
+}
+
+
+
+/*==============================================================================
+ * Report
+ *============================================================================*/
+
+bool yy_bench_report(yy_report *report, const char *title,
+                     const yy_bench_result *results, u32 count) {
+    static const char *columns[] = {
+        "iterations",
+        "min (ns)", "median (ns)", "mean (ns)", "p90 (ns)", "p99 (ns)",
+        "min (cycles)", "median (cycles)", "mean (cycles)",
+        "p90 (cycles)", "p99 (cycles)", NULL
+    };
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+
+    if (!report || !results || !count) return false;
+    yy_chart_options_init(&op);
+    op.title = title ? title : "Benchmark";
+    op.type = YY_CHART_TABLE;
+    op.h_axis.categories = columns;
+
+    chart = yy_chart_new();
+    if (!chart) return false;
+    suc &= yy_chart_set_options(chart, &op);
+    for (u32 i = 0; i < count; i++) {
+        const yy_bench_result *res = results + i;
+        const yy_bench_summary *sums[2] = { &res->ns, &res->cycles };
+        suc &= yy_chart_item_begin(chart, res->name ? res->name : "");
+        suc &= yy_chart_item_add_float(chart, (float)res->iters);
+        for (u32 s = 0; s < 2; s++) {
+            suc &= yy_chart_item_add_float(chart, (float)sums[s]->min);
+            suc &= yy_chart_item_add_float(chart, (float)sums[s]->median);
+            suc &= yy_chart_item_add_float(chart, (float)sums[s]->mean);
+            suc &= yy_chart_item_add_float(chart, (float)sums[s]->p90);
+            suc &= yy_chart_item_add_float(chart, (float)sums[s]->p99);
+        }
+        suc &= yy_chart_item_end(chart);
+    }
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    return suc;
+}
+
+
+
+/*==============================================================================
+ * Baseline
+ *============================================================================*/
+
+/* Summary of a benchmark in baseline, in ns per iteration. */
+typedef struct {
+    char *name;
+    f64 median;
+    f64 low; /* confidence interval of median */
+    f64 high;
+    f64 mean;
+    f64 min;
+    u64 iters;
+    u32 count;
+} bench_entry;
+
+struct yy_bench_baseline {
+    char *env;
+    bench_entry *entries;
+    u32 count;
+    u32 capacity;
+};
+
+/* Environment fingerprint: "os|cpu|compiler", without line break. */
+static char *bench_env_fingerprint(void) {
+    yy_sb sb;
+    if (!yy_sb_init(&sb, 0)) return NULL;
+    bool suc = yy_sb_printf(&sb, "%s|%s|%s", yy_env_get_os_desc(),
+                            yy_env_get_cpu_desc(), yy_env_get_compiler_desc());
+    char *str = suc ? yy_sb_copy_str(&sb, NULL) : NULL;
+    yy_sb_release(&sb);
+    if (str) {
+        for (char *cur = str; *cur; cur++) {
+            if (*cur == '\r' || *cur == '\n') *cur = ' ';
+        }
+    }
+    return str;
+}
+
+static bench_entry *bench_baseline_find(const yy_bench_baseline *base, const char *name) {
+    for (u32 i = 0; i < base->count; i++) {
+        if (strcmp(base->entries[i].name, name) == 0) return base->entries + i;
+    }
+    return NULL;
+}
+
+/* Add an entry, the name is copied and line breaks are replaced. */
+static bool bench_baseline_put(yy_bench_baseline *base, const bench_entry *entry) {
+    bench_entry *dst = bench_baseline_find(base, entry->name);
+    if (!dst) {
+        if (base->count >= base->capacity) {
+            u32 capacity = base->capacity ? base->capacity * 2 : 16;
+            bench_entry *entries = realloc(base->entries, capacity * sizeof(bench_entry));
+            if (!entries) return false;
+            base->entries = entries;
+            base->capacity = capacity;
+        }
+        char *name = yy_str_copy(entry->name);
+        if (!name) return false;
+        for (char *cur = name; *cur; cur++) {
+            if (*cur == '\r' || *cur == '\n') *cur = ' ';
+        }
+        dst = base->entries + base->count++;
+        *dst = *entry;
+        dst->name = name;
+    } else {
+        char *name = dst->name;
+        *dst = *entry;
+        dst->name = name;
+    }
+    return true;
+}
+
+yy_bench_baseline *yy_bench_baseline_new(void) {
+    yy_bench_baseline *base = (yy_bench_baseline *)calloc(1, sizeof(yy_bench_baseline));
+    if (!base) return NULL;
+    base->env = bench_env_fingerprint();
+    if (!base->env) {
+        free(base);
+        return NULL;
+    }
+    return base;
+}
+
+yy_bench_baseline *yy_bench_baseline_load(const char *path) {
+    yy_dat dat;
+    char *line;
+    usize len;
+
+    if (!path || !yy_dat_init_with_file(&dat, path)) return NULL;
+    line = yy_dat_copy_line(&dat, &len);
+    if (!line || strcmp(line, BENCH_BASELINE_MAGIC) != 0) {
+        if (line) free(line);
+        yy_dat_release(&dat);
+        return NULL;
+    }
+    free(line);
+
+    yy_bench_baseline *base = (yy_bench_baseline *)calloc(1, sizeof(yy_bench_baseline));
+    bool suc = base != NULL;
+    /* line: median low high mean min iters count name */
+    while (suc && (line = yy_dat_copy_line(&dat, &len))) {
+        bench_entry entry = { 0 };
+        unsigned long long iters;
+        int name_pos = 0;
+        if (yy_str_has_prefix(line, "env=")) {
+            if (base->env) free(base->env);
+            base->env = yy_str_copy(line + 4);
+            suc = base->env != NULL;
+        } else if (sscanf(line, "%lf %lf %lf %lf %lf %llu %u %n",
+                          &entry.median, &entry.low, &entry.high, &entry.mean,
+                          &entry.min, &iters, &entry.count, &name_pos) == 7 &&
+                   name_pos > 0 && line[name_pos]) {
+            entry.iters = (u64)iters;
+            entry.name = line + name_pos;
+            suc = bench_baseline_put(base, &entry);
+        }
+        free(line);
+    }
+    yy_dat_release(&dat);
+    if (suc && !base->env) base->env = yy_str_copy("");
+    if (!suc || !base->env) {
+        yy_bench_baseline_free(base);
+        return NULL;
+    }
+    return base;
+}
+
+bool yy_bench_baseline_save(yy_bench_baseline *base, const char *path) {
+    yy_sb sb;
+    if (!base || !path) return false;
+    char *env = bench_env_fingerprint();
+    if (!env) return false;
+    free(base->env);
+    base->env = env;
+
+    if (!yy_sb_init(&sb, 0)) return false;
+    bool suc = yy_sb_printf(&sb, "%s\n", BENCH_BASELINE_MAGIC) &&
+               yy_sb_printf(&sb, "env=%s\n", base->env);
+    for (u32 i = 0; i < base->count && suc; i++) {
+        const bench_entry *e = base->entries + i;
+        suc = yy_sb_printf(&sb, "%.9g %.9g %.9g %.9g %.9g %llu %u %s\n",
+                           e->median, e->low, e->high, e->mean, e->min,
+                           (unsigned long long)e->iters, e->count, e->name);
+    }
+    if (suc) suc = yy_file_write_atomic(path, (u8 *)yy_sb_get_str(&sb), yy_sb_get_len(&sb));
+    yy_sb_release(&sb);
+    return suc;
+}
+
+void yy_bench_baseline_free(yy_bench_baseline *base) {
+    if (!base) return;
+    for (u32 i = 0; i < base->count; i++) free(base->entries[i].name);
+    if (base->entries) free(base->entries);
+    if (base->env) free(base->env);
+    free(base);
+}
+
+bool yy_bench_baseline_add(yy_bench_baseline *base, const yy_bench_result *result) {
+    bench_entry entry;
+    if (!base || !result || !result->name || !result->sample_count) return false;
+    entry.name = result->name;
+    entry.median = result->ns.median;
+    entry.low = result->median_ci.low;
+    entry.high = result->median_ci.high;
+    entry.mean = result->ns.mean;
+    entry.min = result->ns.min;
+    entry.iters = result->iters;
+    entry.count = result->sample_count;
+    return bench_baseline_put(base, &entry);
+}
+
+const char *yy_bench_baseline_get_env(const yy_bench_baseline *base) {
+    return base ? base->env : NULL;
+}
+
+bool yy_bench_baseline_env_match(const yy_bench_baseline *base) {
+    if (!base) return false;
+    char *env = bench_env_fingerprint();
+    bool match = env && strcmp(env, base->env) == 0;
+    if (env) free(env);
+    return match;
+}
+
+bool yy_bench_baseline_compare(const yy_bench_baseline *base,
+                               const yy_bench_result *result, f64 threshold,
+                               yy_bench_diff *diff) {
+    if (!base || !result || !result->name || !diff) return false;
+    if (threshold <= 0) threshold = BENCH_DEF_THRESHOLD;
+
+    memset(diff, 0, sizeof(yy_bench_diff));
+    diff->name = result->name;
+    diff->median = result->ns.median;
+    diff->low = result->median_ci.low;
+    diff->high = result->median_ci.high;
+    diff->pass = true;
+
+    const bench_entry *e = bench_baseline_find(base, result->name);
+    if (!e) {
+        diff->status = YY_BENCH_STATUS_NEW;
+        diff->base_median = diff->base_low = diff->base_high = NAN;
+        diff->speedup = NAN;
+        return true;
+    }
+    diff->base_median = e->median;
+    diff->base_low = e->low;
+    diff->base_high = e->high;
+    diff->speedup = diff->median > 0 ? e->median / diff->median : NAN;
+
+    /* a change is reported only if it exceeds the threshold and the
+       confidence intervals of the medians do not overlap */
+    f64 ratio = e->median > 0 ? diff->median / e->median : 1.0;
+    if (ratio > 1.0 + threshold && diff->low > e->high) {
+        diff->status = YY_BENCH_STATUS_SLOWER;
+        diff->pass = false;
+    } else if (ratio < 1.0 - threshold && diff->high < e->low) {
+        diff->status = YY_BENCH_STATUS_FASTER;
+    } else {
+        diff->status = YY_BENCH_STATUS_SAME;
+    }
+    return true;
+}
+
+bool yy_bench_baseline_report(yy_report *report, const yy_bench_baseline *base,
+                              const char *title,
+                              const yy_bench_diff *diffs, u32 count) {
+    static const char *status_names[] = { "new", "unchanged", "faster", "slower" };
+    /* the colors are not copied by the chart, so they should be static */
+    static const char *colors[] = { "#AAAAAA", "#058DC7", "#50B432", "#ED561B", NULL };
+    static const char *columns[] = {
+        "baseline (ns)", "current (ns)", "change (%)", "speedup",
+        "CI low (ns)", "CI high (ns)", NULL
+    };
+    yy_chart_options op;
+    yy_chart *chart;
+    char buf[256];
+    bool suc = true;
+
+    if (!report || !diffs || !count) return false;
+    const char **categories = (const char **)calloc(count + 1, sizeof(char *));
+    if (!categories) return false;
+
+    /* summary */
+    u32 status_count[4] = { 0 };
+    for (u32 i = 0; i < count; i++) {
+        categories[i] = diffs[i].name ? diffs[i].name : "";
+        status_count[diffs[i].status]++;
+    }
+    snprintf(buf, sizeof(buf), "%s: %u passed, %u failed (%u faster, %u unchanged, %u new)",
+             title ? title : "Regression", count - status_count[YY_BENCH_STATUS_SLOWER],
+             status_count[YY_BENCH_STATUS_SLOWER], status_count[YY_BENCH_STATUS_FASTER],
+             status_count[YY_BENCH_STATUS_SAME], status_count[YY_BENCH_STATUS_NEW]);
+    suc &= yy_report_add_info(report, buf);
+    if (base && !yy_bench_baseline_env_match(base)) {
+        snprintf(buf, sizeof(buf), "Warning: baseline is recorded in another environment: %s",
+                 base->env);
+        suc &= yy_report_add_info(report, buf);
+    }
+
+    /* speedup bars, one series per status so the bars are colored by status */
+    yy_chart_options_init(&op);
+    op.title = title ? title : "Regression";
+    op.subtitle = "speedup vs baseline (baseline median / current median)";
+    op.type = YY_CHART_BAR;
+    op.colors = colors;
+    op.v_axis.categories = categories;
+    op.h_axis.title = "speedup";
+    op.tooltip.value_decimals = 3;
+    op.tooltip.value_suffix = "x";
+    op.plot.group_stacked = true;
+    op.plot.value_labels_enabled = true;
+    op.plot.value_labels_decimals = 3;
+
+    chart = yy_chart_new();
+    suc &= chart != NULL;
+    if (chart) {
+        suc &= yy_chart_set_options(chart, &op);
+        for (u32 s = 0; s < 4; s++) {
+            suc &= yy_chart_item_begin(chart, status_names[s]);
+            for (u32 i = 0; i < count; i++) {
+                const yy_bench_diff *d = diffs + i;
+                f64 val = (u32)d->status != s ? NAN :
+                          d->status == YY_BENCH_STATUS_NEW ? 1.0 : d->speedup;
+                suc &= yy_chart_item_add_float(chart, (float)val);
+            }
+            suc &= yy_chart_item_end(chart);
+        }
+        if (suc) suc = yy_report_add_chart(report, chart);
+        yy_chart_free(chart);
+    }
+
+    /* table of the differences, the status is appended to the row name */
+    yy_chart_options_init(&op);
+    op.title = title ? title : "Regression";
+    op.type = YY_CHART_TABLE;
+    op.h_axis.categories = columns;
+    chart = yy_chart_new();
+    suc &= chart != NULL;
+    if (chart) {
+        suc &= yy_chart_set_options(chart, &op);
+        for (u32 i = 0; i < count; i++) {
+            const yy_bench_diff *d = diffs + i;
+            snprintf(buf, sizeof(buf), "%s (%s)", categories[i],
+                     d->pass ? status_names[d->status] : "FAIL: slower");
+            suc &= yy_chart_item_begin(chart, buf);
+            suc &= yy_chart_item_add_float(chart, (float)d->base_median);
+            suc &= yy_chart_item_add_float(chart, (float)d->median);
+            suc &= yy_chart_item_add_float(chart, (float)((d->median / d->base_median - 1.0) * 100.0));
+            suc &= yy_chart_item_add_float(chart, (float)d->speedup);
+            suc &= yy_chart_item_add_float(chart, (float)d->low);
+            suc &= yy_chart_item_add_float(chart, (float)d->high);
+            suc &= yy_chart_item_end(chart);
+        }
+        if (suc) suc = yy_report_add_chart(report, chart);
+        yy_chart_free(chart);
+    }
+
+    free(categories);
+    return suc;
+}
+
+
+
+/*==============================================================================
+ * Sweep
+ *============================================================================*/
+
+struct yy_bench_sweep {
+    char *title;
+    char *arg_title;
+    u64 *args;
+    u32 arg_count;
+    bool logarithmic; /* use logarithmic axis for arguments */
+    f64 bytes_per_arg;
+    yy_bench_result *results; /* [impl][arg] */
+    char **names; /* name of each implementation */
+    u32 impl_count;
+    u32 impl_capacity;
+};
+
+/* Context of the benchmark function with argument. */
+typedef struct {
+    yy_bench_sweep_func func;
+    void *ctx;
+    u64 arg;
+} bench_sweep_ctx;
+
+static void bench_sweep_thunk(void *ctx, u64 iters) {
+    bench_sweep_ctx *sc = (bench_sweep_ctx *)ctx;
+    sc->func(sc->ctx, sc->arg, iters);
+}
+
+static yy_bench_sweep *bench_sweep_new(const char *title, u32 count) {
+    if (count == 0) return NULL;
+    yy_bench_sweep *sweep = (yy_bench_sweep *)calloc(1, sizeof(yy_bench_sweep));
+    if (!sweep) return NULL;
+    sweep->title = yy_str_copy(title ? title : "Sweep");
+    sweep->arg_title = yy_str_copy("argument");
+    sweep->args = (u64 *)calloc(count, sizeof(u64));
+    sweep->bytes_per_arg = 1.0;
+    if (!sweep->title || !sweep->arg_title || !sweep->args) {
+        yy_bench_sweep_free(sweep);
+        return NULL;
+    }
+    return sweep;
+}
+
+yy_bench_sweep *yy_bench_sweep_new_linear(const char *title,
+                                          u64 start, u64 end, u64 step) {
+    if (step == 0 || end < start) return NULL;
+    u64 count = (end - start) / step + 1;
+    if (count > ((u32)1 << 20)) return NULL;
+    yy_bench_sweep *sweep = bench_sweep_new(title, (u32)count);
+    if (!sweep) return NULL;
+    for (u64 i = 0; i < count; i++) sweep->args[i] = start + i * step;
+    sweep->arg_count = (u32)count;
+    return sweep;
+}
+
+yy_bench_sweep *yy_bench_sweep_new_pow2(const char *title, u64 start, u64 end) {
+    if (start == 0 || end < start) return NULL;
+    u32 count = 0;
+    for (u64 arg = start; arg <= end; arg *= 2) {
+        count++;
+        if (arg > end / 2) break;
+    }
+    yy_bench_sweep *sweep = bench_sweep_new(title, count);
+    if (!sweep) return NULL;
+    u64 arg = start;
+    for (u32 i = 0; i < count; i++, arg *= 2) sweep->args[i] = arg;
+    sweep->arg_count = count;
+    sweep->logarithmic = true;
+    return sweep;
+}
+
+yy_bench_sweep *yy_bench_sweep_new_list(const char *title,
+                                        const u64 *args, u32 count) {
+    if (!args) return NULL;
+    yy_bench_sweep *sweep = bench_sweep_new(title, count);
+    if (!sweep) return NULL;
+    memcpy(sweep->args, args, count * sizeof(u64));
+    sweep->arg_count = count;
+    u64 min = args[0], max = args[0];
+    for (u32 i = 1; i < count; i++) {
+        if (args[i] < min) min = args[i];
+        if (args[i] > max) max = args[i];
+    }
+    sweep->logarithmic = min > 0 && (f64)max / (f64)min >= 100.0;
+    return sweep;
+}
+
+void yy_bench_sweep_free(yy_bench_sweep *sweep) {
+    if (!sweep) return;
+    for (u32 i = 0; i < sweep->impl_count; i++) {
+        for (u32 a = 0; a < sweep->arg_count; a++) {
+            yy_bench_result_release(sweep->results + (usize)i * sweep->arg_count + a);
+        }
+        free(sweep->names[i]);
+    }
+    if (sweep->results) free(sweep->results);
+    if (sweep->names) free(sweep->names);
+    if (sweep->args) free(sweep->args);
+    if (sweep->title) free(sweep->title);
+    if (sweep->arg_title) free(sweep->arg_title);
+    free(sweep);
+}
+
+bool yy_bench_sweep_set_arg_title(yy_bench_sweep *sweep, const char *title) {
+    if (!sweep || !title) return false;
+    char *str = yy_str_copy(title);
+    if (!str) return false;
+    free(sweep->arg_title);
+    sweep->arg_title = str;
+    return true;
+}
+
+bool yy_bench_sweep_set_bytes_per_arg(yy_bench_sweep *sweep, f64 bytes) {
+    if (!sweep || !(bytes > 0)) return false;
+    sweep->bytes_per_arg = bytes;
+    return true;
+}
+
+bool yy_bench_sweep_run(yy_bench_sweep *sweep, const char *name,
+                        yy_bench_sweep_func func, void *ctx,
+                        const yy_bench_options *op) {
+    char buf[256];
+    if (!sweep || !name || !func) return false;
+    if (sweep->impl_count >= sweep->impl_capacity) {
+        u32 capacity = sweep->impl_capacity ? sweep->impl_capacity * 2 : 4;
+        yy_bench_result *results = realloc(sweep->results,
+            (usize)capacity * sweep->arg_count * sizeof(yy_bench_result));
+        if (!results) return false;
+        sweep->results = results;
+        char **names = realloc(sweep->names, capacity * sizeof(char *));
+        if (!names) return false;
+        sweep->names = names;
+        sweep->impl_capacity = capacity;
+    }
+    char *impl_name = yy_str_copy(name);
+    if (!impl_name) return false;
+
+    yy_bench_result *results = sweep->results + (usize)sweep->impl_count * sweep->arg_count;
+    bench_sweep_ctx sc;
+    sc.func = func;
+    sc.ctx = ctx;
+    for (u32 a = 0; a < sweep->arg_count; a++) {
+        sc.arg = sweep->args[a];
+        snprintf(buf, sizeof(buf), "%s/%llu", name, (unsigned long long)sc.arg);
+        if (!yy_bench_run(buf, bench_sweep_thunk, &sc, op, results + a)) {
+            while (a-- > 0) yy_bench_result_release(results + a);
+            free(impl_name);
+            return false;
+        }
+    }
+    sweep->names[sweep->impl_count++] = impl_name;
+    return true;
+}
+
+u32 yy_bench_sweep_get_arg_count(const yy_bench_sweep *sweep) {
+    return sweep ? sweep->arg_count : 0;
+}
+
+const u64 *yy_bench_sweep_get_args(const yy_bench_sweep *sweep) {
+    return sweep ? sweep->args : NULL;
+}
+
+u32 yy_bench_sweep_get_impl_count(const yy_bench_sweep *sweep) {
+    return sweep ? sweep->impl_count : 0;
+}
+
+const yy_bench_result *yy_bench_sweep_get_result(const yy_bench_sweep *sweep,
+                                                 u32 impl, u32 arg_idx) {
+    if (!sweep || impl >= sweep->impl_count || arg_idx >= sweep->arg_count) return NULL;
+    return sweep->results + (usize)impl * sweep->arg_count + arg_idx;
+}
+
+bool yy_bench_sweep_report(yy_report *report, const yy_bench_sweep *sweep,
+                           yy_bench_sweep_unit unit) {
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+
+    if (!report || !sweep || !sweep->impl_count) return false;
+    yy_chart_options_init(&op);
+    op.title = sweep->title;
+    op.type = YY_CHART_LINE;
+    op.h_axis.title = sweep->arg_title;
+    op.h_axis.logarithmic = sweep->logarithmic;
+    op.v_axis.title = unit == YY_BENCH_SWEEP_GBPS ? "GB/s" :
+                      unit == YY_BENCH_SWEEP_CYCLES ? "cycles/op" : "ns/op";
+    op.tooltip.value_decimals = 3;
+    op.tooltip.shared = true;
+    op.tooltip.crosshairs = true;
+
+    chart = yy_chart_new();
+    if (!chart) return false;
+    suc &= yy_chart_set_options(chart, &op);
+    for (u32 i = 0; i < sweep->impl_count; i++) {
+        suc &= yy_chart_item_begin(chart, sweep->names[i]);
+        for (u32 a = 0; a < sweep->arg_count; a++) {
+            const yy_bench_result *res = sweep->results + (usize)i * sweep->arg_count + a;
+            f64 val;
+            if (unit == YY_BENCH_SWEEP_GBPS) {
+                /* bytes per ns is GB/s */
+                val = res->ns.median > 0 ?
+                      (f64)sweep->args[a] * sweep->bytes_per_arg / res->ns.median : NAN;
+            } else if (unit == YY_BENCH_SWEEP_CYCLES) {
+                val = res->cycles.median;
+            } else {
+                val = res->ns.median;
+            }
+            suc &= yy_chart_item_add_point(chart, (float)sweep->args[a], (float)val);
+        }
+        suc &= yy_chart_item_end(chart);
+    }
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    return suc;
+}
+
+
+
+/*==============================================================================
+ * Parallel
+ *============================================================================*/
+
+typedef struct {
+    yy_spin_barrier barrier;
+    volatile bool failed;
+    yy_bench_parallel_func func;
+    void *ctx;
+    u64 iters;
+    u32 warmup;
+    u32 repetitions;
+    u64 **ticks; /* aligned buffer of each thread, start ticks then end ticks
+                    of each repetition */
+} bench_shared;
+
+/* Context of the single thread calibration. */
+typedef struct {
+    yy_bench_parallel_func func;
+    void *ctx;
+} bench_parallel_ctx;
+
+static void bench_parallel_thunk(void *ctx, u64 iters) {
+    bench_parallel_ctx *pc = (bench_parallel_ctx *)ctx;
+    pc->func(pc->ctx, 0, iters);
+}
+
+/* Allocate memory aligned to BENCH_CACHE_LINE, the size is rounded up so the
+   memory does not share cache line with others. */
+static void *bench_malloc_aligned(usize size) {
+    size = (size + BENCH_CACHE_LINE - 1) & ~(usize)(BENCH_CACHE_LINE - 1);
+    u8 *raw = (u8 *)malloc(size + BENCH_CACHE_LINE + sizeof(void *));
+    if (!raw) return NULL;
+    usize addr = (usize)(raw + sizeof(void *));
+    addr = (addr + BENCH_CACHE_LINE - 1) & ~(usize)(BENCH_CACHE_LINE - 1);
+    ((void **)addr)[-1] = raw;
+    return (void *)addr;
+}
+
+static void bench_free_aligned(void *ptr) {
+    if (ptr) free(((void **)ptr)[-1]);
+}
+
+/* Thread function of yy_thread_run(), called after the thread is pinned. */
+static void bench_worker_run(void *ctx, u32 index) {
+    bench_shared *shared = (bench_shared *)ctx;
+    u32 reps = shared->repetitions;
+
+    /* first touch after pinned, the buffer is allocated on local node */
+    u64 *ticks = (u64 *)bench_malloc_aligned((usize)reps * 2 * sizeof(u64));
+    if (ticks) {
+        memset(ticks, 0, (usize)reps * 2 * sizeof(u64));
+    } else {
+        shared->failed = true;
+    }
+    shared->ticks[index] = ticks;
+    if (!yy_spin_barrier_wait(&shared->barrier) || shared->failed) return;
+
+    for (u32 i = 0; i < shared->warmup; i++) {
+        if (!yy_spin_barrier_wait(&shared->barrier)) return;
+        shared->func(shared->ctx, index, shared->iters);
+    }
+    /* the next barrier waits for all threads to end the repetition */
+    for (u32 i = 0; i < reps; i++) {
+        if (!yy_spin_barrier_wait(&shared->barrier)) return;
+        u64 t1 = yy_time_get_ticks_begin();
+        shared->func(shared->ctx, index, shared->iters);
+        u64 t2 = yy_time_get_ticks_end();
+        ticks[i] = t1;
+        ticks[reps + i] = t2;
+    }
+}
+
+/* Collect the ticks of threads to result. */
+static bool bench_parallel_collect(u64 *const *ticks, u32 thread_count,
+                                   yy_bench_parallel_result *result) {
+    u32 reps = result->sample_count;
+    u64 *walls = (u64 *)calloc(reps, sizeof(u64));
+    u64 *skews = (u64 *)calloc(reps, sizeof(u64));
+    yy_bench_summary sum;
+    bool suc = walls && skews;
+
+    for (u32 r = 0; suc && r < reps; r++) {
+        u64 first = ticks[0][r], last = first;
+        u64 end = ticks[0][reps + r];
+        for (u32 t = 0; t < thread_count; t++) {
+            u64 t1 = ticks[t][r];
+            u64 t2 = ticks[t][reps + r];
+            result->samples[(usize)t * reps + r] = yy_time_ticks_elapsed(t1, t2);
+            if (t1 < first) first = t1;
+            if (t1 > last) last = t1;
+            if (t2 > end) end = t2;
+        }
+        walls[r] = yy_time_ticks_elapsed(first, end);
+        skews[r] = last - first;
+    }
+
+    if (suc) suc = bench_summarize(result->samples, thread_count * reps, &sum);
+    if (suc) {
+        f64 tick_per_sec = (f64)yy_cpu_get_tick_per_sec();
+        f64 ns_per_tick = 1e9 / tick_per_sec;
+        f64 iters = (f64)result->iters;
+        f64 wall = yy_stats_median(walls, reps);
+        bench_summary_scale(&sum, ns_per_tick / iters, &result->ns);
+        for (u32 t = 0; t < thread_count; t++) {
+            f64 median = yy_stats_median(result->samples + (usize)t * reps, reps);
+            result->thread_ns[t] = median * ns_per_tick / iters;
+        }
+        result->throughput = wall > 0 ? iters * thread_count * tick_per_sec / wall : NAN;
+        result->start_skew = yy_stats_median(skews, reps) * ns_per_tick;
+        result->efficiency = NAN;
+    }
+    if (walls) free(walls);
+    if (skews) free(skews);
+    return suc;
+}
+
+bool yy_bench_run_parallel(const char *name, yy_bench_parallel_func func,
+                           void *ctx, u32 thread_count,
+                           const yy_bench_options *op,
+                           yy_bench_parallel_result *result) {
+    yy_bench_options def;
+    bench_shared shared;
+    u64 **ticks;
+    bool suc;
+
+    if (!result) return false;
+    memset(result, 0, sizeof(yy_bench_parallel_result));
+    if (!name || !func || thread_count < 1) return false;
+#if defined(_WIN32)
+    if (thread_count > 1) return false;
+#endif
+    if (!op) {
+        yy_bench_options_init(&def);
+        op = &def;
+    }
+    if (op->repetitions == 0) return false;
+    if (yy_cpu_get_tick_per_sec() == 0) yy_cpu_measure_freq_fast(NULL);
+
+    result->name = yy_str_copy(name);
+    result->samples = (u64 *)calloc((usize)thread_count * op->repetitions, sizeof(u64));
+    result->thread_ns = (f64 *)calloc(thread_count, sizeof(f64));
+    ticks = (u64 **)calloc(thread_count, sizeof(u64 *));
+    if (!result->name || !result->samples || !result->thread_ns || !ticks) {
+        if (ticks) free(ticks);
+        yy_bench_parallel_result_release(result);
+        return false;
+    }
+
+    /* calibrate with a single thread */
+    u64 iters = op->iters;
+    if (iters == 0) {
+        bench_parallel_ctx pc;
+        pc.func = func;
+        pc.ctx = ctx;
+        f64 tick_per_sec = (f64)yy_cpu_get_tick_per_sec();
+        u64 min_ticks = (u64)(op->min_time * tick_per_sec);
+        u64 timer_ticks = BENCH_TIMER_FACTOR * (yy_time_get_ticks_overhead() + 1);
+        if (min_ticks < timer_ticks) min_ticks = timer_ticks;
+        iters = bench_calibrate(bench_parallel_thunk, &pc, min_ticks);
+    }
+    result->thread_count = thread_count;
+    result->iters = iters;
+    result->sample_count = op->repetitions;
+
+    memset(&shared, 0, sizeof(shared));
+    yy_spin_barrier_init(&shared.barrier, thread_count);
+    shared.func = func;
+    shared.ctx = ctx;
+    shared.iters = iters;
+    shared.warmup = op->warmup;
+    shared.repetitions = op->repetitions;
+    shared.ticks = ticks;
+
+    suc = yy_thread_run(thread_count, bench_worker_run, &shared,
+                        &shared.barrier, &result->unpinned_count);
+    suc = suc && !shared.failed;
+    if (suc) suc = bench_parallel_collect(ticks, thread_count, result);
+    for (u32 i = 0; i < thread_count; i++) bench_free_aligned(ticks[i]);
+    free(ticks);
+    if (!suc) yy_bench_parallel_result_release(result);
+    return suc;
+}
+
+void yy_bench_parallel_result_release(yy_bench_parallel_result *result) {
+    if (!result) return;
+    if (result->name) free(result->name);
+    if (result->samples) free(result->samples);
+    if (result->thread_ns) free(result->thread_ns);
+    memset(result, 0, sizeof(yy_bench_parallel_result));
+}
+
+u32 yy_bench_run_scaling(const char *name, yy_bench_parallel_func func,
+                         void *ctx, u32 max_threads,
+                         const yy_bench_options *op,
+                         yy_bench_parallel_result **results) {
+    yy_bench_options run_op;
+    yy_bench_parallel_result *arr;
+    char buf[256];
+    u32 count = 0;
+
+    if (!results) return 0;
+    *results = NULL;
+    if (!name || !func) return 0;
+    if (max_threads == 0) max_threads = yy_thread_get_core_count();
+    if (max_threads == 0) max_threads = 1;
+#if defined(_WIN32)
+    max_threads = 1;
+#endif
+
+    /* thread counts: 1, 2, ..., 8, 16, 32, ..., max_threads */
+    u32 total = 0;
+    for (u32 n = 1; n <= max_threads;) {
+        total++;
+        if (n == max_threads) break;
+        n = n < BENCH_SCALING_LINEAR_MAX ? n + 1 : n * 2;
+        if (n > max_threads) n = max_threads;
+    }
+    arr = (yy_bench_parallel_result *)calloc(total, sizeof(yy_bench_parallel_result));
+    if (!arr) return 0;
+
+    if (op) run_op = *op;
+    else yy_bench_options_init(&run_op);
+    for (u32 n = 1; count < total;) {
+        snprintf(buf, sizeof(buf), "%s/%u", name, n);
+        if (!yy_bench_run_parallel(buf, func, ctx, n, &run_op, arr + count)) {
+            yy_bench_scaling_free(arr, count);
+            return 0;
+        }
+        /* keep the work per thread for all thread counts */
+        run_op.iters = arr[0].iters;
+        arr[count].efficiency = arr[0].throughput > 0 ?
+            arr[count].throughput / (arr[0].throughput * n) : NAN;
+        count++;
+        n = n < BENCH_SCALING_LINEAR_MAX ? n + 1 : n * 2;
+        if (n > max_threads) n = max_threads;
+    }
+    *results = arr;
+    return count;
+}
+
+void yy_bench_scaling_free(yy_bench_parallel_result *results, u32 count) {
+    if (!results) return;
+    for (u32 i = 0; i < count; i++) yy_bench_parallel_result_release(results + i);
+    free(results);
+}
+
+bool yy_bench_scaling_report(yy_report *report, const char *title,
+                             const yy_bench_parallel_result *results, u32 count) {
+    static const char *columns[] = {
+        "threads", "iterations", "throughput (M/s)", "efficiency (%)",
+        "median (ns)", "p99 (ns)", "slowest thread (ns)", "start skew (ns)",
+        "unpinned threads", NULL
+    };
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+
+    if (!report || !results || !count) return false;
+    if (!title) title = "Scaling";
+
+    /* throughput with the ideal linear scaling */
+    yy_chart_options_init(&op);
+    op.title = title;
+    op.subtitle = "aggregate throughput";
+    op.type = YY_CHART_LINE;
+    op.h_axis.title = "threads";
+    op.h_axis.allow_decimals = false;
+    op.v_axis.title = "M iterations/s";
+    op.tooltip.value_decimals = 3;
+    op.tooltip.shared = true;
+    op.tooltip.crosshairs = true;
+    chart = yy_chart_new();
+    suc &= chart != NULL;
+    if (chart) {
+        suc &= yy_chart_set_options(chart, &op);
+        suc &= yy_chart_item_begin(chart, "measured");
+        for (u32 i = 0; i < count; i++) {
+            suc &= yy_chart_item_add_point(chart, (float)results[i].thread_count,
+                                           (float)(results[i].throughput / 1e6));
+        }
+        suc &= yy_chart_item_end(chart);
+        suc &= yy_chart_item_begin(chart, "ideal");
+        for (u32 i = 0; i < count; i++) {
+            f64 val = results[0].throughput / results[0].thread_count *
+                      results[i].thread_count;
+            suc &= yy_chart_item_add_point(chart, (float)results[i].thread_count,
+                                           (float)(val / 1e6));
+        }
+        suc &= yy_chart_item_end(chart);
+        if (suc) suc = yy_report_add_chart(report, chart);
+        yy_chart_free(chart);
+    }
+
+    /* parallel efficiency */
+    yy_chart_options_init(&op);
+    op.title = title;
+    op.subtitle = "parallel efficiency: throughput / (single thread throughput * threads)";
+    op.type = YY_CHART_LINE;
+    op.h_axis.title = "threads";
+    op.h_axis.allow_decimals = false;
+    op.v_axis.title = "efficiency (%)";
+    op.v_axis.min = 0;
+    op.tooltip.value_decimals = 1;
+    op.tooltip.value_suffix = "%";
+    chart = yy_chart_new();
+    suc &= chart != NULL;
+    if (chart) {
+        suc &= yy_chart_set_options(chart, &op);
+        suc &= yy_chart_item_begin(chart, "efficiency");
+        for (u32 i = 0; i < count; i++) {
+            suc &= yy_chart_item_add_point(chart, (float)results[i].thread_count,
+                                           (float)(results[i].efficiency * 100.0));
+        }
+        suc &= yy_chart_item_end(chart);
+        if (suc) suc = yy_report_add_chart(report, chart);
+        yy_chart_free(chart);
+    }
+
+    /* table with the latency of threads */
+    yy_chart_options_init(&op);
+    op.title = title;
+    op.type = YY_CHART_TABLE;
+    op.h_axis.categories = columns;
+    chart = yy_chart_new();
+    suc &= chart != NULL;
+    if (chart) {
+        suc &= yy_chart_set_options(chart, &op);
+        for (u32 i = 0; i < count; i++) {
+            const yy_bench_parallel_result *res = results + i;
+            f64 slowest = 0;
+            for (u32 t = 0; t < res->thread_count; t++) {
+                if (res->thread_ns[t] > slowest) slowest = res->thread_ns[t];
+            }
+            suc &= yy_chart_item_begin(chart, res->name ? res->name : "");
+            suc &= yy_chart_item_add_float(chart, (float)res->thread_count);
+            suc &= yy_chart_item_add_float(chart, (float)res->iters);
+            suc &= yy_chart_item_add_float(chart, (float)(res->throughput / 1e6));
+            suc &= yy_chart_item_add_float(chart, (float)(res->efficiency * 100.0));
+            suc &= yy_chart_item_add_float(chart, (float)res->ns.median);
+            suc &= yy_chart_item_add_float(chart, (float)res->ns.p99);
+            suc &= yy_chart_item_add_float(chart, (float)slowest);
+            suc &= yy_chart_item_add_float(chart, (float)res->start_skew);
+            suc &= yy_chart_item_add_float(chart, (float)res->unpinned_count);
+            suc &= yy_chart_item_end(chart);
+        }
+        if (suc) suc = yy_report_add_chart(report, chart);
+        yy_chart_free(chart);
+    }
+    return suc;
+}
@@ -0,0 +1,399 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_bench_h
+#define yybench_bench_h
+
+#include "yybench_def.h"
+#include "yybench_chart.h"
+#include "yybench_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * Benchmark Runner
+
+ Run a function with an auto-calibrated iteration count, and collect the
+ ticks of each repetition:
+ 1. Calibrate: the iteration count grows until one repetition takes at least
+    the target duration, and is long enough compared to the timer resolution
+    and the timer overhead.
+ 2. Warmup: run some repetitions without recording.
+ 3. Measure: record the ticks of each repetition.
+
+ yy_cpu_measure_freq() (or yy_cpu_measure_freq_fast()) should be called before
+ running, otherwise yy_cpu_measure_freq_fast() is called on first run.
+
+ Usage:
+
+     static void bench_strlen(void *ctx, u64 iters) {
+         const char *str = ctx;
+         for (u64 i = 0; i < iters; i++) {
+             usize len = strlen(str);
+             yy_bench_keep(&len);
+         }
+     }
+
+     yy_bench_result result;
+     if (yy_bench_run("strlen", bench_strlen, "hello", NULL, &result)) {
+         printf("%s: %.2f ns/op, %.2f cycles/op\n", result.name,
+                result.ns.median, result.cycles.median);
+         yy_bench_result_release(&result);
+     }
+
+ *============================================================================*/
+
+/** A benchmark function, it should run the measured code `iters` times. */
+typedef void (*yy_bench_func)(void *ctx, u64 iters);
+
+/** Options of the runner. */
+typedef struct yy_bench_options {
+    f64 min_time; /* target duration of one repetition in seconds, default 0.01 */
+    u32 warmup; /* warmup repetitions, default 2 */
+    u32 repetitions; /* measured repetitions, default 30 */
+    u64 iters; /* iterations of one repetition, 0 to calibrate (default) */
+} yy_bench_options;
+
+/** Summary of the samples, per iteration. */
+typedef struct yy_bench_summary {
+    f64 min;
+    f64 median;
+    f64 mean;
+    f64 p90;
+    f64 p99;
+} yy_bench_summary;
+
+/** Result of a benchmark. */
+typedef struct yy_bench_result {
+    char *name; /* benchmark name */
+    u64 iters; /* iterations of each repetition */
+    u32 sample_count; /* repetitions */
+    u64 *samples; /* ticks of each repetition, timer overhead subtracted */
+    yy_bench_summary ns; /* nanoseconds per iteration */
+    yy_bench_summary cycles; /* CPU cycles per iteration */
+    yy_stats_ci median_ci; /* 95% bootstrap confidence interval of ns.median */
+    u32 outlier_count; /* samples classified as outliers by MAD */
+} yy_bench_result;
+
+/** Init options with default values. */
+void yy_bench_options_init(yy_bench_options *op);
+
+/** Run a benchmark.
+    @param name The benchmark name.
+    @param func The benchmark function.
+    @param ctx The context passed to func.
+    @param op The options, NULL to use the default.
+    @param result The result, should be released with yy_bench_result_release().
+    @return false on error (invalid parameter or out of memory). */
+bool yy_bench_run(const char *name, yy_bench_func func, void *ctx,
+                  const yy_bench_options *op, yy_bench_result *result);
+
+/** Release the result. */
+void yy_bench_result_release(yy_bench_result *result);
+
+/** Add a table of results to report, one row for each result.
+    @param title The table title, or NULL to use the default. */
+bool yy_bench_report(yy_report *report, const char *title,
+                     const yy_bench_result *results, u32 count);
+
+/** Prevent the compiler from optimizing away a value computed in the
+    benchmark function. */
+static yy_inline void yy_bench_keep(void *ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __asm volatile("" : : "r"(ptr) : "memory");
+#else
+    static void *volatile sink;
+    sink = ptr;
+#endif
+}
+
+
+/*==============================================================================
+ * Baseline
+
+ A baseline stores the summary of benchmark results (median and its
+ confidence interval in ns per iteration) with the environment fingerprint
+ (OS, CPU and compiler) in a small text file. A later run is compared with it,
+ a benchmark fails if it is slower than the threshold and the confidence
+ intervals do not overlap.
+
+ Usage:
+
+     yy_bench_baseline *base = yy_bench_baseline_load("parser.baseline");
+     if (!base) base = yy_bench_baseline_new();
+
+     yy_bench_diff diff;
+     yy_bench_baseline_compare(base, &result, 0.03, &diff);
+     if (!diff.pass) printf("%s: %.1f%% slower\n", diff.name,
+                            (1.0 / diff.speedup - 1.0) * 100.0);
+     yy_bench_baseline_report(report, base, NULL, &diff, 1);
+
+     // update the baseline if accepted
+     yy_bench_baseline_add(base, &result);
+     yy_bench_baseline_save(base, "parser.baseline");
+     yy_bench_baseline_free(base);
+
+ *============================================================================*/
+
+/** A set of benchmark summaries. */
+typedef struct yy_bench_baseline yy_bench_baseline;
+
+/** Status of a benchmark compared with baseline. */
+typedef enum yy_bench_status {
+    YY_BENCH_STATUS_NEW = 0, /* not in baseline */
+    YY_BENCH_STATUS_SAME, /* no significant change */
+    YY_BENCH_STATUS_FASTER, /* significantly faster */
+    YY_BENCH_STATUS_SLOWER /* significantly slower (regression) */
+} yy_bench_status;
+
+/** Difference between a result and the baseline, in ns per iteration. */
+typedef struct yy_bench_diff {
+    const char *name; /* owned by the result */
+    yy_bench_status status;
+    bool pass; /* false if slower */
+    f64 base_median, base_low, base_high; /* baseline, NaN if new */
+    f64 median, low, high; /* current result */
+    f64 speedup; /* base_median / median, NaN if new */
+} yy_bench_diff;
+
+/** Creates an empty baseline with the current environment. */
+yy_bench_baseline *yy_bench_baseline_new(void);
+
+/** Load a baseline file, returns NULL if the file is not found or invalid. */
+yy_bench_baseline *yy_bench_baseline_load(const char *path);
+
+/** Save the baseline to file, with the current environment.
+    The file is replaced atomically, a crash never leaves a partial file. */
+bool yy_bench_baseline_save(yy_bench_baseline *base, const char *path);
+
+/** Free the baseline. */
+void yy_bench_baseline_free(yy_bench_baseline *base);
+
+/** Add or replace (with same name) a result summary. */
+bool yy_bench_baseline_add(yy_bench_baseline *base, const yy_bench_result *result);
+
+/** Get the environment fingerprint of the baseline: "os|cpu|compiler". */
+const char *yy_bench_baseline_get_env(const yy_bench_baseline *base);
+
+/** Whether the baseline is recorded in the current environment,
+    results from a different environment are not comparable. */
+bool yy_bench_baseline_env_match(const yy_bench_baseline *base);
+
+/** Compare a result with the baseline.
+    @param threshold The relative change to be reported, 0 to use default (0.03).
+    @return false if the parameters are invalid. */
+bool yy_bench_baseline_compare(const yy_bench_baseline *base,
+                               const yy_bench_result *result, f64 threshold,
+                               yy_bench_diff *diff);
+
+/** Add a regression report: speedup bars and a table of the differences.
+    @param base The baseline, used to check the environment, can be NULL.
+    @param title The title, or NULL to use the default. */
+bool yy_bench_baseline_report(yy_report *report, const yy_bench_baseline *base,
+                              const char *title,
+                              const yy_bench_diff *diffs, u32 count);
+
+
+
+/*==============================================================================
+ * Sweep
+
+ Run benchmarks over a range of arguments (such as input sizes), one line per
+ implementation, and render a chart of ns/op, cycles/op or GB/s per argument.
+
+ Usage:
+
+     typedef struct { u8 *dst, *src; } copy_ctx; // 1GB buffers
+
+     static void bench_memcpy(void *ctx, u64 size, u64 iters) {
+         copy_ctx *c = ctx;
+         for (u64 i = 0; i < iters; i++) {
+             memcpy(c->dst, c->src, size);
+             yy_bench_keep(c->dst);
+         }
+     }
+
+     // 16B to 1GB
+     yy_bench_sweep *sweep = yy_bench_sweep_new_pow2("copy", 16, 1 << 30);
+     yy_bench_sweep_set_arg_title(sweep, "size (bytes)");
+     yy_bench_sweep_run(sweep, "memcpy", bench_memcpy, &ctx, NULL);
+     yy_bench_sweep_run(sweep, "my_memcpy", bench_my_memcpy, &ctx, NULL);
+     yy_bench_sweep_report(report, sweep, YY_BENCH_SWEEP_GBPS);
+     yy_bench_sweep_free(sweep);
+
+ *============================================================================*/
+
+/** A benchmark function with an argument, it should run the measured code
+    `iters` times with the argument (such as input size). */
+typedef void (*yy_bench_sweep_func)(void *ctx, u64 arg, u64 iters);
+
+/** Unit of the sweep chart. */
+typedef enum yy_bench_sweep_unit {
+    YY_BENCH_SWEEP_NS = 0, /* median ns per iteration */
+    YY_BENCH_SWEEP_CYCLES, /* median CPU cycles per iteration */
+    YY_BENCH_SWEEP_GBPS /* GB/s, with (arg * bytes_per_arg) bytes per iteration */
+} yy_bench_sweep_unit;
+
+/** A sweep: the results of each implementation over the arguments. */
+typedef struct yy_bench_sweep yy_bench_sweep;
+
+/** Creates a sweep with arguments: start, start + step, ... (<= end).
+    Returns NULL if the range is invalid. */
+yy_bench_sweep *yy_bench_sweep_new_linear(const char *title,
+                                          u64 start, u64 end, u64 step);
+
+/** Creates a sweep with arguments: start, start * 2, ... (<= end),
+    the chart uses a logarithmic axis. Returns NULL if the range is invalid. */
+yy_bench_sweep *yy_bench_sweep_new_pow2(const char *title, u64 start, u64 end);
+
+/** Creates a sweep with a list of arguments (copied), the chart uses a
+    logarithmic axis if the arguments span more than 2 orders of magnitude. */
+yy_bench_sweep *yy_bench_sweep_new_list(const char *title,
+                                        const u64 *args, u32 count);
+
+/** Free the sweep. */
+void yy_bench_sweep_free(yy_bench_sweep *sweep);
+
+/** Set the title of the argument axis, default is "argument". */
+bool yy_bench_sweep_set_arg_title(yy_bench_sweep *sweep, const char *title);
+
+/** Set the bytes processed per iteration for each unit of argument,
+    used by YY_BENCH_SWEEP_GBPS, default is 1 (the argument is byte count). */
+bool yy_bench_sweep_set_bytes_per_arg(yy_bench_sweep *sweep, f64 bytes);
+
+/** Run an implementation over all arguments, the result of each argument
+    is named "name/arg".
+    @param op The options of each argument, NULL to use the default. */
+bool yy_bench_sweep_run(yy_bench_sweep *sweep, const char *name,
+                        yy_bench_sweep_func func, void *ctx,
+                        const yy_bench_options *op);
+
+/** Get the argument count. */
+u32 yy_bench_sweep_get_arg_count(const yy_bench_sweep *sweep);
+
+/** Get the arguments. */
+const u64 *yy_bench_sweep_get_args(const yy_bench_sweep *sweep);
+
+/** Get the implementation count. */
+u32 yy_bench_sweep_get_impl_count(const yy_bench_sweep *sweep);
+
+/** Get the result of an implementation (in run order) with an argument,
+    returns NULL if the index is out of range. */
+const yy_bench_result *yy_bench_sweep_get_result(const yy_bench_sweep *sweep,
+                                                 u32 impl, u32 arg_idx);
+
+/** Add a line chart to report, one line per implementation. */
+bool yy_bench_sweep_report(yy_report *report, const yy_bench_sweep *sweep,
+                           yy_bench_sweep_unit unit);
+
+
+
+/*==============================================================================
+ * Parallel
+
+ Run a function on multiple threads at the same time, to measure the aggregate
+ throughput and the latency of each thread under contention:
+ 1. The threads are pinned to one hardware thread of each core first (the
+    calling thread is thread 0), only the cpus allowed by the affinity or
+    cpuset are used, and the threads that cannot be pinned are counted in
+    `unpinned_count`. Each thread records its ticks into its own
+    cache-line-aligned buffer, so the threads do not share cache lines.
+ 2. In each repetition, the threads are released together by a spin barrier,
+    and each thread runs the function `iters` times.
+ 3. The throughput of a repetition is the iterations of all threads divided by
+    the time from the first start to the last end.
+
+ The iteration count is calibrated with a single thread, so a scaling run keeps
+ the same work per thread for each thread count (weak scaling). The start skew
+ assumes the timer is synchronized across cores (such as invariant TSC).
+ Multiple threads are not supported on Windows.
+
+ Usage:
+
+     static void bench_inc(void *ctx, u32 thread, u64 iters) {
+         u64 *counter = ctx; // shared counter
+         for (u64 i = 0; i < iters; i++) {
+             __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+         }
+     }
+
+     // 1 thread to all cores
+     yy_bench_parallel_result *results;
+     u32 count = yy_bench_run_scaling("atomic_inc", bench_inc, &counter,
+                                      0, NULL, &results);
+     yy_bench_scaling_report(report, NULL, results, count);
+     yy_bench_scaling_free(results, count);
+
+ *============================================================================*/
+
+/** A benchmark function run by each thread, it should run the measured code
+    `iters` times. The thread index is from 0 to thread_count - 1. */
+typedef void (*yy_bench_parallel_func)(void *ctx, u32 thread, u64 iters);
+
+/** Result of a parallel benchmark. */
+typedef struct yy_bench_parallel_result {
+    char *name; /* benchmark name */
+    u32 thread_count;
+    u64 iters; /* iterations of each thread in each repetition */
+    u32 sample_count; /* repetitions */
+    u64 *samples; /* ticks of each thread in each repetition: [thread][rep] */
+    f64 *thread_ns; /* median ns per iteration of each thread */
+    yy_bench_summary ns; /* ns per iteration of all threads */
+    f64 throughput; /* median iterations per second of all threads */
+    f64 efficiency; /* throughput / (single thread throughput * thread_count),
+                       set by yy_bench_run_scaling(), NaN otherwise */
+    f64 start_skew; /* median ns from the first thread start to the last */
+    u32 unpinned_count; /* threads not pinned to a cpu, such as the cpu is
+                           not allowed or unknown, the result may be noisy */
+} yy_bench_parallel_result;
+
+/** Run a benchmark on multiple threads.
+    @param name The benchmark name.
+    @param func The benchmark function.
+    @param ctx The context passed to func, shared by all threads.
+    @param thread_count The thread count, threads more than cpus are allowed.
+    @param op The options, NULL to use the default.
+    @param result The result, should be released with
+        yy_bench_parallel_result_release().
+    @return false on error (invalid parameter, out of memory, or failed to
+        create thread). */
+bool yy_bench_run_parallel(const char *name, yy_bench_parallel_func func,
+                           void *ctx, u32 thread_count,
+                           const yy_bench_options *op,
+                           yy_bench_parallel_result *result);
+
+/** Release the result. */
+void yy_bench_parallel_result_release(yy_bench_parallel_result *result);
+
+/** Run a benchmark with thread counts from 1 to max_threads: every count up to
+    8, then powers of 2 and max_threads. The result of each count is named
+    "name/threads", and the efficiency is relative to the single thread run.
+    @param max_threads The max thread count, 0 to use the count of cores
+        allowed by the affinity or cpuset.
+    @param results Receives the results, should be freed with
+        yy_bench_scaling_free().
+    @return The result count, 0 on error. */
+u32 yy_bench_run_scaling(const char *name, yy_bench_parallel_func func,
+                         void *ctx, u32 max_threads,
+                         const yy_bench_options *op,
+                         yy_bench_parallel_result **results);
+
+/** Free the results of yy_bench_run_scaling(). */
+void yy_bench_scaling_free(yy_bench_parallel_result *results, u32 count);
+
+/** Add a scaling report: throughput and parallel efficiency charts over the
+    thread count, and a table with the latency of the threads.
+    @param title The title, or NULL to use the default. */
+bool yy_bench_scaling_report(yy_report *report, const char *title,
+                             const yy_bench_parallel_result *results, u32 count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
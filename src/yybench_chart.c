@@ -6,6 +6,7 @@
 #include "yybench_chart.h"
 #include "yybench_env.h"
 #include "yybench_cpu.h"
+#include "yybench_topo.h"
 #include "yybench_file.h"
 
 #define ARR_TYPE(type) yy_buf
@@ -18,8 +19,10 @@
 
 typedef struct {
     f64 v;
+    f64 x;
     bool is_integer;
     bool is_null;
+    bool has_x;
 } yy_chart_value;
 
 typedef struct {
@@ -214,8 +217,10 @@ bool yy_chart_item_add_int(yy_chart *chart, int value) {
     
     if (!chart || !chart->item_opened) return false;
     cvalue.v = value;
+    cvalue.x = 0;
     cvalue.is_integer = true;
     cvalue.is_null = false;
+    cvalue.has_x = false;
     count = ARR_COUNT(chart->items, yy_chart_item);
     item = ARR_GET(chart->items, yy_chart_item, count - 1);
     return ARR_ADD(item->values, cvalue, yy_chart_value);
@@ -228,8 +233,27 @@ bool yy_chart_item_add_float(yy_chart *chart, float value) {
     
     if (!chart || !chart->item_opened) return false;
     cvalue.v = value;
+    cvalue.x = 0;
     cvalue.is_integer = false;
     cvalue.is_null = !isfinite(cvalue.v);
+    cvalue.has_x = false;
+    count = ARR_COUNT(chart->items, yy_chart_item);
+    item = ARR_GET(chart->items, yy_chart_item, count - 1);
+    return ARR_ADD(item->values, cvalue, yy_chart_value);
+}
+
+bool yy_chart_item_add_point(yy_chart *chart, float x, float y) {
+    size_t count;
+    yy_chart_item *item;
+    yy_chart_value cvalue;
+    
+    if (!chart || !chart->item_opened) return false;
+    if (!isfinite(x)) return false;
+    cvalue.v = y;
+    cvalue.x = x;
+    cvalue.is_integer = false;
+    cvalue.is_null = !isfinite(cvalue.v);
+    cvalue.has_x = true;
     count = ARR_COUNT(chart->items, yy_chart_item);
     item = ARR_GET(chart->items, yy_chart_item, count - 1);
     return ARR_ADD(item->values, cvalue, yy_chart_value);
@@ -373,6 +397,8 @@ bool yy_report_add_env_info(yy_report *report) {
     if (!yy_report_add_info(report, info)) return false;
     snprintf(info, sizeof(info), "CPU Frequency: %.2f MHz", yy_cpu_get_freq() / 1000.0 / 1000.0);
     if (!yy_report_add_info(report, info)) return false;
+    snprintf(info, sizeof(info), "Topology: %s", yy_topo_get_desc());
+    if (!yy_report_add_info(report, info)) return false;
     return true;
 }
 
@@ -766,9 +792,11 @@ bool yy_report_write_html_string(yy_report *report, char **html, usize *len) {
                 AS("        { name: '"); AE(item->name); AS("', data: [");
                 for ((void)(v = 0), val_count = ARR_COUNT(item->values, yy_chart_value); v < val_count; v++) {
                     val = ARR_GET(item->values, yy_chart_value, v);
+                    if (val->has_x) AF("[%f, ", (float)val->x);
                     if (val->is_null) AS("null");
                     else if (val->is_integer) AF("%d", (int)val->v);
                     else AF("%f", (float)val->v);
+                    if (val->has_x) AS("]");
                     if (v + 1 < val_count) AS(", ");
                 }
                 AS("] }"); if (i + 1 < item_count) AS(","); LS("");
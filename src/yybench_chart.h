@@ -216,6 +216,11 @@ bool yy_chart_item_add_int(yy_chart *chart, int value);
 /** Add a floating value to current chart item */
 bool yy_chart_item_add_float(yy_chart *chart, float value);
 
+/** Add a point with explicit x value to current chart item (line chart only),
+    the plot.point_start and plot.point_interval are ignored for this point.
+    It can be used with a logarithmic h_axis. */
+bool yy_chart_item_add_point(yy_chart *chart, float x, float y);
+
 /** End a chart item */
 bool yy_chart_item_end(yy_chart *chart);
 
@@ -5,6 +5,16 @@
 
 #include "yybench_cpu.h"
 #include "yybench_time.h"
+#include "yybench_env.h"
+#include "yybench_file.h"
+#include "yybench_str.h"
+#include "yybench_topo.h"
+
+#ifndef _WIN32
+#include <sys/utsname.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define REPEAT_2(x)   x x
 #define REPEAT_4(x)   REPEAT_2(REPEAT_2(x))
@@ -178,23 +188,28 @@ void yy_cpu_run_seq_b(void) {
 static u64 yy_cycle_per_sec = 0;
 static u64 yy_tick_per_sec = 0;
 
-void yy_cpu_measure_freq(void) {
-#define warmup_count 8
-#define measure_count 128
+/* Run sequence a and b repeatedly, measure the CPU frequency and the timer
+   frequency. More runs give more stable result, but take longer time. */
+static void cpu_measure_freq(int warmup_count, int measure_count,
+                             u64 *cycle_per_sec, u64 *tick_per_sec) {
+#define max_measure_count 128
     yy_time p1, p2;
-    u64 ticks_a[measure_count];
-    u64 ticks_b[measure_count];
+    u64 ticks_a[max_measure_count];
+    u64 ticks_b[max_measure_count];
+    if (measure_count > max_measure_count) measure_count = max_measure_count;
+    if (measure_count < 1) measure_count = 1;
     
     /* warm up CPU caches and stabilize the frequency */
     for (int i = 0; i < warmup_count; i++) {
         yy_cpu_run_seq_a();
         yy_cpu_run_seq_b();
-        yy_time_get_current(&p1);
+        yy_time_get_current_with_clock(&p1, YY_TIME_CLOCK_DEFAULT);
         yy_time_get_ticks();
     }
     
-    /* run sequence a and b repeatedly, record ticks and times */
-    yy_time_get_current(&p1);
+    /* run sequence a and b repeatedly, record ticks and times,
+       use monotonic clock to avoid the wall time adjustment */
+    yy_time_get_current_with_clock(&p1, YY_TIME_CLOCK_DEFAULT);
     u64 t1 = yy_time_get_ticks();
     for (int i = 0; i < measure_count; i++) {
         u64 s1 = yy_time_get_ticks();
@@ -206,12 +221,12 @@ void yy_cpu_measure_freq(void) {
         ticks_b[i] = s3 - s2;
     }
     u64 t2 = yy_time_get_ticks();
-    yy_time_get_current(&p2);
+    yy_time_get_current_with_clock(&p2, YY_TIME_CLOCK_DEFAULT);
     
     /* calculate tick count per second, this value is high precision */
     f64 total_seconds = yy_time_to_seconds(&p2) - yy_time_to_seconds(&p1);
     u64 total_ticks = t2 - t1;
-    yy_tick_per_sec = (u64)((f64)total_ticks / total_seconds);
+    *tick_per_sec = (u64)((f64)total_ticks / total_seconds);
     
     /* find the minimum ticks of each sequence to avoid inaccurate values
        caused by context switching, etc. */
@@ -224,9 +239,292 @@ void yy_cpu_measure_freq(void) {
        loops and function calls */
     u64 one_ticks = ticks_b[0] - ticks_a[0];
     u64 one_insts = YY_CPU_RUN_INST_COUNT_B - YY_CPU_RUN_INST_COUNT_A;
-    yy_cycle_per_sec = (u64)((f64)one_insts / (f64)one_ticks * (f64)yy_tick_per_sec);
-#undef warmup_count
-#undef measure_count
+    *cycle_per_sec = (u64)((f64)one_insts / (f64)one_ticks * (f64)*tick_per_sec);
+#undef max_measure_count
+}
+
+void yy_cpu_measure_freq(void) {
+    cpu_measure_freq(8, 128, &yy_cycle_per_sec, &yy_tick_per_sec);
+}
+
+
+
+/*==============================================================================
+ * Fast Frequency Calibration
+ *============================================================================*/
+
+/* The guessed (or cached) value is accepted if the difference from the short
+   validation run is within this ratio. */
+#define CPU_FREQ_TOLERANCE 0.02
+
+#define CPU_FREQ_CACHE_MAGIC "yybench-cpu-freq-cache-v1"
+
+/* Execute CPUID instruction, returns false if not available. */
+static bool cpu_cpuid(u32 leaf, u32 subleaf, u32 regs[4]) {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_AMD64))
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (u32)info[i];
+    return true;
+#elif (defined(__GNUC__) || defined(__clang__)) && (YY_ARCH_X64 || YY_ARCH_X86)
+    __asm volatile("cpuid"
+                   : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+                   : "a"(leaf), "c"(subleaf));
+    return true;
+#else
+    (void)leaf; (void)subleaf;
+    memset(regs, 0, sizeof(u32) * 4);
+    return false;
+#endif
+}
+
+/* Read an unsigned integer from a text file, such as sysfs node. */
+static bool cpu_read_file_u64(const char *path, u64 *val) {
+    u8 *dat;
+    usize len;
+    unsigned long long num;
+    if (!yy_file_read(path, &dat, &len)) return false;
+    bool suc = sscanf((const char *)dat, "%llu", &num) == 1;
+    free(dat);
+    if (suc) *val = (u64)num;
+    return suc;
+}
+
+/* Guess tick per second from hardware information, returns 0 if unknown. */
+static u64 cpu_guess_tick_per_sec(void) {
+#if YY_ARCH_X64 || YY_ARCH_X86
+    /* CPUID leaf 0x15: TSC/core crystal clock ratio (Intel) */
+    u32 regs[4];
+    if (!cpu_cpuid(0, 0, regs) || regs[0] < 0x15) return 0;
+    u32 max_leaf = regs[0];
+    cpu_cpuid(0x15, 0, regs);
+    u64 denominator = regs[0], numerator = regs[1], crystal_hz = regs[2];
+    if (!denominator || !numerator) return 0;
+    if (!crystal_hz && max_leaf >= 0x16) {
+        /* crystal clock is not enumerated, calculate it from base frequency */
+        cpu_cpuid(0x16, 0, regs);
+        crystal_hz = (u64)regs[0] * 1000 * 1000 * denominator / numerator;
+    }
+    return crystal_hz * numerator / denominator;
+#elif defined(__aarch64__)
+    /* the generic timer frequency is readable in user mode */
+    u64 freq;
+    __asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return freq;
+#else
+    return 0;
+#endif
+}
+
+/* Guess CPU frequency candidates from hardware information,
+   returns the candidate count. */
+static int cpu_guess_cycle_per_sec(u64 *guesses, int max_count) {
+    int count = 0;
+#define ADD_GUESS(val) do { \
+    u64 _val = (val); \
+    if (_val && count < max_count) guesses[count++] = _val; } while (0)
+    
+#if defined(__linux__)
+    static const char *files[] = {
+        "cpuinfo_max_freq", /* max frequency with turbo */
+        "scaling_cur_freq", /* current frequency */
+        "base_frequency"    /* nominal frequency (intel_pstate) */
+    };
+    char path[128];
+    int cpu = sched_getcpu();
+    if (cpu < 0) cpu = 0;
+    for (usize i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        u64 khz = 0;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, files[i]);
+        if (cpu_read_file_u64(path, &khz)) ADD_GUESS(khz * 1000);
+    }
+#endif
+    
+#if YY_ARCH_X64 || YY_ARCH_X86
+    /* CPUID leaf 0x16: base and max frequency in MHz (Intel) */
+    u32 regs[4];
+    if (cpu_cpuid(0, 0, regs) && regs[0] >= 0x16) {
+        cpu_cpuid(0x16, 0, regs);
+        ADD_GUESS((u64)(regs[1] & 0xFFFF) * 1000 * 1000);
+        ADD_GUESS((u64)(regs[0] & 0xFFFF) * 1000 * 1000);
+    }
+#endif
+    
+    return count;
+#undef ADD_GUESS
+}
+
+/* Build the cache key with CPU model, kernel version and boot id. */
+static void cpu_freq_cache_key(char *buf, usize size) {
+    char kernel[256] = { 0 };
+    char boot[128] = { 0 };
+    
+#if defined(_WIN32)
+    snprintf(kernel, sizeof(kernel), "%s", yy_env_get_os_desc());
+#else
+    struct utsname name;
+    if (uname(&name) == 0) {
+        snprintf(kernel, sizeof(kernel), "%s %s", name.release, name.version);
+    }
+#endif
+    
+#if defined(__linux__)
+    u8 *dat;
+    usize len;
+    if (yy_file_read("/proc/sys/kernel/random/boot_id", &dat, &len)) {
+        snprintf(boot, sizeof(boot), "%s", (const char *)dat);
+        free(dat);
+    }
+#elif defined(__APPLE__)
+    struct timeval boottime;
+    usize boot_size = sizeof(boottime);
+    if (sysctlbyname("kern.boottime", &boottime, &boot_size, NULL, 0) == 0) {
+        snprintf(boot, sizeof(boot), "%ld", (long)boottime.tv_sec);
+    }
+#endif
+    
+    snprintf(buf, size, "%s|%s|%s", yy_env_get_cpu_desc(), kernel, boot);
+    for (char *cur = buf; *cur; cur++) {
+        if (*cur == '\r' || *cur == '\n') *cur = ' ';
+    }
+}
+
+/* Default cache path is per user: the user cache directory ($XDG_CACHE_HOME
+   or ~/.cache) if it exists, otherwise the temporary directory with the user
+   id in the file name. */
+static void cpu_freq_cache_path(char *buf, const char *path) {
+    if (path) {
+        snprintf(buf, YY_MAX_PATH, "%s", path);
+        return;
+    }
+#ifdef _WIN32
+    const char *dir = getenv("TEMP");
+    if (!dir) dir = getenv("TMP");
+    if (!dir) dir = ".";
+    yy_path_combine(buf, dir, "yybench_cpu_freq.cache", NULL);
+#else
+    char name[64];
+    const char *dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir && yy_path_is_dir(dir)) {
+        yy_path_combine(buf, dir, "yybench_cpu_freq.cache", NULL);
+        return;
+    }
+    dir = getenv("HOME");
+    if (dir && *dir) {
+        yy_path_combine(buf, dir, ".cache", NULL);
+        if (yy_path_is_dir(buf)) {
+            yy_path_combine(buf, dir, ".cache", "yybench_cpu_freq.cache", NULL);
+            return;
+        }
+    }
+    dir = getenv("TMPDIR");
+    if (!dir) dir = "/tmp";
+    snprintf(name, sizeof(name), "yybench_cpu_freq.%lu.cache",
+             (unsigned long)getuid());
+    yy_path_combine(buf, dir, name, NULL);
+#endif
+}
+
+static bool cpu_freq_cache_load(const char *path, const char *key,
+                                u64 *cycle_per_sec, u64 *tick_per_sec) {
+    yy_dat dat;
+    char *line;
+    usize len;
+    bool key_match = false;
+    unsigned long long num;
+    
+    *cycle_per_sec = 0;
+    *tick_per_sec = 0;
+    if (!yy_dat_init_with_file(&dat, path)) return false;
+    line = yy_dat_copy_line(&dat, &len);
+    if (!line || strcmp(line, CPU_FREQ_CACHE_MAGIC) != 0) {
+        if (line) free(line);
+        yy_dat_release(&dat);
+        return false;
+    }
+    free(line);
+    while ((line = yy_dat_copy_line(&dat, &len))) {
+        if (yy_str_has_prefix(line, "key=")) {
+            key_match = strcmp(line + 4, key) == 0;
+        } else if (sscanf(line, "cycle_per_sec=%llu", &num) == 1) {
+            *cycle_per_sec = (u64)num;
+        } else if (sscanf(line, "tick_per_sec=%llu", &num) == 1) {
+            *tick_per_sec = (u64)num;
+        }
+        free(line);
+    }
+    yy_dat_release(&dat);
+    return key_match && *cycle_per_sec && *tick_per_sec;
+}
+
+static bool cpu_freq_cache_save(const char *path, const char *key,
+                                u64 cycle_per_sec, u64 tick_per_sec) {
+    yy_sb sb;
+    if (!yy_sb_init(&sb, 0)) return false;
+    bool suc = yy_sb_printf(&sb, "%s\n", CPU_FREQ_CACHE_MAGIC) &&
+               yy_sb_printf(&sb, "key=%s\n", key) &&
+               yy_sb_printf(&sb, "cycle_per_sec=%llu\n",
+                            (unsigned long long)cycle_per_sec) &&
+               yy_sb_printf(&sb, "tick_per_sec=%llu\n",
+                            (unsigned long long)tick_per_sec);
+    /* concurrent processes may save the cache at the same time */
+    if (suc) suc = yy_file_write_atomic(path, (u8 *)yy_sb_get_str(&sb), yy_sb_get_len(&sb));
+    yy_sb_release(&sb);
+    return suc;
+}
+
+static bool cpu_freq_close(u64 val, u64 ref) {
+    if (!val || !ref) return false;
+    f64 diff = ((f64)val - (f64)ref) / (f64)ref;
+    return fabs(diff) <= CPU_FREQ_TOLERANCE;
+}
+
+bool yy_cpu_measure_freq_fast(const char *cache_path) {
+    char path[YY_MAX_PATH];
+    char key[1024];
+    u64 guesses[8];
+    u64 cycle_per_sec, tick_per_sec;
+    u64 cached_cycle, cached_tick;
+    bool validated = false;
+    
+    cpu_freq_cache_path(path, cache_path);
+    cpu_freq_cache_key(key, sizeof(key));
+    
+    /* short validation run, the timer frequency is precise enough with
+       nanosecond clock, but the CPU frequency may be noisy */
+    cpu_measure_freq(2, 16, &cycle_per_sec, &tick_per_sec);
+    
+    /* try cached value first */
+    if (cpu_freq_cache_load(path, key, &cached_cycle, &cached_tick) &&
+        cpu_freq_close(cached_cycle, cycle_per_sec) &&
+        cpu_freq_close(cached_tick, tick_per_sec)) {
+        yy_cycle_per_sec = cached_cycle;
+        yy_tick_per_sec = cached_tick;
+        return true;
+    }
+    
+    /* then try the hardware information */
+    u64 guess_tick = cpu_guess_tick_per_sec();
+    if (cpu_freq_close(guess_tick, tick_per_sec)) tick_per_sec = guess_tick;
+    int guess_count = cpu_guess_cycle_per_sec(guesses, 8);
+    for (int i = 0; i < guess_count; i++) {
+        if (cpu_freq_close(guesses[i], cycle_per_sec)) {
+            cycle_per_sec = guesses[i];
+            validated = true;
+            break;
+        }
+    }
+    
+    /* fallback to the full measurement */
+    if (validated) {
+        yy_cycle_per_sec = cycle_per_sec;
+        yy_tick_per_sec = tick_per_sec;
+    } else {
+        yy_cpu_measure_freq();
+    }
+    cpu_freq_cache_save(path, key, yy_cycle_per_sec, yy_tick_per_sec);
+    return validated;
 }
 
 u64 yy_cpu_get_freq(void) {
@@ -248,3 +546,1103 @@ f64 yy_cpu_tick_to_sec(u64 tick) {
 u64 yy_cpu_tick_to_cycle(u64 tick) {
     return (u64)(tick * ((f64)yy_cycle_per_sec / (f64)yy_tick_per_sec));
 }
+
+
+
+
+/*==============================================================================
+ * CPU Affinity
+ *============================================================================*/
+
+#if defined(__linux__)
+
+/* The affinity before the first pin, it's restored by yy_cpu_unpin_thread(). */
+static cpu_set_t cpu_saved_set;
+static bool cpu_saved_valid = false;
+static pthread_once_t cpu_saved_once = PTHREAD_ONCE_INIT;
+
+static void cpu_save_affinity(void) {
+    cpu_saved_valid = pthread_getaffinity_np(pthread_self(), sizeof(cpu_saved_set),
+                                             &cpu_saved_set) == 0;
+}
+
+static void cpu_read_list(const char *path, u8 *flags, int max);
+
+bool yy_cpu_pin_thread(int core) {
+    cpu_set_t set;
+    if (core < 0 || core >= CPU_SETSIZE) return false;
+    pthread_once(&cpu_saved_once, cpu_save_affinity);
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool yy_cpu_unpin_thread(void) {
+    cpu_set_t set;
+    if (cpu_saved_valid) {
+        set = cpu_saved_set;
+    } else {
+        /* not pinned by this library, use all online cpus,
+           the kernel limits it to the cpuset of the process */
+        u8 online[CPU_SETSIZE];
+        memset(online, 0, sizeof(online));
+        cpu_read_list("/sys/devices/system/cpu/online", online, CPU_SETSIZE);
+        CPU_ZERO(&set);
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (online[i]) CPU_SET(i, &set);
+        }
+        if (CPU_COUNT(&set) == 0) return false;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool yy_cpu_is_allowed(int core) {
+    cpu_set_t set;
+    if (core < 0 || core >= CPU_SETSIZE) return false;
+    if (cpu_saved_valid) set = cpu_saved_set;
+    else if (sched_getaffinity(0, sizeof(set), &set) != 0) return false;
+    return CPU_ISSET(core, &set);
+}
+
+bool yy_cpu_pin_scope_begin(yy_cpu_pin_scope *scope, int core) {
+    cpu_set_t set;
+    if (!scope) return false;
+    scope->pinned = false;
+    if (sizeof(set) > sizeof(scope->mask)) return false;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return false;
+    }
+    memcpy(scope->mask, &set, sizeof(set));
+    if (!yy_cpu_pin_thread(core)) return false;
+    scope->pinned = true;
+    return true;
+}
+
+bool yy_cpu_pin_scope_end(yy_cpu_pin_scope *scope) {
+    cpu_set_t set;
+    if (!scope || !scope->pinned) return false;
+    memcpy(&set, scope->mask, sizeof(set));
+    scope->pinned = false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static void cpu_read_list(const char *path, u8 *flags, int max) {
+    u8 *dat;
+    usize len;
+    if (!yy_file_read(path, &dat, &len)) return;
+    yy_topo_parse_cpu_list((const char *)dat, flags, (u32)max);
+    free(dat);
+}
+
+/* Read per-core busy and total time from /proc/stat. */
+static bool cpu_read_stat(u64 *busy, u64 *total, int max) {
+    yy_dat dat;
+    char *line;
+    usize len;
+    if (!yy_dat_init_with_file(&dat, "/proc/stat")) return false;
+    while ((line = yy_dat_copy_line(&dat, &len))) {
+        int cpu;
+        unsigned long long v[8] = { 0 };
+        if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu", &cpu,
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) >= 5 &&
+            cpu >= 0 && cpu < max) {
+            /* user nice system idle iowait irq softirq steal */
+            u64 idle = v[3] + v[4];
+            u64 sum = 0;
+            for (int i = 0; i < 8; i++) sum += v[i];
+            busy[cpu] = sum - idle;
+            total[cpu] = sum;
+        }
+        free(line);
+    }
+    yy_dat_release(&dat);
+    return true;
+}
+
+/* Read the cpus of the cgroup cpuset of current process (cgroup v2 or v1),
+   or the online cpus if cpuset is not available. */
+static void cpu_read_cpuset(u8 *flags, int max) {
+    yy_dat dat;
+    char *line;
+    usize len;
+    char path[512];
+    bool found = false;
+    if (yy_dat_init_with_file(&dat, "/proc/self/cgroup")) {
+        /* v2: "0::/path", v1: "3:cpu,cpuset:/path" */
+        while (!found && (line = yy_dat_copy_line(&dat, &len))) {
+            char *ctrl = strchr(line, ':');
+            char *dir = ctrl ? strchr(ctrl + 1, ':') : NULL;
+            if (dir) {
+                *dir++ = '\0';
+                ctrl++;
+                if (*ctrl == '\0') {
+                    snprintf(path, sizeof(path),
+                             "/sys/fs/cgroup%s/cpuset.cpus.effective", dir);
+                    found = yy_path_exist(path);
+                } else if (strcmp(ctrl, "cpuset") == 0 ||
+                           yy_str_has_prefix(ctrl, "cpuset,") ||
+                           strstr(ctrl, ",cpuset,") ||
+                           yy_str_has_suffix(ctrl, ",cpuset")) {
+                    snprintf(path, sizeof(path),
+                             "/sys/fs/cgroup/cpuset%s/cpuset.effective_cpus", dir);
+                    found = yy_path_exist(path);
+                }
+            }
+            free(line);
+        }
+        yy_dat_release(&dat);
+    }
+    if (found) {
+        cpu_read_list(path, flags, max);
+        for (int i = 0; i < max; i++) {
+            if (flags[i]) return;
+        }
+    }
+    cpu_read_list("/sys/devices/system/cpu/online", flags, max);
+}
+
+int yy_cpu_pick_quiet_core(void) {
+    const int max = CPU_SETSIZE;
+    char path[128];
+    int best = -1;
+    f64 best_score = 0;
+    
+    /* flags: cpuset, isolated, nohz_full, siblings */
+    u8 *flags = (u8 *)calloc((usize)max, 4);
+    /* ticks: busy and total of the 2 samples, then the load */
+    u64 *ticks = (u64 *)calloc((usize)max, 4 * sizeof(u64));
+    f64 *load = (f64 *)calloc((usize)max, sizeof(f64));
+    if (!flags || !ticks || !load) goto done;
+    u8 *cpuset = flags, *isolated = flags + max;
+    u8 *nohz = flags + max * 2, *siblings = flags + max * 3;
+    u64 *busy1 = ticks, *total1 = ticks + max;
+    u64 *busy2 = ticks + max * 2, *total2 = ticks + max * 3;
+    
+    /* the cpus allowed by the cpuset instead of the scheduler affinity,
+       the isolated cpus are not in the default affinity */
+    cpu_read_cpuset(cpuset, max);
+    cpu_read_list("/sys/devices/system/cpu/isolated", isolated, max);
+    cpu_read_list("/sys/devices/system/cpu/nohz_full", nohz, max);
+    
+    /* sample the load of each core */
+    cpu_read_stat(busy1, total1, max);
+    struct timespec ts = { 0, 50 * 1000 * 1000 };
+    nanosleep(&ts, NULL);
+    cpu_read_stat(busy2, total2, max);
+    for (int i = 0; i < max; i++) {
+        u64 total = total2[i] - total1[i];
+        load[i] = total ? (f64)(busy2[i] - busy1[i]) / (f64)total : 0;
+    }
+    
+    for (int i = 0; i < max; i++) {
+        if (!cpuset[i]) continue;
+        
+        /* the max load of SMT siblings */
+        f64 sibling_load = 0;
+        memset(siblings, 0, (usize)max);
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", i);
+        cpu_read_list(path, siblings, max);
+        for (int j = 0; j < max; j++) {
+            if (j != i && siblings[j] && load[j] > sibling_load) {
+                sibling_load = load[j];
+            }
+        }
+        
+        /* core 0 usually handles more interrupts and housekeeping work */
+        f64 score = 1000.0;
+        if (isolated[i]) score += 400.0;
+        if (nohz[i]) score += 200.0;
+        score -= load[i] * 100.0;
+        score -= sibling_load * 100.0;
+        if (i == 0) score -= 10.0;
+        if (best < 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    
+done:
+    if (flags) free(flags);
+    if (ticks) free(ticks);
+    if (load) free(load);
+    return best;
+}
+
+#elif defined(_WIN32)
+
+bool yy_cpu_pin_thread(int core) {
+    if (core < 0 || core >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+}
+
+bool yy_cpu_unpin_thread(void) {
+    DWORD_PTR process_mask, system_mask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(),
+                                &process_mask, &system_mask)) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), process_mask) != 0;
+}
+
+bool yy_cpu_is_allowed(int core) {
+    DWORD_PTR process_mask, system_mask;
+    if (core < 0 || core >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+    if (!GetProcessAffinityMask(GetCurrentProcess(),
+                                &process_mask, &system_mask)) return false;
+    return (process_mask & ((DWORD_PTR)1 << core)) != 0;
+}
+
+int yy_cpu_pick_quiet_core(void) {
+    return -1;
+}
+
+bool yy_cpu_pin_scope_begin(yy_cpu_pin_scope *scope, int core) {
+    if (!scope) return false;
+    scope->pinned = false;
+    if (core < 0 || core >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+    DWORD_PTR old = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+    if (!old) return false;
+    scope->mask[0] = (u64)old;
+    scope->pinned = true;
+    return true;
+}
+
+bool yy_cpu_pin_scope_end(yy_cpu_pin_scope *scope) {
+    if (!scope || !scope->pinned) return false;
+    scope->pinned = false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)scope->mask[0]) != 0;
+}
+
+#elif defined(__APPLE__)
+
+/* Threads with the same affinity tag are scheduled to share an L2 cache,
+   this is only a hint to the scheduler, and not supported on Apple Silicon. */
+static bool cpu_set_affinity_tag(integer_t tag) {
+    thread_affinity_policy_data_t policy = { tag };
+    thread_port_t thread = pthread_mach_thread_np(pthread_self());
+    return thread_policy_set(thread, THREAD_AFFINITY_POLICY,
+                             (thread_policy_t)&policy,
+                             THREAD_AFFINITY_POLICY_COUNT) == KERN_SUCCESS;
+}
+
+bool yy_cpu_pin_thread(int core) {
+    if (core < 0) return false;
+    return cpu_set_affinity_tag(core + 1);
+}
+
+bool yy_cpu_unpin_thread(void) {
+    return cpu_set_affinity_tag(THREAD_AFFINITY_TAG_NULL);
+}
+
+bool yy_cpu_is_allowed(int core) {
+    return core >= 0;
+}
+
+int yy_cpu_pick_quiet_core(void) {
+    return -1;
+}
+
+bool yy_cpu_pin_scope_begin(yy_cpu_pin_scope *scope, int core) {
+    if (!scope) return false;
+    scope->pinned = yy_cpu_pin_thread(core);
+    return scope->pinned;
+}
+
+bool yy_cpu_pin_scope_end(yy_cpu_pin_scope *scope) {
+    if (!scope || !scope->pinned) return false;
+    scope->pinned = false;
+    return yy_cpu_unpin_thread();
+}
+
+#else
+
+bool yy_cpu_pin_thread(int core) {
+    return false;
+}
+
+bool yy_cpu_unpin_thread(void) {
+    return false;
+}
+
+bool yy_cpu_is_allowed(int core) {
+    return false;
+}
+
+int yy_cpu_pick_quiet_core(void) {
+    return -1;
+}
+
+bool yy_cpu_pin_scope_begin(yy_cpu_pin_scope *scope, int core) {
+    if (scope) scope->pinned = false;
+    return false;
+}
+
+bool yy_cpu_pin_scope_end(yy_cpu_pin_scope *scope) {
+    return false;
+}
+
+#endif
+
+
+
+
+/*==============================================================================
+ * CPU Per-Core Survey
+ *============================================================================*/
+
+typedef struct {
+    u64 cycle_per_sec; /* 0 if not measured */
+    i64 tick_offset;
+} cpu_core_info;
+
+static cpu_core_info *yy_cpu_cores = NULL;
+static u32 yy_cpu_core_count = 0;
+
+#if defined(__linux__)
+
+/* Shared state between the reference thread and the peer thread. */
+typedef struct {
+    int ref_core;
+    int round_count;
+    i64 offset; /* result */
+    volatile u64 peer_tick;
+    volatile int state; /* 0: idle, 1: ping, 2: pong, 3: finish */
+} cpu_offset_ctx;
+
+/* The reference thread: send a ping with local timestamp, wait for the pong
+   with peer's timestamp. The sample with the minimum round-trip time is used
+   to estimate the offset, assume the peer's timestamp was taken in the middle
+   of the round trip. */
+static void *cpu_offset_ref_thread(void *arg) {
+    cpu_offset_ctx *ctx = (cpu_offset_ctx *)arg;
+    u64 min_rtt = (u64)-1;
+    yy_cpu_pin_thread(ctx->ref_core);
+    
+    for (int i = 0; i < ctx->round_count; i++) {
+        while (__atomic_load_n(&ctx->state, __ATOMIC_ACQUIRE) != 0) {}
+        u64 t1 = yy_time_get_ticks_begin();
+        __atomic_store_n(&ctx->state, 1, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&ctx->state, __ATOMIC_ACQUIRE) != 2) {}
+        u64 t2 = yy_time_get_ticks_end();
+        u64 peer = ctx->peer_tick;
+        u64 rtt = t2 - t1;
+        if (rtt < min_rtt) {
+            min_rtt = rtt;
+            ctx->offset = (i64)(peer - (t1 + rtt / 2));
+        }
+        __atomic_store_n(&ctx->state, 0, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&ctx->state, __ATOMIC_ACQUIRE) != 0) {}
+    __atomic_store_n(&ctx->state, 3, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Measure the timer offset of current core relative to the reference core,
+   current thread should be pinned to a core other than the reference core. */
+static bool cpu_measure_tick_offset(int ref_core, i64 *offset) {
+    cpu_offset_ctx ctx;
+    pthread_t thread;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.ref_core = ref_core;
+    ctx.round_count = 256;
+    if (pthread_create(&thread, NULL, cpu_offset_ref_thread, &ctx) != 0) {
+        return false;
+    }
+    while (true) {
+        int state = __atomic_load_n(&ctx.state, __ATOMIC_ACQUIRE);
+        if (state == 3) break;
+        if (state != 1) continue;
+        ctx.peer_tick = yy_time_get_ticks_begin();
+        __atomic_store_n(&ctx.state, 2, __ATOMIC_RELEASE);
+    }
+    pthread_join(thread, NULL);
+    *offset = ctx.offset;
+    return true;
+}
+
+bool yy_cpu_survey_cores(void) {
+    yy_cpu_pin_scope scope;
+    u64 cycle_per_sec, tick_per_sec = 0;
+    int ref_core = -1, max_core = -1;
+    
+    /* online cpus from topology, not the affinity of current thread,
+       which may be already pinned to one core */
+    u32 cpu_count = yy_topo_get_cpu_count();
+    for (u32 i = 0; i < cpu_count; i++) {
+        int id = yy_topo_get_cpu(i)->id;
+        if (id > max_core) max_core = id;
+    }
+    if (max_core < 0) return false;
+    
+    cpu_core_info *cores = calloc((usize)max_core + 1, sizeof(cpu_core_info));
+    if (!cores) return false;
+    
+    /* the reference is the first online core this process can run on */
+    for (int i = 0; i <= max_core && ref_core < 0; i++) {
+        if (yy_cpu_pin_scope_begin(&scope, i)) ref_core = i;
+    }
+    if (ref_core < 0) {
+        free(cores);
+        return false;
+    }
+    for (u32 i = 0; i < cpu_count; i++) {
+        int id = yy_topo_get_cpu(i)->id;
+        if (id < ref_core) continue;
+        /* cores out of the cpuset (taskset, container) cannot be pinned */
+        if (!yy_cpu_pin_thread(id)) continue;
+        cpu_measure_freq(2, 16, &cycle_per_sec, &tick_per_sec);
+        cores[id].cycle_per_sec = cycle_per_sec;
+        if (id != ref_core) {
+            cpu_measure_tick_offset(ref_core, &cores[id].tick_offset);
+        }
+    }
+    yy_cpu_pin_scope_end(&scope);
+    
+    if (yy_cpu_cores) free(yy_cpu_cores);
+    yy_cpu_cores = cores;
+    yy_cpu_core_count = (u32)max_core + 1;
+    if (!yy_tick_per_sec) yy_tick_per_sec = tick_per_sec;
+    if (!yy_cycle_per_sec) yy_cycle_per_sec = cores[ref_core].cycle_per_sec;
+    return true;
+}
+
+int yy_cpu_get_current_core(void) {
+    return sched_getcpu();
+}
+
+#else
+
+bool yy_cpu_survey_cores(void) {
+    return false;
+}
+
+int yy_cpu_get_current_core(void) {
+#if defined(_WIN32)
+    return (int)GetCurrentProcessorNumber();
+#else
+    return -1;
+#endif
+}
+
+#endif
+
+u32 yy_cpu_get_core_count(void) {
+    return yy_cpu_core_count;
+}
+
+u64 yy_cpu_get_core_freq(u32 core) {
+    if (core >= yy_cpu_core_count) return 0;
+    return yy_cpu_cores[core].cycle_per_sec;
+}
+
+i64 yy_cpu_get_core_tick_offset(u32 core) {
+    if (core >= yy_cpu_core_count) return 0;
+    return yy_cpu_cores[core].tick_offset;
+}
+
+u64 yy_cpu_tick_to_cycle_on_core(u64 tick, u32 core) {
+    u64 cycle_per_sec = yy_cpu_get_core_freq(core);
+    if (!cycle_per_sec) return yy_cpu_tick_to_cycle(tick);
+    return (u64)(tick * ((f64)cycle_per_sec / (f64)yy_tick_per_sec));
+}
+
+
+
+
+/*==============================================================================
+ * CPU Frequency Monitor
+ *============================================================================*/
+
+#if !defined(_WIN32)
+
+struct yy_cpu_monitor {
+    f64 interval;
+    int core;
+    int probe_core; /* core the sampler thread is pinned to for the probe */
+    bool probe;
+    bool running;
+    volatile bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    yy_buf samples; /* yy_cpu_freq_sample array */
+};
+
+/* Short sequences of the probe, same as the C version of yy_cpu_run_seq_a/b
+   with fewer loops: 128 and 256 dependent adds per loop. */
+#define CPU_PROBE_LOOP 512
+#define CPU_PROBE_INST_COUNT_A (CPU_PROBE_LOOP * 4 * 32)
+#define CPU_PROBE_INST_COUNT_B (CPU_PROBE_LOOP * 4 * 64)
+
+/* volatile, so the result is kept and the inputs are unknown */
+static volatile u32 cpu_probe_vals[5];
+
+static yy_noinline void cpu_probe_seq_a(void) {
+    u32 loop = CPU_PROBE_LOOP;
+    u32 v1 = cpu_probe_vals[1];
+    u32 v2 = cpu_probe_vals[2];
+    u32 v3 = cpu_probe_vals[3];
+    u32 v4 = cpu_probe_vals[4];
+    do {
+        REPEAT_32( v1 += v4; v2 += v1; v3 += v2; v4 += v3; )
+    } while(--loop);
+    cpu_probe_vals[0] = v1;
+}
+
+static yy_noinline void cpu_probe_seq_b(void) {
+    u32 loop = CPU_PROBE_LOOP;
+    u32 v1 = cpu_probe_vals[1];
+    u32 v2 = cpu_probe_vals[2];
+    u32 v3 = cpu_probe_vals[3];
+    u32 v4 = cpu_probe_vals[4];
+    do {
+        REPEAT_64( v1 += v4; v2 += v1; v3 += v2; v4 += v3; )
+    } while(--loop);
+    cpu_probe_vals[0] = v1;
+}
+
+/* Measure the clock of current core with the short sequences, about 400K
+   cycles (2 runs of each), returns 0 if the timer frequency is unknown. */
+static u64 cpu_probe_freq(void) {
+    u64 tick_per_sec = yy_tick_per_sec;
+    u64 ticks_a = 0, ticks_b = 0;
+    if (!tick_per_sec) return 0;
+    for (int i = 0; i < 2; i++) {
+        u64 s1 = yy_time_get_ticks();
+        cpu_probe_seq_a();
+        u64 s2 = yy_time_get_ticks();
+        cpu_probe_seq_b();
+        u64 s3 = yy_time_get_ticks();
+        if (i == 0 || s2 - s1 < ticks_a) ticks_a = s2 - s1;
+        if (i == 0 || s3 - s2 < ticks_b) ticks_b = s3 - s2;
+    }
+    if (ticks_b <= ticks_a) return 0;
+    u64 insts = CPU_PROBE_INST_COUNT_B - CPU_PROBE_INST_COUNT_A;
+    return (u64)((f64)insts / (f64)(ticks_b - ticks_a) * (f64)tick_per_sec);
+}
+
+static void *cpu_monitor_thread(void *arg) {
+    yy_cpu_monitor *monitor = (yy_cpu_monitor *)arg;
+    yy_cpu_freq_sample sample;
+    char path[128];
+    struct timespec ts;
+    
+    ts.tv_sec = (time_t)monitor->interval;
+    ts.tv_nsec = (long)((monitor->interval - (f64)ts.tv_sec) * 1e9);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+             monitor->core);
+    
+    /* the probe is skipped if the sampler cannot run on the probe core,
+       a probe on an arbitrary core measures nothing useful */
+    bool pinned = monitor->probe && yy_cpu_pin_thread(monitor->probe_core);
+    
+    while (!__atomic_load_n(&monitor->stop, __ATOMIC_ACQUIRE)) {
+        memset(&sample, 0, sizeof(sample));
+        sample.time = yy_time_get_seconds();
+        if (cpu_read_file_u64(path, &sample.sys_freq)) sample.sys_freq *= 1000;
+        if (pinned) {
+            sample.probe_begin = yy_time_get_seconds();
+            sample.probe_freq = cpu_probe_freq();
+            sample.probe_end = yy_time_get_seconds();
+        }
+        pthread_mutex_lock(&monitor->lock);
+        yy_buf_append(&monitor->samples, (u8 *)&sample, sizeof(sample));
+        pthread_mutex_unlock(&monitor->lock);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/* An SMT sibling of the core runs at the same clock, so the probe measures the
+   clock of the core without taking the hardware thread of the benchmark.
+   Returns the core itself if it has no sibling. */
+static int cpu_monitor_probe_core(int core) {
+    const yy_topo_cpu *target = NULL;
+    u32 count = yy_topo_get_cpu_count();
+    for (u32 i = 0; i < count; i++) {
+        if (yy_topo_get_cpu(i)->id == core) target = yy_topo_get_cpu(i);
+    }
+    if (!target) return core;
+    for (u32 i = 0; i < count; i++) {
+        const yy_topo_cpu *cpu = yy_topo_get_cpu(i);
+        if (cpu->core == target->core && cpu->id != core) return cpu->id;
+    }
+    return core;
+}
+
+yy_cpu_monitor *yy_cpu_monitor_new(f64 interval, int core, bool probe) {
+    if (!(interval > 0)) return NULL;
+    yy_cpu_monitor *monitor = calloc(1, sizeof(yy_cpu_monitor));
+    if (!monitor) return NULL;
+    if (!yy_buf_init(&monitor->samples, 0)) {
+        free(monitor);
+        return NULL;
+    }
+    if (pthread_mutex_init(&monitor->lock, NULL) != 0) {
+        yy_buf_release(&monitor->samples);
+        free(monitor);
+        return NULL;
+    }
+    if (core < 0) core = yy_cpu_get_current_core();
+    monitor->interval = interval;
+    monitor->core = core < 0 ? 0 : core;
+    monitor->probe_core = cpu_monitor_probe_core(monitor->core);
+    monitor->probe = probe;
+    return monitor;
+}
+
+void yy_cpu_monitor_free(yy_cpu_monitor *monitor) {
+    if (!monitor) return;
+    yy_cpu_monitor_stop(monitor);
+    pthread_mutex_destroy(&monitor->lock);
+    yy_buf_release(&monitor->samples);
+    free(monitor);
+}
+
+bool yy_cpu_monitor_start(yy_cpu_monitor *monitor) {
+    if (!monitor) return false;
+    if (monitor->running) return true;
+    monitor->samples.cur = monitor->samples.hdr;
+    monitor->stop = false;
+    if (pthread_create(&monitor->thread, NULL,
+                       cpu_monitor_thread, monitor) != 0) return false;
+    monitor->running = true;
+    return true;
+}
+
+bool yy_cpu_monitor_stop(yy_cpu_monitor *monitor) {
+    if (!monitor) return false;
+    if (!monitor->running) return true;
+    __atomic_store_n(&monitor->stop, true, __ATOMIC_RELEASE);
+    pthread_join(monitor->thread, NULL);
+    monitor->running = false;
+    return true;
+}
+
+int yy_cpu_monitor_get_probe_core(const yy_cpu_monitor *monitor) {
+    if (!monitor || !monitor->probe) return -1;
+    return monitor->probe_core;
+}
+
+u32 yy_cpu_monitor_copy_samples(yy_cpu_monitor *monitor,
+                                yy_cpu_freq_sample **samples) {
+    if (!monitor || !samples) return 0;
+    *samples = NULL;
+    pthread_mutex_lock(&monitor->lock);
+    usize len = yy_buf_len(&monitor->samples);
+    if (len) {
+        *samples = malloc(len);
+        if (*samples) memcpy(*samples, monitor->samples.hdr, len);
+        else len = 0;
+    }
+    pthread_mutex_unlock(&monitor->lock);
+    return (u32)(len / sizeof(yy_cpu_freq_sample));
+}
+
+#else
+
+yy_cpu_monitor *yy_cpu_monitor_new(f64 interval, int core, bool probe) {
+    return NULL;
+}
+
+void yy_cpu_monitor_free(yy_cpu_monitor *monitor) {
+}
+
+bool yy_cpu_monitor_start(yy_cpu_monitor *monitor) {
+    return false;
+}
+
+bool yy_cpu_monitor_stop(yy_cpu_monitor *monitor) {
+    return false;
+}
+
+int yy_cpu_monitor_get_probe_core(const yy_cpu_monitor *monitor) {
+    return -1;
+}
+
+u32 yy_cpu_monitor_copy_samples(yy_cpu_monitor *monitor,
+                                yy_cpu_freq_sample **samples) {
+    if (samples) *samples = NULL;
+    return 0;
+}
+
+#endif
+
+bool yy_cpu_monitor_check(yy_cpu_monitor *monitor, f64 begin, f64 end,
+                          f64 threshold, f64 *drift) {
+    yy_cpu_freq_sample *samples;
+    u64 ref_sys = 0, ref_probe = yy_cpu_get_freq();
+    f64 max_drift = 0;
+    
+    if (drift) *drift = 0;
+    u32 count = yy_cpu_monitor_copy_samples(monitor, &samples);
+    if (!count) return true;
+    for (u32 i = 0; i < count; i++) {
+        if (!ref_sys) ref_sys = samples[i].sys_freq;
+        if (!ref_probe) ref_probe = samples[i].probe_freq;
+    }
+    for (u32 i = 0; i < count; i++) {
+        yy_cpu_freq_sample *sample = samples + i;
+        if (sample->time < begin || sample->time > end) continue;
+        if (sample->sys_freq && ref_sys) {
+            f64 d = fabs((f64)sample->sys_freq - (f64)ref_sys) / (f64)ref_sys;
+            if (d > max_drift) max_drift = d;
+        }
+        if (sample->probe_freq && ref_probe) {
+            f64 d = fabs((f64)sample->probe_freq - (f64)ref_probe) / (f64)ref_probe;
+            if (d > max_drift) max_drift = d;
+        }
+    }
+    free(samples);
+    if (drift) *drift = max_drift;
+    return max_drift <= threshold;
+}
+
+u64 yy_cpu_monitor_get_freq(yy_cpu_monitor *monitor, f64 begin, f64 end) {
+    yy_cpu_freq_sample *samples;
+    f64 sys_sum = 0, probe_sum = 0;
+    u32 sys_num = 0, probe_num = 0;
+    
+    u32 count = yy_cpu_monitor_copy_samples(monitor, &samples);
+    if (!count) return 0;
+    for (u32 i = 0; i < count; i++) {
+        yy_cpu_freq_sample *sample = samples + i;
+        if (sample->time < begin || sample->time > end) continue;
+        if (sample->sys_freq) {
+            sys_sum += (f64)sample->sys_freq;
+            sys_num++;
+        }
+        if (sample->probe_freq) {
+            probe_sum += (f64)sample->probe_freq;
+            probe_num++;
+        }
+    }
+    free(samples);
+    if (probe_num) return (u64)(probe_sum / probe_num);
+    if (sys_num) return (u64)(sys_sum / sys_num);
+    return 0;
+}
+
+
+
+/*==============================================================================
+ * CPU Instruction Probe
+ *============================================================================*/
+
+static const char *cpu_inst_names[YY_CPU_INST_COUNT] = {
+    "add r64, r64",
+    "imul r64, r64",
+    "mov r64, [r64]",
+    "mov [r64], r64",
+    "addsd xmm, xmm",
+    "mulsd xmm, xmm",
+    "divsd xmm, xmm",
+    "paddd xmm, xmm",
+    "pmulld xmm, xmm",
+    "vaddps ymm, ymm, ymm",
+    "vmulps ymm, ymm, ymm",
+    "vfmadd231ps ymm, ymm, ymm",
+};
+
+const char *yy_cpu_inst_get_name(yy_cpu_inst inst) {
+    if ((u32)inst >= YY_CPU_INST_COUNT) return NULL;
+    return cpu_inst_names[inst];
+}
+
+#if YY_ARCH_X64 && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+
+#define CPU_JIT_CODE_SIZE (64 * 1024)
+#define CPU_JIT_MAX_UNROLL 1024
+#define CPU_JIT_DEFAULT_UNROLL 64
+#define CPU_JIT_INST_PER_RUN (1 << 20)
+#define CPU_JIT_RUNS 8
+
+/* Register numbers in x86-64 encoding. Only the caller-saved registers are
+   used, r11 is the loop counter. */
+#define CPU_JIT_RAX 0
+#define CPU_JIT_R11 11
+#if defined(_WIN32)
+static const u8 cpu_jit_gprs[] = { 0, 1, 2, 8, 9, 10 }; /* rax rcx rdx r8-r10 */
+#define CPU_JIT_XMM_COUNT 6 /* xmm0-xmm5 */
+#else
+static const u8 cpu_jit_gprs[] = { 0, 1, 2, 6, 7, 8, 9, 10 }; /* rax rcx rdx rsi rdi r8-r10 */
+#define CPU_JIT_XMM_COUNT 16 /* xmm0-xmm15 */
+#endif
+#define CPU_JIT_GPR_COUNT ((u32)sizeof(cpu_jit_gprs))
+
+/* Memory for load and store instructions. */
+static u64 cpu_jit_data[64];
+
+typedef struct {
+    u8 *cur;
+    u8 *end;
+    bool overflow;
+} cpu_jit;
+
+static void cpu_jit_byte(cpu_jit *jit, u32 byte) {
+    if (jit->cur < jit->end) *jit->cur++ = (u8)byte;
+    else jit->overflow = true;
+}
+
+static void cpu_jit_u32(cpu_jit *jit, u32 val) {
+    for (int i = 0; i < 4; i++) cpu_jit_byte(jit, (val >> (i * 8)) & 0xFF);
+}
+
+static void cpu_jit_u64(cpu_jit *jit, u64 val) {
+    for (int i = 0; i < 8; i++) cpu_jit_byte(jit, (u32)(val >> (i * 8)) & 0xFF);
+}
+
+/* [prefix] [REX] opcode ModRM(reg, rm), register direct mode. */
+static void cpu_jit_rr(cpu_jit *jit, u32 prefix, bool w,
+                       const u8 *op, int op_len, u32 reg, u32 rm) {
+    u32 rex = 0x40 | (w ? 8 : 0) | ((reg >> 3) << 2) | (rm >> 3);
+    if (prefix) cpu_jit_byte(jit, prefix);
+    if (rex != 0x40) cpu_jit_byte(jit, rex);
+    for (int i = 0; i < op_len; i++) cpu_jit_byte(jit, op[i]);
+    cpu_jit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* 3-byte VEX, 256-bit, register direct mode. */
+static void cpu_jit_vex(cpu_jit *jit, u32 map, u32 pp, u32 op,
+                        u32 reg, u32 vvvv, u32 rm) {
+    cpu_jit_byte(jit, 0xC4);
+    cpu_jit_byte(jit, ((~reg >> 3) & 1) << 7 | 1 << 6 | ((~rm >> 3) & 1) << 5 | map);
+    cpu_jit_byte(jit, ((~vvvv) & 15) << 3 | 1 << 2 | pp);
+    cpu_jit_byte(jit, op);
+    cpu_jit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* mov reg, [base + disp8] */
+static void cpu_jit_load(cpu_jit *jit, u32 reg, u32 base, u32 disp) {
+    cpu_jit_byte(jit, 0x48 | ((reg >> 3) << 2) | (base >> 3));
+    cpu_jit_byte(jit, 0x8B);
+    cpu_jit_byte(jit, 0x40 | ((reg & 7) << 3) | (base & 7));
+    cpu_jit_byte(jit, disp);
+}
+
+/* mov [base + disp8], reg */
+static void cpu_jit_store(cpu_jit *jit, u32 reg, u32 base, u32 disp) {
+    cpu_jit_byte(jit, 0x48 | ((reg >> 3) << 2) | (base >> 3));
+    cpu_jit_byte(jit, 0x89);
+    cpu_jit_byte(jit, 0x40 | ((reg & 7) << 3) | (base & 7));
+    cpu_jit_byte(jit, disp);
+}
+
+static bool cpu_inst_is_gpr(yy_cpu_inst inst) {
+    return inst <= YY_CPU_INST_STORE;
+}
+
+static bool cpu_inst_is_avx(yy_cpu_inst inst) {
+    return inst >= YY_CPU_INST_VADDPS;
+}
+
+/* Emit the idx-th instruction of the loop body. */
+static void cpu_jit_emit_inst(cpu_jit *jit, yy_cpu_inst inst,
+                              bool dependent, u32 idx) {
+    static const u8 op_add[] = { 0x01 };
+    static const u8 op_imul[] = { 0x0F, 0xAF };
+    static const u8 op_addsd[] = { 0x0F, 0x58 };
+    static const u8 op_mulsd[] = { 0x0F, 0x59 };
+    static const u8 op_divsd[] = { 0x0F, 0x5E };
+    static const u8 op_paddd[] = { 0x0F, 0xFE };
+    static const u8 op_pmulld[] = { 0x0F, 0x38, 0x40 };
+    u32 base = cpu_jit_gprs[0];
+    u32 gpr = cpu_jit_gprs[dependent ? 0 : idx % CPU_JIT_GPR_COUNT];
+    /* the first register is the base address of load and store */
+    u32 gpr_nb = cpu_jit_gprs[dependent ? 1 : 1 + idx % (CPU_JIT_GPR_COUNT - 1)];
+    u32 xmm = dependent ? 0 : idx % CPU_JIT_XMM_COUNT;
+
+    switch (inst) {
+        case YY_CPU_INST_ADD: cpu_jit_rr(jit, 0, true, op_add, 1, gpr, gpr); break;
+        case YY_CPU_INST_IMUL: cpu_jit_rr(jit, 0, true, op_imul, 2, gpr, gpr); break;
+        case YY_CPU_INST_LOAD:
+            /* data[0] contains its own address, so the dependent chain
+               `mov base, [base]` always loads the same address */
+            if (dependent) cpu_jit_load(jit, base, base, 0);
+            else cpu_jit_load(jit, gpr_nb, base, 0);
+            break;
+        case YY_CPU_INST_STORE:
+            /* dependent: store-to-load forwarding round trip */
+            if (dependent) {
+                cpu_jit_store(jit, gpr_nb, base, 8);
+                cpu_jit_load(jit, gpr_nb, base, 8);
+            } else {
+                cpu_jit_store(jit, gpr_nb, base, 8 + (idx % 8) * 8);
+            }
+            break;
+        case YY_CPU_INST_ADDSD: cpu_jit_rr(jit, 0xF2, false, op_addsd, 2, xmm, xmm); break;
+        case YY_CPU_INST_MULSD: cpu_jit_rr(jit, 0xF2, false, op_mulsd, 2, xmm, xmm); break;
+        case YY_CPU_INST_DIVSD: cpu_jit_rr(jit, 0xF2, false, op_divsd, 2, xmm, xmm); break;
+        case YY_CPU_INST_PADDD: cpu_jit_rr(jit, 0x66, false, op_paddd, 2, xmm, xmm); break;
+        case YY_CPU_INST_PMULLD: cpu_jit_rr(jit, 0x66, false, op_pmulld, 3, xmm, xmm); break;
+        case YY_CPU_INST_VADDPS: cpu_jit_vex(jit, 1, 0, 0x58, xmm, xmm, xmm); break;
+        case YY_CPU_INST_VMULPS: cpu_jit_vex(jit, 1, 0, 0x59, xmm, xmm, xmm); break;
+        case YY_CPU_INST_VFMADDPS: cpu_jit_vex(jit, 2, 1, 0xB8, xmm, xmm, xmm); break;
+        default: break;
+    }
+}
+
+/* Generate: void func(void) { init; loop (count) { inst * unroll } } */
+static bool cpu_jit_gen(u8 *code, yy_cpu_inst inst, bool dependent,
+                        u32 unroll, u32 count) {
+    static const u8 op_movq[] = { 0x0F, 0x6E };
+    cpu_jit jit;
+    jit.cur = code;
+    jit.end = code + CPU_JIT_CODE_SIZE;
+    jit.overflow = false;
+
+    /* registers init, avoid denormals */
+    if (cpu_inst_is_avx(inst)) {
+        cpu_jit_byte(&jit, 0xC5); cpu_jit_byte(&jit, 0xF8); cpu_jit_byte(&jit, 0x77); /* vzeroupper */
+        for (u32 i = 0; i < CPU_JIT_XMM_COUNT; i++) {
+            cpu_jit_vex(&jit, 1, 0, 0x57, i, i, i); /* vxorps ymm, ymm, ymm */
+        }
+    } else if (!cpu_inst_is_gpr(inst)) {
+        cpu_jit_byte(&jit, 0x48); cpu_jit_byte(&jit, 0xB8); /* mov rax, 1.0 */
+        cpu_jit_u64(&jit, 0x3FF0000000000000ULL);
+        for (u32 i = 0; i < CPU_JIT_XMM_COUNT; i++) {
+            cpu_jit_rr(&jit, 0x66, true, op_movq, 2, i, CPU_JIT_RAX); /* movq xmm, rax */
+        }
+    }
+    for (u32 i = 0; i < CPU_JIT_GPR_COUNT; i++) {
+        u32 reg = cpu_jit_gprs[i];
+        if (reg >= 8) cpu_jit_byte(&jit, 0x41);
+        cpu_jit_byte(&jit, 0xB8 + (reg & 7)); /* mov r32, 1 */
+        cpu_jit_u32(&jit, 1);
+    }
+    if (inst == YY_CPU_INST_LOAD || inst == YY_CPU_INST_STORE) {
+        u32 reg = cpu_jit_gprs[0];
+        cpu_jit_byte(&jit, 0x48 | (reg >> 3)); /* mov base, imm64 */
+        cpu_jit_byte(&jit, 0xB8 + (reg & 7));
+        cpu_jit_u64(&jit, (u64)(usize)cpu_jit_data);
+    }
+    cpu_jit_byte(&jit, 0x49); cpu_jit_byte(&jit, 0xC7); cpu_jit_byte(&jit, 0xC3); /* mov r11, count */
+    cpu_jit_u32(&jit, count);
+
+    /* align loop to 64 bytes */
+    while (((usize)jit.cur & 63) != 0 && !jit.overflow) cpu_jit_byte(&jit, 0x90);
+    u8 *loop = jit.cur;
+    for (u32 i = 0; i < unroll; i++) cpu_jit_emit_inst(&jit, inst, dependent, i);
+    cpu_jit_byte(&jit, 0x49); cpu_jit_byte(&jit, 0xFF); cpu_jit_byte(&jit, 0xCB); /* dec r11 */
+    cpu_jit_byte(&jit, 0x0F); cpu_jit_byte(&jit, 0x85); /* jnz loop */
+    cpu_jit_u32(&jit, (u32)(i32)(loop - (jit.cur + 4)));
+    if (cpu_inst_is_avx(inst)) {
+        cpu_jit_byte(&jit, 0xC5); cpu_jit_byte(&jit, 0xF8); cpu_jit_byte(&jit, 0x77); /* vzeroupper */
+    }
+    cpu_jit_byte(&jit, 0xC3); /* ret */
+    return !jit.overflow;
+}
+
+static u8 *cpu_jit_alloc(void) {
+#if defined(_WIN32)
+    return (u8 *)VirtualAlloc(NULL, CPU_JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void *mem = mmap(NULL, CPU_JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : (u8 *)mem;
+#endif
+}
+
+/* Switch the page from writable to executable (W^X). */
+static bool cpu_jit_seal(u8 *code) {
+#if defined(_WIN32)
+    DWORD old;
+    if (!VirtualProtect(code, CPU_JIT_CODE_SIZE, PAGE_EXECUTE_READ, &old)) return false;
+    return FlushInstructionCache(GetCurrentProcess(), code, CPU_JIT_CODE_SIZE) != 0;
+#else
+    return mprotect(code, CPU_JIT_CODE_SIZE, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void cpu_jit_free(u8 *code) {
+#if defined(_WIN32)
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, CPU_JIT_CODE_SIZE);
+#endif
+}
+
+/* Generate and run the loop, returns the min ticks of several runs,
+   or 0 if failed. */
+static u64 cpu_jit_run(yy_cpu_inst inst, bool dependent, u32 unroll, u32 count) {
+    typedef void (*cpu_jit_func)(void);
+    union { u8 *code; cpu_jit_func func; } jit_func;
+    u64 best = 0;
+    u8 *code = cpu_jit_alloc();
+    if (!code) return 0;
+    if (!cpu_jit_gen(code, inst, dependent, unroll, count) || !cpu_jit_seal(code)) {
+        cpu_jit_free(code);
+        return 0;
+    }
+    jit_func.func = NULL;
+    jit_func.code = code;
+    for (int i = 0; i < CPU_JIT_RUNS; i++) {
+        cpu_jit_data[0] = (u64)(usize)cpu_jit_data;
+        u64 t1 = yy_time_get_ticks_begin();
+        jit_func.func();
+        u64 t2 = yy_time_get_ticks_end();
+        u64 ticks = yy_time_ticks_elapsed(t1, t2);
+        if (i == 0 || ticks < best) best = ticks;
+    }
+    cpu_jit_free(code);
+    return best ? best : 1;
+}
+
+static bool cpu_xgetbv_avx(void) {
+#if defined(_MSC_VER)
+    return (_xgetbv(0) & 6) == 6;
+#else
+    u32 eax, edx;
+    __asm volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (eax & 6) == 6;
+#endif
+}
+
+bool yy_cpu_inst_supported(yy_cpu_inst inst) {
+    u32 regs[4];
+    if ((u32)inst >= YY_CPU_INST_COUNT) return false;
+    if (inst <= YY_CPU_INST_PADDD) return true; /* x86-64 includes SSE2 */
+    if (!cpu_cpuid(0, 0, regs) || regs[0] < 1) return false;
+    cpu_cpuid(1, 0, regs);
+    u32 ecx = regs[2];
+    if (inst == YY_CPU_INST_PMULLD) return (ecx & (1u << 19)) != 0; /* SSE4.1 */
+    bool avx = (ecx & (1u << 28)) && (ecx & (1u << 27)) && cpu_xgetbv_avx();
+    if (inst == YY_CPU_INST_VFMADDPS) return avx && (ecx & (1u << 12)) != 0; /* FMA */
+    return avx;
+}
+
+f64 yy_cpu_measure_inst(yy_cpu_inst inst, bool dependent, u32 unroll) {
+    if (!yy_cpu_inst_supported(inst)) return 0;
+    if (!unroll) unroll = CPU_JIT_DEFAULT_UNROLL;
+    if (unroll > CPU_JIT_MAX_UNROLL) unroll = CPU_JIT_MAX_UNROLL;
+
+    u32 count = CPU_JIT_INST_PER_RUN / unroll;
+    u64 ticks_a = cpu_jit_run(inst, dependent, unroll, count);
+    u64 ticks_b = cpu_jit_run(inst, dependent, unroll * 2, count);
+    if (!ticks_a || !ticks_b) return 0;
+    if (ticks_b <= ticks_a) return 0.0;
+    f64 cycles = (f64)(ticks_b - ticks_a) * yy_cpu_get_cycle_per_tick();
+    return cycles / ((f64)count * unroll);
+}
+
+#else
+
+bool yy_cpu_inst_supported(yy_cpu_inst inst) {
+    (void)inst;
+    return false;
+}
+
+f64 yy_cpu_measure_inst(yy_cpu_inst inst, bool dependent, u32 unroll) {
+    (void)inst; (void)dependent; (void)unroll;
+    return 0;
+}
+
+#endif
+
+bool yy_cpu_measure_inst_info(yy_cpu_inst inst, f64 *latency, f64 *throughput) {
+    if (!yy_cpu_inst_supported(inst)) return false;
+    f64 lat = yy_cpu_measure_inst(inst, true, 0);
+    f64 thr = yy_cpu_measure_inst(inst, false, 0);
+    if (latency) *latency = lat;
+    if (throughput) *throughput = thr;
+    return true;
+}
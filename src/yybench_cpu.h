@@ -31,6 +31,22 @@ void yy_cpu_spin(f64 second);
     This function may returns inaccurate result in debug mode. */
 void yy_cpu_measure_freq(void);
 
+/** Measure current CPU frequency with a persisted calibration cache.
+    
+    This function runs a short validation (about 1/8 of yy_cpu_measure_freq()),
+    and compares it with the cached value (keyed by CPU model, kernel and boot
+    id), and then the hardware information (CPUID leaf 0x15/0x16, cpufreq in
+    sysfs). The full measurement is used only when all of them fail validation,
+    and the result is written back to the cache file.
+    
+    @param cache_path The cache file path, pass NULL to use the default path
+        "yybench_cpu_freq.cache" in the user cache directory ($XDG_CACHE_HOME
+        or ~/.cache), or "yybench_cpu_freq.<uid>.cache" in the temporary
+        directory if there is no user cache directory. The file is replaced
+        atomically, so concurrent processes can share it.
+    @return true if the full measurement was skipped. */
+bool yy_cpu_measure_freq_fast(const char *cache_path);
+
 /** Returns CPU frequency in Hz.
     You should call yy_cpu_measure_freq() at least once before calling this
     function. */
@@ -57,6 +73,223 @@ f64 yy_cpu_tick_to_sec(u64 tick);
 u64 yy_cpu_tick_to_cycle(u64 tick);
 
 
+
+/*==============================================================================
+ * CPU Affinity
+ *============================================================================*/
+
+/** Pin current thread to a core, so the OS will not migrate the thread to
+    other cores. On macOS, this is only an affinity hint to the scheduler.
+    Returns false if the core is not available or not supported. */
+bool yy_cpu_pin_thread(int core);
+
+/** Allow current thread to run on all cores available to the process.
+    On Linux, this restores the affinity saved before the first
+    yy_cpu_pin_thread() call, or all online cores (limited by the cpuset) if
+    no thread is pinned by this library. */
+bool yy_cpu_unpin_thread(void);
+
+/** Whether the process may run on a core (not excluded by the affinity or
+    cpuset), so it can be used with yy_cpu_pin_thread().
+    On Linux, this checks the affinity saved before the first
+    yy_cpu_pin_thread() call, or the affinity of current thread if no thread
+    is pinned by this library. On macOS, pinning is only a hint and all cores
+    are allowed. Returns false if it's not supported. */
+bool yy_cpu_is_allowed(int core);
+
+/** Pick a quiet core for benchmark.
+    Cores isolated from the scheduler (isolcpus) and with tick disabled
+    (nohz_full) are preferred, and cores which are busy or whose SMT siblings
+    are busy are avoided. The candidates are the cpus of the cgroup cpuset
+    (or all online cpus), not the scheduler affinity, since the isolated cpus
+    are excluded from the default affinity. The core load is sampled from
+    /proc/stat for about 50ms. This function is available on Linux only.
+    Returns the core id, or -1 if it's not supported. */
+int yy_cpu_pick_quiet_core(void);
+
+/** A scope to pin current thread and restore the previous affinity. */
+typedef struct yy_cpu_pin_scope {
+    bool pinned;
+    u64 mask[16]; /* previous affinity mask */
+} yy_cpu_pin_scope;
+
+/** Save the affinity of current thread to the scope, then pin the thread to
+    a core. Returns false if pin fails. */
+bool yy_cpu_pin_scope_begin(yy_cpu_pin_scope *scope, int core);
+
+/** Restore the affinity of current thread which was saved in the scope. */
+bool yy_cpu_pin_scope_end(yy_cpu_pin_scope *scope);
+
+
+
+/*==============================================================================
+ * CPU Per-Core Survey
+ *============================================================================*/
+
+/** Pin current thread to each online core in turn, measure the CPU frequency
+    and the timer offset (relative to the first online core) of each core.
+    The results are stored in a per-core table.
+    This function may take about 60ms per core, it's available on Linux only.
+    Returns false if the survey is not supported or fails. */
+bool yy_cpu_survey_cores(void);
+
+/** Returns the size of the per-core table (the max core id + 1),
+    or 0 if yy_cpu_survey_cores() was not called successfully. */
+u32 yy_cpu_get_core_count(void);
+
+/** Returns the id of the core which current thread is running on,
+    or -1 if it's unknown. */
+int yy_cpu_get_current_core(void);
+
+/** Returns CPU frequency of the core in Hz, or 0 if it's not measured. */
+u64 yy_cpu_get_core_freq(u32 core);
+
+/** Returns the timer offset of the core in ticks, relative to the first online
+    core: (ticks on this core) - (ticks on the first core) at the same moment.
+    Returns 0 if it's not measured. */
+i64 yy_cpu_get_core_tick_offset(u32 core);
+
+/** Convert tick to CPU cycle with the frequency of the specified core.
+    This function uses the global frequency (same as yy_cpu_tick_to_cycle())
+    if the core is not measured by yy_cpu_survey_cores(). */
+u64 yy_cpu_tick_to_cycle_on_core(u64 tick, u32 core);
+
+
+
+/*==============================================================================
+ * CPU Frequency Monitor
+ *============================================================================*/
+
+/** A sample of CPU frequency. */
+typedef struct yy_cpu_freq_sample {
+    f64 time; /* timestamp in seconds, same clock as yy_time_get_seconds() */
+    u64 sys_freq; /* frequency reported by OS (cpufreq) in Hz, 0 if unknown */
+    u64 probe_freq; /* frequency measured by a short probe in Hz, 0 if unknown */
+    f64 probe_begin; /* probe begin time in seconds, 0 if no probe */
+    f64 probe_end; /* probe end time in seconds, 0 if no probe */
+} yy_cpu_freq_sample;
+
+/** A frequency monitor, it samples CPU frequency in a background thread. */
+typedef struct yy_cpu_monitor yy_cpu_monitor;
+
+/** Creates a frequency monitor.
+    @param interval The sampling interval in seconds, such as 0.1.
+    @param core The core to read OS reported frequency,
+        pass -1 to use the core which current thread is running on.
+    @param probe Whether to run a short probe of dependent adds (about 400K
+        cycles, or 0.1 ms at 4 GHz) in the sampler thread on each sample.
+        The probe measures the actual clock rate of the core, see
+        yy_cpu_monitor_get_probe_core(). The timer frequency should be measured
+        before, see yy_cpu_measure_freq(), or probe_freq is 0.
+    @return NULL if the monitor is not supported on this platform. */
+yy_cpu_monitor *yy_cpu_monitor_new(f64 interval, int core, bool probe);
+
+/** Returns the core the probe runs on, or -1 if the probe is disabled.
+    The sampler thread is pinned to an SMT sibling of the monitored core, which
+    shares its clock, or to the monitored core itself if it has no sibling
+    (then the probe adds load on the monitored core). If the sampler cannot be
+    pinned, the probe is skipped and probe_freq is 0.
+    The sibling shares the execution ports, caches and branch predictor of the
+    physical core, so the benchmark on the monitored core runs slower while the
+    probe runs, the measurements overlapping [probe_begin, probe_end] of a
+    sample may be excluded. */
+int yy_cpu_monitor_get_probe_core(const yy_cpu_monitor *monitor);
+
+/** Stop and free the monitor. */
+void yy_cpu_monitor_free(yy_cpu_monitor *monitor);
+
+/** Start sampling in a background thread. The timeline is cleared. */
+bool yy_cpu_monitor_start(yy_cpu_monitor *monitor);
+
+/** Stop sampling and wait for the background thread to exit. */
+bool yy_cpu_monitor_stop(yy_cpu_monitor *monitor);
+
+/** Copy the sampled timeline, returns the sample count.
+    The result should be released with free(). */
+u32 yy_cpu_monitor_copy_samples(yy_cpu_monitor *monitor,
+                                yy_cpu_freq_sample **samples);
+
+/** Check whether the frequency drifted in a measurement window.
+    The probe frequency is compared with yy_cpu_get_freq() (or the first probe
+    sample if it's not measured), and the OS frequency is compared with the
+    first OS sample of the timeline.
+    @param begin The window begin time, from yy_time_get_seconds().
+    @param end The window end time, from yy_time_get_seconds().
+    @param threshold The max allowed relative drift, such as 0.02 for 2%.
+    @param drift Output the max relative drift in the window, can be NULL.
+    @return true if the frequency is stable in the window. */
+bool yy_cpu_monitor_check(yy_cpu_monitor *monitor, f64 begin, f64 end,
+                          f64 threshold, f64 *drift);
+
+/** Returns the average frequency in a measurement window in Hz, which may be
+    used to renormalize the results. The probe frequency is preferred.
+    Returns 0 if there is no sample in the window. */
+u64 yy_cpu_monitor_get_freq(yy_cpu_monitor *monitor, f64 begin, f64 end);
+
+
+
+/*==============================================================================
+ * CPU Instruction Probe
+
+ A runtime code generator which emits a loop of one instruction into an
+ executable page, and measures it with the same A/B differencing trick as
+ yy_cpu_run_seq_a/b: the loop is generated with `unroll` and `unroll * 2`
+ instructions, and the difference removes the loop and call overhead.
+
+ dependent:   each instruction uses the result of the previous one,
+              the result is latency in cycles.
+ independent: instructions rotate over several registers (independent chains),
+              the result is reciprocal throughput in cycles.
+
+ It's only supported on x86-64 now. The CPU frequency should be measured
+ before the probe, see yy_cpu_measure_freq().
+
+ Usage:
+
+     yy_cpu_measure_freq();
+     f64 lat, thr;
+     if (yy_cpu_measure_inst_info(YY_CPU_INST_IMUL, &lat, &thr)) {
+         printf("imul: latency %.2f, throughput %.2f\n", lat, thr);
+     }
+
+ *============================================================================*/
+
+/** Instruction to probe. */
+typedef enum yy_cpu_inst {
+    YY_CPU_INST_ADD = 0, /* add r64, r64 */
+    YY_CPU_INST_IMUL, /* imul r64, r64 */
+    YY_CPU_INST_LOAD, /* mov r64, [r64] (L1 hit) */
+    YY_CPU_INST_STORE, /* mov [r64], r64, dependent: store and reload */
+    YY_CPU_INST_ADDSD, /* addsd xmm, xmm (SSE2) */
+    YY_CPU_INST_MULSD, /* mulsd xmm, xmm (SSE2) */
+    YY_CPU_INST_DIVSD, /* divsd xmm, xmm (SSE2) */
+    YY_CPU_INST_PADDD, /* paddd xmm, xmm (SSE2) */
+    YY_CPU_INST_PMULLD, /* pmulld xmm, xmm (SSE4.1) */
+    YY_CPU_INST_VADDPS, /* vaddps ymm, ymm, ymm (AVX) */
+    YY_CPU_INST_VMULPS, /* vmulps ymm, ymm, ymm (AVX) */
+    YY_CPU_INST_VFMADDPS, /* vfmadd231ps ymm, ymm, ymm (FMA) */
+    YY_CPU_INST_COUNT
+} yy_cpu_inst;
+
+/** Returns the instruction name, such as "imul r64, r64". */
+const char *yy_cpu_inst_get_name(yy_cpu_inst inst);
+
+/** Returns whether the instruction can be probed on this CPU. */
+bool yy_cpu_inst_supported(yy_cpu_inst inst);
+
+/** Measure cycles per instruction.
+    @param inst The instruction.
+    @param dependent Whether the instructions form a dependency chain.
+    @param unroll Instructions per loop iteration (1 to 1024),
+        pass 0 to use the default (64).
+    @return Cycles per instruction, or 0 if not supported. */
+f64 yy_cpu_measure_inst(yy_cpu_inst inst, bool dependent, u32 unroll);
+
+/** Measure latency and reciprocal throughput of an instruction in cycles.
+    Returns false if not supported. */
+bool yy_cpu_measure_inst_info(yy_cpu_inst inst, f64 *latency, f64 *throughput);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,10 @@
 
 #include "yybench_file.h"
 
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
 
 /*==============================================================================
  * File Utils
@@ -320,32 +324,43 @@ bool yy_file_read_with_padding(const char *path, u8 **dat, usize *len, usize pad
         fclose(file);
         return false;
     }
-    void *buf = malloc((usize)file_size + padding);
+    
+    /* The size reported by pseudo files (such as /proc and /sys on Linux)
+       may be 0 or a page size, so read until the end of file. */
+    usize capacity = (usize)file_size + 1;
+    usize size = 0;
+    if (capacity < 4096) capacity = 4096;
+    u8 *buf = (u8 *)malloc(capacity + padding);
     if (buf == NULL) {
         fclose(file);
         return false;
     }
-    
-    if (file_size > 0) {
-#if _MSC_VER >= 1400
-        if (fread_s(buf, file_size, file_size, 1, file) != 1) {
-            free(buf);
-            fclose(file);
-            return false;
-        }
-#else
-        if (fread(buf, file_size, 1, file) != 1) {
-            free(buf);
-            fclose(file);
-            return false;
+    while (true) {
+        if (size == capacity) {
+            usize new_capacity = capacity * 2;
+            u8 *new_buf = (u8 *)realloc(buf, new_capacity + padding);
+            if (new_buf == NULL) {
+                free(buf);
+                fclose(file);
+                return false;
+            }
+            buf = new_buf;
+            capacity = new_capacity;
         }
-#endif
+        usize read = fread(buf + size, 1, capacity - size, file);
+        size += read;
+        if (read == 0) break;
+    }
+    if (ferror(file)) {
+        free(buf);
+        fclose(file);
+        return false;
     }
     fclose(file);
     
-    memset((char *)buf + file_size, 0, padding);
-    *dat = (u8 *)buf;
-    *len = (usize)file_size;
+    memset(buf + size, 0, padding);
+    *dat = buf;
+    *len = size;
     return true;
 }
 
@@ -371,6 +386,44 @@ bool yy_file_write(const char *path, u8 *dat, usize len) {
     return true;
 }
 
+bool yy_file_write_atomic(const char *path, u8 *dat, usize len) {
+    char tmp[YY_MAX_PATH];
+    bool suc;
+    if (!path || !strlen(path)) return false;
+    if (len && !dat) return false;
+    if (strlen(path) + 32 >= YY_MAX_PATH) return false;
+    
+#ifdef _WIN32
+    static volatile LONG counter = 0;
+    snprintf(tmp, sizeof(tmp), "%s.%lu.%ld.tmp", path,
+             (unsigned long)GetCurrentProcessId(),
+             (long)InterlockedIncrement(&counter));
+    suc = yy_file_write(tmp, dat, len) &&
+          MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+    if (!suc) DeleteFileA(tmp);
+    return suc;
+#else
+    /* mkstemp() creates the file exclusively with mode 0600,
+       keep the mode of the existing file, or 0644 for a new file */
+    struct stat st;
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    int fd = mkstemp(tmp);
+    if (fd == -1) return false;
+    fchmod(fd, stat(path, &st) == 0 ? (st.st_mode & 0777) : 0644);
+    FILE *file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        remove(tmp);
+        return false;
+    }
+    suc = len == 0 || fwrite(dat, len, 1, file) == 1;
+    if (fclose(file) != 0) suc = false;
+    if (suc) suc = rename(tmp, path) == 0;
+    if (!suc) remove(tmp);
+    return suc;
+#endif
+}
+
 bool yy_file_delete(const char *path) {
     if (!path || !*path) return false;
     return remove(path) == 0;
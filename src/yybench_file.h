@@ -83,6 +83,11 @@ bool yy_file_read_with_padding(const char *path, u8 **dat, usize *len, usize pad
 /** Write data to file, overwrite if exist. */
 bool yy_file_write(const char *path, u8 *dat, usize len);
 
+/** Write data to a unique temporary file in the same directory, then rename it
+    to path, so readers never see a partially written file and an existing
+    symlink at path is replaced instead of followed. */
+bool yy_file_write_atomic(const char *path, u8 *dat, usize len);
+
 /** Delete a file, returns true if success. */
 bool yy_file_delete(const char *path);
 
@@ -0,0 +1,407 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_mem.h"
+#include "yybench_cpu.h"
+#include "yybench_time.h"
+#include "yybench_topo.h"
+#include "yybench_rand.h"
+#include "yybench_thread.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#define MEM_DEFAULT_HOPS (1 << 20)
+#define MEM_DEFAULT_MIN_SIZE ((usize)4 * 1024)
+#define MEM_DEFAULT_MAX_SIZE ((u64)4 * 1024 * 1024 * 1024)
+#define MEM_LATENCY_RUNS 3
+#define MEM_RING_SEED 0x5EED5EED5EED5EEDULL /* fixed seed of the latency ring */
+
+#define REPEAT_2(x)   x x
+#define REPEAT_4(x)   REPEAT_2(REPEAT_2(x))
+#define REPEAT_8(x)   REPEAT_2(REPEAT_4(x))
+#define REPEAT_16(x)  REPEAT_2(REPEAT_8(x))
+
+
+/* Returns physical memory size in bytes, or 0 if unknown. */
+static u64 mem_get_physical_size(void) {
+#if defined(_WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) return 0;
+    return (u64)status.ullTotalPhys;
+#elif defined(__APPLE__)
+    u64 size = 0;
+    usize len = sizeof(size);
+    if (sysctlbyname("hw.memsize", &size, &len, NULL, 0) != 0) return 0;
+    return size;
+#elif defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) return 0;
+    return (u64)pages * (u64)page_size;
+#else
+    return 0;
+#endif
+}
+
+/* Prevent the compiler from optimizing away the pointer chase. */
+static yy_inline void mem_keep(void *ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __asm volatile("" : : "r"(ptr) : "memory");
+#else
+    static void *volatile sink;
+    sink = ptr;
+    (void)sink;
+#endif
+}
+
+/* Link all slots into a single random cycle (Sattolo's algorithm),
+   returns the first slot. The ring is same for each call. */
+static void *mem_build_ring(u8 *buf, usize slot_size, usize slot_count) {
+    yy_random_state rs;
+    yy_random_seed_r(&rs, MEM_RING_SEED);
+    for (usize i = 0; i < slot_count; i++) {
+        *(usize *)(void *)(buf + i * slot_size) = i;
+    }
+    for (usize i = slot_count - 1; i > 0; i--) {
+        usize j = (usize)yy_random64_uniform_r(&rs, (u64)i);
+        usize *a = (usize *)(void *)(buf + i * slot_size);
+        usize *b = (usize *)(void *)(buf + j * slot_size);
+        usize tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+    for (usize i = 0; i < slot_count; i++) {
+        void **slot = (void **)(void *)(buf + i * slot_size);
+        *slot = buf + (*(usize *)slot) * slot_size;
+    }
+    return buf;
+}
+
+/* Follow the pointer chain, count should be a multiple of 16. */
+static yy_noinline void *mem_chase(void *p, u64 count) {
+    for (u64 i = 0; i < count; i += 16) {
+        REPEAT_16(p = *(void **)p;)
+    }
+    return p;
+}
+
+bool yy_mem_measure_latency(usize size, u64 hops, yy_mem_latency *result) {
+    usize slot_size = yy_topo_get_cache_line_size();
+    usize slot_count;
+    u8 *buf;
+    void *p;
+    u64 min_ticks = 0, warmup;
+
+    if (!result) return false;
+    if (slot_size < sizeof(void *)) slot_size = sizeof(void *);
+    slot_count = size / slot_size;
+    if (slot_count < 1) return false;
+    if (!hops) hops = MEM_DEFAULT_HOPS;
+    hops = (hops + 15) / 16 * 16;
+
+    buf = (u8 *)malloc(slot_count * slot_size);
+    if (!buf) return false;
+    p = mem_build_ring(buf, slot_size, slot_count);
+
+    /* warm up: touch the whole ring once (limited to the hops of one run) */
+    warmup = (u64)slot_count < hops ? (u64)slot_count : hops;
+    p = mem_chase(p, (warmup + 15) / 16 * 16);
+
+    for (int i = 0; i < MEM_LATENCY_RUNS; i++) {
+        u64 t1 = yy_time_get_ticks_begin();
+        p = mem_chase(p, hops);
+        u64 t2 = yy_time_get_ticks_end();
+        u64 ticks = yy_time_ticks_elapsed(t1, t2);
+        if (i == 0 || ticks < min_ticks) min_ticks = ticks;
+    }
+    mem_keep(p);
+    free(buf);
+
+    result->size = slot_count * slot_size;
+    result->cycles = (f64)yy_cpu_tick_to_cycle(min_ticks) / (f64)hops;
+    result->ns = yy_cpu_tick_to_sec(min_ticks) * 1000.0 * 1000.0 * 1000.0 / (f64)hops;
+    return true;
+}
+
+usize yy_mem_profile_latency(usize min_size, usize max_size,
+                             yy_mem_latency **results) {
+    yy_mem_latency *arr;
+    usize count = 0, capacity = 0;
+
+    if (!results) return 0;
+    *results = NULL;
+    if (!min_size) min_size = MEM_DEFAULT_MIN_SIZE;
+    if (!max_size) {
+        u64 max = MEM_DEFAULT_MAX_SIZE;
+        u64 phys = mem_get_physical_size();
+        if (phys && max > phys / 4) max = phys / 4;
+        if (max > (u64)((usize)~(usize)0 / 2)) max = (u64)((usize)~(usize)0 / 2);
+        max_size = (usize)max;
+    }
+    if (max_size < min_size) return 0;
+
+    for (usize size = min_size; size <= max_size && size >= min_size; size *= 2) {
+        for (int step = 0; step < 2; step++) {
+            usize cur = step == 0 ? size : size + size / 2;
+            if (cur > max_size || cur < size) break;
+            if (count == capacity) {
+                usize new_capacity = capacity ? capacity * 2 : 64;
+                arr = (yy_mem_latency *)realloc(*results, new_capacity * sizeof(yy_mem_latency));
+                if (!arr) break;
+                *results = arr;
+                capacity = new_capacity;
+            }
+            /* skip the sizes which cannot be allocated */
+            if (yy_mem_measure_latency(cur, 0, *results + count)) count++;
+        }
+        if (size > max_size / 2) break;
+    }
+    if (!count && *results) {
+        free(*results);
+        *results = NULL;
+    }
+    return count;
+}
+
+bool yy_mem_report_latency(yy_report *report,
+                           const yy_mem_latency *results, usize count) {
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+
+    if (!report || !results || !count) return false;
+
+    yy_chart_options_init(&op);
+    op.title = "Memory Latency";
+    op.subtitle = "random pointer chase, one load per cache line";
+    op.type = YY_CHART_LINE;
+    op.h_axis.title = "buffer size (KB)";
+    op.h_axis.logarithmic = true;
+    op.v_axis.title = "latency per load";
+    op.tooltip.value_decimals = 2;
+    op.tooltip.shared = true;
+    op.tooltip.crosshairs = true;
+
+    chart = yy_chart_new();
+    if (!chart) return false;
+    suc &= yy_chart_set_options(chart, &op);
+    suc &= yy_chart_item_begin(chart, "ns");
+    for (usize i = 0; i < count; i++) {
+        suc &= yy_chart_item_add_point(chart, (float)(results[i].size / 1024.0),
+                                       (float)results[i].ns);
+    }
+    suc &= yy_chart_item_end(chart);
+    suc &= yy_chart_item_begin(chart, "cycles");
+    for (usize i = 0; i < count; i++) {
+        suc &= yy_chart_item_add_point(chart, (float)(results[i].size / 1024.0),
+                                       (float)results[i].cycles);
+    }
+    suc &= yy_chart_item_end(chart);
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    return suc;
+}
+
+
+
+/*==============================================================================
+ * Memory Bandwidth
+ *============================================================================*/
+
+#define MEM_BANDWIDTH_RUNS 6 /* the first run is ignored */
+#define MEM_KERNEL_COUNT 4
+
+typedef struct {
+    yy_spin_barrier barrier;
+    volatile bool failed;
+    usize count; /* element count of each array */
+    f64 best[MEM_KERNEL_COUNT]; /* best time in seconds of each kernel */
+} mem_shared;
+
+static const f64 mem_kernel_bytes[MEM_KERNEL_COUNT] = { 16, 16, 24, 24 };
+
+static yy_noinline void mem_kernel_copy(f64 *c, const f64 *a, usize n) {
+    for (usize i = 0; i < n; i++) c[i] = a[i];
+}
+
+static yy_noinline void mem_kernel_scale(f64 *b, const f64 *c, f64 s, usize n) {
+    for (usize i = 0; i < n; i++) b[i] = s * c[i];
+}
+
+static yy_noinline void mem_kernel_add(f64 *c, const f64 *a, const f64 *b, usize n) {
+    for (usize i = 0; i < n; i++) c[i] = a[i] + b[i];
+}
+
+static yy_noinline void mem_kernel_triad(f64 *a, const f64 *b, const f64 *c, f64 s, usize n) {
+    for (usize i = 0; i < n; i++) a[i] = b[i] + s * c[i];
+}
+
+/* Thread function of yy_thread_run(), called after the thread is pinned,
+   thread 0 records the time. */
+static void mem_worker_run(void *ctx, u32 index) {
+    mem_shared *shared = (mem_shared *)ctx;
+    usize n = shared->count;
+    f64 *a, *b, *c;
+
+    /* first touch after pinned, the pages are allocated on local node */
+    a = (f64 *)malloc(n * sizeof(f64));
+    b = (f64 *)malloc(n * sizeof(f64));
+    c = (f64 *)malloc(n * sizeof(f64));
+    if (a && b && c) {
+        for (usize i = 0; i < n; i++) {
+            a[i] = 1.0;
+            b[i] = 2.0;
+            c[i] = 0.0;
+        }
+    } else {
+        shared->failed = true;
+    }
+    if (yy_spin_barrier_wait(&shared->barrier) && !shared->failed) {
+        for (int r = 0; r < MEM_BANDWIDTH_RUNS; r++) {
+            for (int k = 0; k < MEM_KERNEL_COUNT; k++) {
+                u64 t1 = 0, t2;
+                if (!yy_spin_barrier_wait(&shared->barrier)) goto done;
+                if (index == 0) t1 = yy_time_get_ticks_begin();
+                switch (k) {
+                    case 0: mem_kernel_copy(c, a, n); break;
+                    case 1: mem_kernel_scale(b, c, 3.0, n); break;
+                    case 2: mem_kernel_add(c, a, b, n); break;
+                    default: mem_kernel_triad(a, b, c, 3.0, n); break;
+                }
+                if (!yy_spin_barrier_wait(&shared->barrier)) goto done;
+                if (index == 0 && r > 0) {
+                    t2 = yy_time_get_ticks_end();
+                    f64 sec = yy_cpu_tick_to_sec(yy_time_ticks_elapsed(t1, t2));
+                    if (shared->best[k] == 0 || sec < shared->best[k]) {
+                        shared->best[k] = sec;
+                    }
+                }
+            }
+        }
+    }
+
+done:
+    free(a);
+    free(b);
+    free(c);
+}
+
+bool yy_mem_measure_bandwidth(u32 thread_count, usize size,
+                              yy_mem_bandwidth *result) {
+    mem_shared shared;
+    usize per_thread, total;
+    u32 unpinned;
+
+    if (!result || thread_count < 1) return false;
+#if defined(_WIN32)
+    if (thread_count > 1) return false;
+#endif
+    if (!size) size = yy_topo_get_working_set(YY_TOPO_DRAM);
+    per_thread = size / sizeof(f64) / thread_count;
+    if (per_thread < 1) return false;
+    total = per_thread * thread_count;
+
+    memset(&shared, 0, sizeof(shared));
+    yy_spin_barrier_init(&shared.barrier, thread_count);
+    shared.count = per_thread;
+    if (!yy_thread_run(thread_count, mem_worker_run, &shared,
+                       &shared.barrier, &unpinned)) return false;
+    if (shared.failed) return false;
+
+    f64 bw[MEM_KERNEL_COUNT];
+    for (int k = 0; k < MEM_KERNEL_COUNT; k++) {
+        bw[k] = shared.best[k] > 0 ?
+            mem_kernel_bytes[k] * (f64)total / shared.best[k] / 1e9 : 0;
+    }
+    result->thread_count = thread_count;
+    result->unpinned_count = unpinned;
+    result->copy = bw[0];
+    result->scale = bw[1];
+    result->add = bw[2];
+    result->triad = bw[3];
+    return true;
+}
+
+usize yy_mem_profile_bandwidth(u32 max_threads, usize size,
+                               yy_mem_bandwidth **results) {
+    yy_mem_bandwidth *arr;
+    usize count = 0;
+    u32 threads, step;
+
+    if (!results) return 0;
+    *results = NULL;
+    if (!max_threads) max_threads = yy_thread_get_cpu_count();
+    if (!max_threads) max_threads = 1;
+#if defined(_WIN32)
+    max_threads = 1;
+#endif
+
+    /* at most 2 log2(max_threads) + 2 points */
+    arr = (yy_mem_bandwidth *)calloc(64 + 2, sizeof(yy_mem_bandwidth));
+    if (!arr) return 0;
+    for (threads = 1; count < 64; threads += step) {
+        if (threads > max_threads) threads = max_threads;
+        if (yy_mem_measure_bandwidth(threads, size, arr + count)) count++;
+        if (threads == max_threads) break;
+        /* 1, 2, 3, 4, 6, 8, 12, 16, 24, 32... */
+        step = 1;
+        while (step * 4 <= threads) step *= 2;
+    }
+    if (!count) {
+        free(arr);
+        return 0;
+    }
+    *results = arr;
+    return count;
+}
+
+bool yy_mem_report_bandwidth(yy_report *report,
+                             const yy_mem_bandwidth *results, usize count) {
+    static const char *names[MEM_KERNEL_COUNT] = { "copy", "scale", "add", "triad" };
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+
+    if (!report || !results || !count) return false;
+
+    /* the result is less reliable if any thread is not pinned */
+    bool unpinned = false;
+    for (usize i = 0; i < count; i++) {
+        if (results[i].unpinned_count) unpinned = true;
+    }
+
+    yy_chart_options_init(&op);
+    op.title = "Memory Bandwidth";
+    op.subtitle = unpinned ?
+        "STREAM-style kernels, f64 arrays (some threads are not pinned)" :
+        "STREAM-style kernels, f64 arrays";
+    op.type = YY_CHART_LINE;
+    op.h_axis.title = "threads";
+    op.h_axis.allow_decimals = false;
+    op.v_axis.title = "GB/s";
+    op.tooltip.value_decimals = 2;
+    op.tooltip.value_suffix = " GB/s";
+    op.tooltip.shared = true;
+    op.tooltip.crosshairs = true;
+
+    chart = yy_chart_new();
+    if (!chart) return false;
+    suc &= yy_chart_set_options(chart, &op);
+    for (int k = 0; k < MEM_KERNEL_COUNT; k++) {
+        suc &= yy_chart_item_begin(chart, names[k]);
+        for (usize i = 0; i < count; i++) {
+            const yy_mem_bandwidth *bw = results + i;
+            f64 v = k == 0 ? bw->copy : k == 1 ? bw->scale : k == 2 ? bw->add : bw->triad;
+            suc &= yy_chart_item_add_point(chart, (float)bw->thread_count, (float)v);
+        }
+        suc &= yy_chart_item_end(chart);
+    }
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    return suc;
+}
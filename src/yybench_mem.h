@@ -0,0 +1,140 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_mem_h
+#define yybench_mem_h
+
+#include "yybench_def.h"
+#include "yybench_chart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * Memory Latency
+
+ The latency is measured with a pointer chase: the buffer is split into cache
+ line sized slots, and the slots are linked into a single random cycle, so each
+ load depends on the previous one and the hardware prefetcher cannot predict
+ the next address. The latency-vs-size curve shows each level of the memory
+ hierarchy (L1, L2, L3, DRAM, and TLB misses).
+
+ Usage:
+
+     yy_cpu_setup_priority();
+     yy_cpu_spin(1.0);
+     yy_cpu_measure_freq();
+
+     yy_mem_latency *results;
+     usize count = yy_mem_profile_latency(0, 0, &results);
+
+     yy_report *report = yy_report_new();
+     yy_report_add_env_info(report);
+     yy_mem_report_latency(report, results, count);
+     yy_report_write_html_file(report, "latency.html");
+     yy_report_free(report);
+     free(results);
+
+ *============================================================================*/
+
+/** Memory latency of one buffer size. */
+typedef struct yy_mem_latency {
+    usize size; /* buffer size in bytes */
+    f64 cycles; /* average CPU cycles per load */
+    f64 ns; /* average nanoseconds per load */
+} yy_mem_latency;
+
+/** Measure the average load latency of a random pointer chase over a buffer.
+    @param size Buffer size in bytes, at least one cache line.
+    @param hops Number of loads per run, pass 0 to use the default (1M).
+    @param result The result.
+    @return false if the buffer cannot be allocated.
+    The CPU frequency should be measured before this function is called. */
+bool yy_mem_measure_latency(usize size, u64 hops, yy_mem_latency *result);
+
+/** Measure the memory latency with buffer sizes from min_size to max_size,
+    with 2 sizes per octave (such as 4K, 6K, 8K, 12K, 16K...).
+    @param min_size Min buffer size, pass 0 to use the default (4KB).
+    @param max_size Max buffer size, pass 0 to use the default (4GB, limited
+        to a quarter of the physical memory).
+    @param results Output results, should be released with free().
+    @return The result count, or 0 on error. */
+usize yy_mem_profile_latency(usize min_size, usize max_size,
+                             yy_mem_latency **results);
+
+/** Add a latency-vs-size line chart (logarithmic size axis) to report. */
+bool yy_mem_report_latency(yy_report *report,
+                           const yy_mem_latency *results, usize count);
+
+
+
+/*==============================================================================
+ * Memory Bandwidth
+
+ STREAM-style kernels on arrays of f64, each thread owns a slice of the arrays
+ (allocated and initialized by itself, so the pages are local to its NUMA node):
+     copy:  c[i] = a[i]                16 bytes per element
+     scale: b[i] = s * c[i]            16 bytes per element
+     add:   c[i] = a[i] + b[i]         24 bytes per element
+     triad: a[i] = b[i] + s * c[i]     24 bytes per element
+ The write-allocate traffic is not counted, same as STREAM.
+
+ Threads are pinned to one hardware thread of each physical core first,
+ interleaved across NUMA nodes, then to the remaining SMT siblings. The cpus
+ excluded by the affinity or cpuset are skipped, and the threads which cannot
+ be pinned are counted in `unpinned_count`.
+ Multi-thread is not supported on Windows yet.
+
+ Usage:
+
+     yy_mem_bandwidth *results;
+     usize count = yy_mem_profile_bandwidth(0, 0, &results);
+     yy_mem_report_bandwidth(report, results, count);
+     free(results);
+
+ *============================================================================*/
+
+/** Memory bandwidth of one thread count, in GB/s (10^9 bytes per second). */
+typedef struct yy_mem_bandwidth {
+    u32 thread_count; /* number of threads */
+    u32 unpinned_count; /* threads not pinned to a cpu, the result may be
+                           disturbed by migration */
+    f64 copy; /* copy kernel bandwidth */
+    f64 scale; /* scale kernel bandwidth */
+    f64 add; /* add kernel bandwidth */
+    f64 triad; /* triad kernel bandwidth */
+} yy_mem_bandwidth;
+
+/** Measure the memory bandwidth with a number of threads.
+    @param thread_count Number of threads, at least 1.
+    @param size The size of each array in bytes (shared by all threads),
+        pass 0 to use the default (yy_topo_get_working_set(YY_TOPO_DRAM)).
+    @param result The result.
+    @return false if the memory or threads cannot be allocated. */
+bool yy_mem_measure_bandwidth(u32 thread_count, usize size,
+                              yy_mem_bandwidth *result);
+
+/** Measure the memory bandwidth with 1 to max_threads threads
+    (1, 2, 3, 4, 6, 8, 12, 16... and max_threads).
+    @param max_threads Max thread count, pass 0 to use all logical CPUs
+        allowed by the affinity or cpuset.
+    @param size The size of each array in bytes, pass 0 to use the default.
+    @param results Output results, should be released with free().
+    @return The result count, or 0 on error. */
+usize yy_mem_profile_bandwidth(u32 max_threads, usize size,
+                               yy_mem_bandwidth **results);
+
+/** Add a bandwidth-vs-thread-count line chart to report. */
+bool yy_mem_report_bandwidth(yy_report *report,
+                             const yy_mem_bandwidth *results, usize count);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,391 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_metric.h"
+#include "yybench_str.h"
+
+/* Compiled expression: a sequence of stack operations (reverse polish). */
+typedef enum {
+    METRIC_OP_NUM, /* push a number */
+    METRIC_OP_VAR, /* push a named value */
+    METRIC_OP_NEG,
+    METRIC_OP_ADD,
+    METRIC_OP_SUB,
+    METRIC_OP_MUL,
+    METRIC_OP_DIV
+} metric_op_type;
+
+typedef struct {
+    metric_op_type type;
+    f64 num;
+    const char *var; /* name of METRIC_OP_VAR, owned by the metric */
+} metric_op;
+
+#define METRIC_MAX_DEPTH 64
+
+struct yy_metric {
+    char *name;
+    char *expr;
+    metric_op *ops;
+    u32 op_count;
+    u32 op_capacity;
+    u32 stack_size; /* max stack depth while evaluating */
+};
+
+static const char *metric_std_names[YY_METRIC_STD_COUNT] = {
+    "IPC",
+    "CPI",
+    "branch MPKI",
+    "branch miss rate",
+    "L1D miss rate",
+    "LLC miss rate",
+    "cycles/byte",
+    "cycles/op",
+    "instructions/op"
+};
+
+static const char *metric_std_exprs[YY_METRIC_STD_COUNT] = {
+    "instructions / cycles",
+    "cycles / instructions",
+    "1000 * branch-misses / instructions",
+    "branch-misses / branches",
+    "L1d-load-misses / L1d-loads",
+    "LLC-load-misses / LLC-loads",
+    "cycles / bytes",
+    "cycles / ops",
+    "instructions / ops"
+};
+
+/* Names of the same event, the first one is Apple alias (or perf stat name),
+   and the others are Linux names from yy_perf_get_event_names(). */
+static const char *metric_aliases[][3] = {
+    { "cycles", "cpu-cycles", NULL },
+    { "L1d-loads", "L1d-read", NULL },
+    { "L1d-load-misses", "L1d-read-misses", NULL },
+    { "L1d-stores", "L1d-write", NULL },
+    { "L1d-store-misses", "L1d-write-misses", NULL },
+    { "L1i-loads", "L1i-read", NULL },
+    { "L1i-load-misses", "L1i-read-misses", NULL },
+    { "LLC-loads", "LLC-read", NULL },
+    { "LLC-load-misses", "LLC-read-misses", NULL },
+    { "LLC-stores", "LLC-write", NULL },
+    { "LLC-store-misses", "LLC-write-misses", NULL },
+};
+
+
+
+/*==============================================================================
+ * Parser
+ *============================================================================*/
+
+typedef struct {
+    yy_metric *metric;
+    const char *cur;
+    u32 depth; /* current stack depth */
+    u32 nest; /* parentheses and unary sign nesting */
+} metric_parser;
+
+static bool metric_push(metric_parser *p, metric_op_type type,
+                        f64 num, const char *var, usize var_len) {
+    yy_metric *m = p->metric;
+    if (m->op_count >= m->op_capacity) {
+        u32 capacity = m->op_capacity ? m->op_capacity * 2 : 16;
+        metric_op *ops = realloc(m->ops, capacity * sizeof(metric_op));
+        if (!ops) return false;
+        m->ops = ops;
+        m->op_capacity = capacity;
+    }
+    metric_op *op = m->ops + m->op_count;
+    op->type = type;
+    op->num = num;
+    op->var = NULL;
+    if (var) {
+        char *str = malloc(var_len + 1);
+        if (!str) return false;
+        memcpy(str, var, var_len);
+        str[var_len] = '\0';
+        op->var = str;
+    }
+    m->op_count++;
+
+    /* track the stack depth: operands push one, binary operators pop one */
+    if (type == METRIC_OP_NUM || type == METRIC_OP_VAR) {
+        p->depth++;
+        if (p->depth > m->stack_size) m->stack_size = p->depth;
+    } else if (type != METRIC_OP_NEG) {
+        p->depth--;
+    }
+    return true;
+}
+
+static void metric_skip_space(metric_parser *p) {
+    while (*p->cur == ' ' || *p->cur == '\t' ||
+           *p->cur == '\n' || *p->cur == '\r') p->cur++;
+}
+
+static bool metric_is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool metric_is_name_char(char c) {
+    return metric_is_name_start(c) || (c >= '0' && c <= '9') ||
+           c == '.' || c == ':';
+}
+
+static bool metric_parse_expr(metric_parser *p);
+
+/* primary := number | name | '(' expr ')' | ('-' | '+') primary */
+static bool metric_parse_unary(metric_parser *p) {
+    metric_skip_space(p);
+    char c = *p->cur;
+    if (c == '-' || c == '+') {
+        if (++p->nest > METRIC_MAX_DEPTH) return false;
+        p->cur++;
+        if (!metric_parse_unary(p)) return false;
+        p->nest--;
+        if (c == '+') return true;
+        return metric_push(p, METRIC_OP_NEG, 0, NULL, 0);
+    }
+    if (c == '(') {
+        if (++p->nest > METRIC_MAX_DEPTH) return false;
+        p->cur++;
+        if (!metric_parse_expr(p)) return false;
+        metric_skip_space(p);
+        if (*p->cur != ')') return false;
+        p->cur++;
+        p->nest--;
+        return true;
+    }
+    if ((c >= '0' && c <= '9') || c == '.') {
+        char *end;
+        f64 num = strtod(p->cur, &end);
+        if (end == p->cur) return false;
+        p->cur = end;
+        return metric_push(p, METRIC_OP_NUM, num, NULL, 0);
+    }
+    if (metric_is_name_start(c)) {
+        /* a '-' between name chars is part of the name: "branch-misses" */
+        const char *start = p->cur;
+        while (metric_is_name_char(*p->cur) ||
+               (*p->cur == '-' && metric_is_name_char(p->cur[1]))) p->cur++;
+        return metric_push(p, METRIC_OP_VAR, 0, start, (usize)(p->cur - start));
+    }
+    return false;
+}
+
+/* term := unary (('*' | '/') unary)* */
+static bool metric_parse_term(metric_parser *p) {
+    if (!metric_parse_unary(p)) return false;
+    while (true) {
+        metric_skip_space(p);
+        char c = *p->cur;
+        if (c != '*' && c != '/') return true;
+        p->cur++;
+        if (!metric_parse_unary(p)) return false;
+        if (!metric_push(p, c == '*' ? METRIC_OP_MUL : METRIC_OP_DIV, 0, NULL, 0)) return false;
+    }
+}
+
+/* expr := term (('+' | '-') term)* */
+static bool metric_parse_expr(metric_parser *p) {
+    if (!metric_parse_term(p)) return false;
+    while (true) {
+        metric_skip_space(p);
+        char c = *p->cur;
+        if (c != '+' && c != '-') return true;
+        p->cur++;
+        if (!metric_parse_term(p)) return false;
+        if (!metric_push(p, c == '+' ? METRIC_OP_ADD : METRIC_OP_SUB, 0, NULL, 0)) return false;
+    }
+}
+
+
+
+/*==============================================================================
+ * Metric
+ *============================================================================*/
+
+yy_metric *yy_metric_new(const char *name, const char *expr) {
+    if (!expr) return NULL;
+    yy_metric *m = (yy_metric *)calloc(1, sizeof(yy_metric));
+    if (!m) return NULL;
+    m->expr = yy_str_copy(expr);
+    m->name = yy_str_copy(name ? name : expr);
+    if (!m->expr || !m->name) {
+        yy_metric_free(m);
+        return NULL;
+    }
+
+    metric_parser p = {0};
+    p.metric = m;
+    p.cur = m->expr;
+    bool suc = metric_parse_expr(&p);
+    metric_skip_space(&p);
+    if (!suc || *p.cur != '\0' || p.depth != 1) {
+        yy_metric_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+yy_metric *yy_metric_new_std(yy_metric_std std) {
+    if ((u32)std >= YY_METRIC_STD_COUNT) return NULL;
+    return yy_metric_new(metric_std_names[std], metric_std_exprs[std]);
+}
+
+void yy_metric_free(yy_metric *metric) {
+    if (!metric) return;
+    for (u32 i = 0; i < metric->op_count; i++) {
+        if (metric->ops[i].var) free((void *)metric->ops[i].var);
+    }
+    if (metric->ops) free(metric->ops);
+    if (metric->name) free(metric->name);
+    if (metric->expr) free(metric->expr);
+    free(metric);
+}
+
+const char *yy_metric_get_name(const yy_metric *metric) {
+    return metric ? metric->name : NULL;
+}
+
+const char *yy_metric_get_expr(const yy_metric *metric) {
+    return metric ? metric->expr : NULL;
+}
+
+const char *yy_metric_std_get_name(yy_metric_std std) {
+    return (u32)std < YY_METRIC_STD_COUNT ? metric_std_names[std] : NULL;
+}
+
+const char *yy_metric_std_get_expr(yy_metric_std std) {
+    return (u32)std < YY_METRIC_STD_COUNT ? metric_std_exprs[std] : NULL;
+}
+
+bool yy_metric_ctx_init_with_perf(yy_metric_ctx *ctx, yy_perf *perf,
+                                  f64 ops, f64 bytes) {
+    if (!ctx) return false;
+    memset(ctx, 0, sizeof(yy_metric_ctx));
+    ctx->ops = ops;
+    ctx->bytes = bytes;
+    if (!perf) return false;
+    const u64 *values = yy_perf_get_counters(perf);
+    if (!values) return false;
+    ctx->count = yy_perf_get_event_count(perf);
+    ctx->names = yy_perf_get_event_names(perf);
+    ctx->values = values;
+    return true;
+}
+
+/* Find a value by name, returns false if not found. */
+static bool metric_find_value(const yy_metric_ctx *ctx, const char *name, f64 *val) {
+    if (strcmp(name, "ops") == 0) {
+        *val = ctx->ops;
+        return ctx->ops > 0;
+    }
+    if (strcmp(name, "bytes") == 0) {
+        *val = ctx->bytes;
+        return ctx->bytes > 0;
+    }
+    if (!ctx->names || !ctx->values) return false;
+    for (u32 i = 0; i < ctx->count; i++) {
+        if (ctx->names[i] && strcmp(ctx->names[i], name) == 0) {
+            *val = (f64)ctx->values[i];
+            return true;
+        }
+    }
+    /* try other names of the same event */
+    for (usize a = 0; a < sizeof(metric_aliases) / sizeof(metric_aliases[0]); a++) {
+        const char **group = metric_aliases[a];
+        bool match = false;
+        for (u32 k = 0; k < 3 && group[k] && !match; k++) {
+            match = strcmp(group[k], name) == 0;
+        }
+        if (!match) continue;
+        for (u32 k = 0; k < 3 && group[k]; k++) {
+            for (u32 i = 0; i < ctx->count; i++) {
+                if (ctx->names[i] && strcmp(ctx->names[i], group[k]) == 0) {
+                    *val = (f64)ctx->values[i];
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+f64 yy_metric_eval(const yy_metric *metric, const yy_metric_ctx *ctx) {
+    f64 stack[METRIC_MAX_DEPTH * 2];
+    u32 top = 0;
+
+    if (!metric || !ctx) return NAN;
+    if (metric->stack_size > sizeof(stack) / sizeof(stack[0])) return NAN;
+    for (u32 i = 0; i < metric->op_count; i++) {
+        const metric_op *op = metric->ops + i;
+        f64 a, b;
+        switch (op->type) {
+            case METRIC_OP_NUM:
+                stack[top++] = op->num;
+                break;
+            case METRIC_OP_VAR:
+                if (!metric_find_value(ctx, op->var, &a)) return NAN;
+                stack[top++] = a;
+                break;
+            case METRIC_OP_NEG:
+                stack[top - 1] = -stack[top - 1];
+                break;
+            default:
+                b = stack[--top];
+                a = stack[top - 1];
+                if (op->type == METRIC_OP_ADD) a += b;
+                else if (op->type == METRIC_OP_SUB) a -= b;
+                else if (op->type == METRIC_OP_MUL) a *= b;
+                else if (b == 0) return NAN;
+                else a /= b;
+                stack[top - 1] = a;
+                break;
+        }
+    }
+    return top == 1 ? stack[0] : NAN;
+}
+
+bool yy_metric_report(yy_report *report, const char *title,
+                      const char **names, const yy_metric_ctx *ctxs, u32 count,
+                      yy_metric **metrics, u32 metric_count) {
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+
+    if (!report || !names || !ctxs || !count) return false;
+    if (!metrics || !metric_count) return false;
+    const char **columns = (const char **)calloc(metric_count + 1, sizeof(char *));
+    if (!columns) return false;
+    for (u32 m = 0; m < metric_count; m++) {
+        columns[m] = metrics[m] ? metrics[m]->name : "";
+    }
+
+    yy_chart_options_init(&op);
+    op.title = title ? title : "Metrics";
+    op.type = YY_CHART_TABLE;
+    op.h_axis.categories = columns;
+
+    chart = yy_chart_new();
+    if (!chart) {
+        free(columns);
+        return false;
+    }
+    suc &= yy_chart_set_options(chart, &op);
+    for (u32 i = 0; i < count; i++) {
+        suc &= yy_chart_item_begin(chart, names[i]);
+        for (u32 m = 0; m < metric_count; m++) {
+            f64 val = yy_metric_eval(metrics[m], ctxs + i);
+            suc &= yy_chart_item_add_float(chart, (float)val);
+        }
+        suc &= yy_chart_item_end(chart);
+    }
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    free(columns);
+    return suc;
+}
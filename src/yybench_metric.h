@@ -0,0 +1,134 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_metric_h
+#define yybench_metric_h
+
+#include "yybench_def.h"
+#include "yybench_perf.h"
+#include "yybench_chart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * Derived Metric
+
+ A metric is an arithmetic expression over named counter values, such as
+ "1000 * branch-misses / instructions". It's evaluated with the counter vector
+ of yy_perf (or any named values), so the ratios are defined in one place.
+
+ Expression syntax:
+     numbers:   1000, 0.5, 1e6
+     operators: + - * / and parentheses, with the usual precedence
+     names:     event names, such as "instructions" or "L1d-load-misses",
+                a name may contain '-', so the subtraction should be written
+                with spaces: "slots-issued - slots-retired"
+     variables: "ops" and "bytes", the operation count and byte count of the
+                measured region, set in the context
+ Common aliases are resolved between Linux and Apple event names, such as
+ "cycles" and "cpu-cycles", "L1d-load-misses" and "L1d-read-misses".
+ The result is NaN if a name is not found, or divided by zero.
+
+ Usage:
+
+     // count the events
+     yy_perf_add_event(perf, YY_PERF_EVENT_CYCLES);
+     yy_perf_add_event(perf, YY_PERF_EVENT_INSTRUCTIONS);
+     ...
+     yy_perf_stop_counting(perf);
+
+     // evaluate metrics, the region processed `len` bytes in `n` operations
+     yy_metric_ctx ctx;
+     yy_metric_ctx_init_with_perf(&ctx, perf, n, len);
+     yy_metric *ipc = yy_metric_new_std(YY_METRIC_IPC);
+     yy_metric *cpb = yy_metric_new("cycles/byte", "cycles / bytes");
+     printf("IPC: %.3f, cycles/byte: %.3f\n",
+            yy_metric_eval(ipc, &ctx), yy_metric_eval(cpb, &ctx));
+     yy_metric_free(ipc);
+     yy_metric_free(cpb);
+
+ *============================================================================*/
+
+/** Standard metrics, with the same definition for all users. */
+typedef enum yy_metric_std {
+    YY_METRIC_IPC = 0, /* instructions / cycles */
+    YY_METRIC_CPI, /* cycles / instructions */
+    YY_METRIC_BRANCH_MPKI, /* 1000 * branch-misses / instructions */
+    YY_METRIC_BRANCH_MISS_RATE, /* branch-misses / branches */
+    YY_METRIC_L1D_MISS_RATE, /* L1d-load-misses / L1d-loads */
+    YY_METRIC_LLC_MISS_RATE, /* LLC-load-misses / LLC-loads */
+    YY_METRIC_CYCLES_PER_BYTE, /* cycles / bytes */
+    YY_METRIC_CYCLES_PER_OP, /* cycles / ops */
+    YY_METRIC_INSTRUCTIONS_PER_OP, /* instructions / ops */
+    YY_METRIC_STD_COUNT
+} yy_metric_std;
+
+/** A compiled metric expression. */
+typedef struct yy_metric yy_metric;
+
+/** Values to evaluate metrics with. */
+typedef struct yy_metric_ctx {
+    u32 count; /* value count */
+    const char **names; /* value names, such as yy_perf_get_event_names() */
+    const u64 *values; /* values, such as yy_perf_get_counters() */
+    f64 ops; /* operation count of the measured region, 0 if unknown */
+    f64 bytes; /* byte count of the measured region, 0 if unknown */
+} yy_metric_ctx;
+
+/** Compile a metric expression.
+    @param name The metric name, such as "IPC", NULL to use the expression.
+    @param expr The expression.
+    @return NULL on syntax error. */
+yy_metric *yy_metric_new(const char *name, const char *expr);
+
+/** Creates a standard metric. */
+yy_metric *yy_metric_new_std(yy_metric_std std);
+
+/** Free the metric. */
+void yy_metric_free(yy_metric *metric);
+
+/** Get the metric name. */
+const char *yy_metric_get_name(const yy_metric *metric);
+
+/** Get the expression of the metric. */
+const char *yy_metric_get_expr(const yy_metric *metric);
+
+/** Get the name of a standard metric, such as "IPC". */
+const char *yy_metric_std_get_name(yy_metric_std std);
+
+/** Get the expression of a standard metric, such as "instructions / cycles". */
+const char *yy_metric_std_get_expr(yy_metric_std std);
+
+/** Init a context with the current counters of perf
+    (it reads the counters with yy_perf_get_counters()).
+    @param ops The operation count of the measured region, 0 if unknown.
+    @param bytes The byte count of the measured region, 0 if unknown.
+    @return false if the counters are not available. */
+bool yy_metric_ctx_init_with_perf(yy_metric_ctx *ctx, yy_perf *perf,
+                                  f64 ops, f64 bytes);
+
+/** Evaluate the metric, returns NaN if it cannot be evaluated. */
+f64 yy_metric_eval(const yy_metric *metric, const yy_metric_ctx *ctx);
+
+/** Add a table of metrics to report, one row for each context.
+    @param title The table title, or NULL to use the default.
+    @param names The row names, such as the benchmark names.
+    @param ctxs The contexts of each row.
+    @param count The row count.
+    @param metrics The metrics (columns).
+    @param metric_count The metric count. */
+bool yy_metric_report(yy_report *report, const char *title,
+                      const char **names, const yy_metric_ctx *ctxs, u32 count,
+                      yy_metric **metrics, u32 metric_count);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
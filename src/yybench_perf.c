@@ -4,6 +4,11 @@
  *============================================================================*/
 
 #include "yybench_perf.h"
+#include "yybench_cpu.h"
+#include "yybench_topo.h"
+#include "yybench_time.h"
+#include "yybench_str.h"
+#include "yybench_sym.h"
 #include <stdio.h>
 
 
@@ -13,19 +18,73 @@
 
 #if YY_LINUX_HAS_PERF
 
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define PERF_TOPDOWN_NONE 0
+#define PERF_TOPDOWN_SLOTS 1 /* topdown-total-slots, topdown-slots-issued... */
+#define PERF_TOPDOWN_METRICS 2 /* slots, topdown-retiring... (Ice Lake+) */
+#define PERF_TOPDOWN_EVENT_COUNT 5
+
+/* Full config of an event, the event value only holds 32-bit config. */
+typedef struct {
+    u64 config;
+    u64 config1;
+    u64 config2;
+    char *name; /* owned name of the event, or NULL */
+    bool no_exclude; /* the PMU rejects exclude_kernel/hv, such as msr */
+} perf_event_ext;
+
 struct yy_perf {
     u32 count;
     u32 capacity;
     u64 *events;
+    perf_event_ext *exts; /* full config of each event */
     const char **names;
     u64 *buffer;
     u64 *ids;
     u64 *counters;
+    int *fds;
+    u32 *groups; /* group index of each event, set by the scheduler */
+    u32 group_count; /* 0 if the events are not scheduled yet */
+    u32 max_group_size; /* 0 to detect by hardware */
+    int anchor; /* anchor event of the scheduled groups, -1 if none */
+    u64 time_enabled;
+    u64 time_running;
+    f64 scheduled_ratio; /* min running ratio of the scheduled groups */
+    struct perf_event_mmap_page **pages; /* mmap'd page of each event */
+    u64 *snap_begin; /* raw values at start (user read mode) */
+    u64 *snap_end; /* raw values at stop (user read mode) */
+    u64 snap_begin_enabled, snap_begin_running;
+    u64 snap_end_enabled, snap_end_running;
     int fd;
     bool is_opened;
     bool is_counting;
+    bool is_scheduled; /* counters are merged from scheduled groups */
+    bool user_read_enabled; /* allow user space read, default is true */
+    bool is_user_read; /* counters are read in user space */
+    int *tids; /* counted threads (or cgroup fd), NULL for the calling thread */
+    int *cpus; /* cpu of each counted thread, NULL for any cpu */
+    u32 thread_count;
+    unsigned long target_flags; /* perf_event_open() flags of the targets */
+    int cgroup_fd; /* opened by yy_perf_open_cgroup(), or -1 */
+    int *thread_fds; /* fds of each thread group: [thread][event] */
+    u64 *thread_ids; /* ids of each thread group: [thread][event] */
+    u64 *thread_counters; /* counters of each thread: [thread][event] */
+    bool inherit; /* count child threads created after open */
+    bool is_attached; /* targets and inherit are set by open_pid/open_cgroup */
+    bool saved_inherit; /* inherit before attached, restored on close */
+    u32 topdown_kind; /* PERF_TOPDOWN_XXX */
+    u32 topdown_idx; /* index of the first topdown event */
+    f64 topdown_scale[PERF_TOPDOWN_EVENT_COUNT]; /* scale of each topdown event */
+    bool no_group_read; /* inherit without PERF_FORMAT_GROUP (old kernel) */
 };
 
+/* read() layout of a group: [count, time_enabled, time_running, value, id, ...] */
+#define PERF_READ_HEADER_SIZE 3
+#define PERF_READ_BUFFER_SIZE(count) (PERF_READ_HEADER_SIZE + (count) * 2)
+
 static const char *perf_event_get_name(u64 event) {
     // see <linux/perf_event.h>
     u32 type = PERF_EVENT_GET_TYPE(event);
@@ -149,52 +208,128 @@ static u64 perf_event_conv(yy_perf_event ev) {
             return PERF_EVENT_MAKE_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_RESULT_ACCESS);
         case YY_PERF_EVENT_LLC_STORE_MISSES:
             return PERF_EVENT_MAKE_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_RESULT_MISS);
+        case YY_PERF_EVENT_TASK_CLOCK:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        case YY_PERF_EVENT_PAGE_FAULTS:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+        case YY_PERF_EVENT_PAGE_FAULTS_MINOR:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN);
+        case YY_PERF_EVENT_PAGE_FAULTS_MAJOR:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ);
+        case YY_PERF_EVENT_CONTEXT_SWITCHES:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+        case YY_PERF_EVENT_CPU_MIGRATIONS:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+        case YY_PERF_EVENT_ALIGNMENT_FAULTS:
+            return PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS);
         default: return 0;
     }
 }
 
 static bool perf_capacity_grow(yy_perf *perf, u32 capacity) {
     u64 *events = NULL;
+    perf_event_ext *exts = NULL;
     const char **names = NULL;
     u64 *buffer = NULL;
     u64 *ids = NULL;
     u64 *counters = NULL;
+    int *fds = NULL;
+    u32 *groups = NULL;
+    struct perf_event_mmap_page **pages = NULL;
+    u64 *snap_begin = NULL;
+    u64 *snap_end = NULL;
 
     events = calloc(capacity, sizeof(u64));
     if (!events) goto fail;
+    exts = calloc(capacity, sizeof(perf_event_ext));
+    if (!exts) goto fail;
     names = calloc(capacity, sizeof(char *));
     if (!names) goto fail;
-    buffer = calloc((capacity + 1) * 2, sizeof(u64));
+    buffer = calloc(PERF_READ_BUFFER_SIZE(capacity), sizeof(u64));
     if (!buffer) goto fail;
     ids = calloc(capacity, sizeof(u64));
     if (!ids) goto fail;
     counters = calloc(capacity, sizeof(u64));
     if (!counters) goto fail;
+    fds = calloc(capacity, sizeof(int));
+    if (!fds) goto fail;
+    groups = calloc(capacity, sizeof(u32));
+    if (!groups) goto fail;
+    pages = calloc(capacity, sizeof(struct perf_event_mmap_page *));
+    if (!pages) goto fail;
+    snap_begin = calloc(capacity, sizeof(u64));
+    if (!snap_begin) goto fail;
+    snap_end = calloc(capacity, sizeof(u64));
+    if (!snap_end) goto fail;
     if (perf->count) {
         memcpy(events, perf->events, perf->count * sizeof(u64));
+        memcpy(exts, perf->exts, perf->count * sizeof(perf_event_ext));
         memcpy(names, perf->names, perf->count * sizeof(char *));
-        memcpy(buffer, perf->buffer, (perf->count + 1) * 2 * sizeof(u64));
+        memcpy(buffer, perf->buffer, PERF_READ_BUFFER_SIZE(perf->count) * sizeof(u64));
+        memcpy(ids, perf->ids, perf->count * sizeof(u64));
         memcpy(counters, perf->counters, perf->count * sizeof(u64));
-        free(perf->events);
-        free(perf->names);
-        free(perf->buffer);
-        free(perf->ids);
-        free(perf->counters);
+        memcpy(fds, perf->fds, perf->count * sizeof(int));
+        memcpy(groups, perf->groups, perf->count * sizeof(u32));
     }
+    /* pages and snapshots are only used after open, no need to copy */
+    if (perf->events) free(perf->events);
+    if (perf->exts) free(perf->exts);
+    if (perf->names) free(perf->names);
+    if (perf->buffer) free(perf->buffer);
+    if (perf->ids) free(perf->ids);
+    if (perf->counters) free(perf->counters);
+    if (perf->fds) free(perf->fds);
+    if (perf->groups) free(perf->groups);
+    if (perf->pages) free(perf->pages);
+    if (perf->snap_begin) free(perf->snap_begin);
+    if (perf->snap_end) free(perf->snap_end);
     perf->events = events;
+    perf->exts = exts;
     perf->names = names;
     perf->buffer = buffer;
     perf->ids = ids;
     perf->counters = counters;
+    perf->fds = fds;
+    perf->groups = groups;
+    perf->pages = pages;
+    perf->snap_begin = snap_begin;
+    perf->snap_end = snap_end;
     perf->capacity = capacity;
     return true;
 
 fail:
     if (events) free(events);
+    if (exts) free(exts);
     if (names) free(names);
     if (buffer) free(buffer);
     if (ids) free(ids);
     if (counters) free(counters);
+    if (fds) free(fds);
+    if (groups) free(groups);
+    if (pages) free(pages);
+    if (snap_begin) free(snap_begin);
+    if (snap_end) free(snap_end);
+    return false;
+}
+
+/* Whether an event with full config can be opened with the same exclusion
+   flags as perf_open_group(). */
+static bool perf_open_test_ext(u32 type, const perf_event_ext *ext) {
+    struct perf_event_attr pe = {0};
+    pe.type = type;
+    pe.config = ext->config;
+    pe.config1 = ext->config1;
+    pe.config2 = ext->config2;
+    pe.exclude_kernel = type != PERF_TYPE_SOFTWARE && !ext->no_exclude;
+    pe.exclude_hv = !ext->no_exclude;
+    pe.size = sizeof(struct perf_event_attr);
+    pe.disabled = 1;
+    int fd = yy_perf_event_open(&pe, 0, -1, -1, 0);
+    if (fd == -1) {
+        return false;
+    }
+    close(fd);
+    return true;
 }
 
 bool perf_open_test(u64 ev) {
@@ -211,37 +346,71 @@ bool perf_open_test(u64 ev) {
     return true;
 }
 
+static bool perf_software_only = false;
+
 bool yy_perf_load(bool print_message_on_error) {
     static bool loaded = false;
     if (loaded) return true;
 
-    if (!perf_open_test(PERF_EVENT_MAKE(PERF_TYPE_HARDWARE, YY_PERF_EVENT_CYCLES))) {
+    if (!perf_open_test(PERF_EVENT_MAKE(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES))) {
+        if (!perf_open_test(PERF_EVENT_MAKE(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK))) {
+            if (print_message_on_error) {
+                fprintf(stderr, "Cannot open perf event, this requires root privileges.\n");
+            }
+            return false;
+        }
         if (print_message_on_error) {
-            fprintf(stderr, "Cannot open perf event, this requires root privileges.\n");
+            fprintf(stderr, "Cannot open hardware perf event, only software events are available.\n");
             fprintf(stderr, "If it runs on a VM, virtual CPU performance counters should be enabled.\n");
         }
-        return false;
+        perf_software_only = true;
     }
 
     loaded = true;
     return true;
 }
 
+bool yy_perf_is_software_only(void) {
+    return perf_software_only;
+}
+
 yy_perf *yy_perf_new(void) {
     yy_perf *perf = (yy_perf *)calloc(1, sizeof(yy_perf));
     if (!perf) return NULL;
-    if (!perf_capacity_grow(perf, 8)) return false;
+    if (!perf_capacity_grow(perf, 8)) {
+        free(perf);
+        return NULL;
+    }
+    perf->user_read_enabled = true;
+    perf->cgroup_fd = -1;
     return perf;
 }
 
+/* Free the owned event names. */
+static void perf_free_event_names(yy_perf *perf) {
+    for (u32 i = 0; i < perf->count; i++) {
+        if (perf->exts[i].name) free(perf->exts[i].name);
+        perf->exts[i].name = NULL;
+    }
+}
+
 void yy_perf_free(yy_perf *perf) {
     if (!perf) return;
     yy_perf_close(perf);
+    if (perf->exts) perf_free_event_names(perf);
     if (perf->events) free(perf->events);
+    if (perf->exts) free(perf->exts);
     if (perf->names) free(perf->names);
     if (perf->buffer) free(perf->buffer);
     if (perf->ids) free(perf->ids);
     if (perf->counters) free(perf->counters);
+    if (perf->fds) free(perf->fds);
+    if (perf->groups) free(perf->groups);
+    if (perf->pages) free(perf->pages);
+    if (perf->snap_begin) free(perf->snap_begin);
+    if (perf->snap_end) free(perf->snap_end);
+    if (perf->tids) free(perf->tids);
+    if (perf->cpus) free(perf->cpus);
     memset(perf, 0, sizeof(yy_perf));
     free(perf);
 }
@@ -254,7 +423,11 @@ bool yy_perf_add_event(yy_perf *perf, yy_perf_event event) {
 bool yy_perf_remove_all_events(yy_perf *perf) {
     if (!perf) return false;
     if (perf->is_opened || perf->is_counting) return false;
+    perf_free_event_names(perf);
     perf->count = 0;
+    perf->group_count = 0;
+    perf->is_scheduled = false;
+    perf->topdown_kind = PERF_TOPDOWN_NONE;
     return true;
 }
 
@@ -271,11 +444,8 @@ bool yy_perf_event_available_apple(yy_perf *perf, const char *ev_name) {
     return false;
 }
 
-bool yy_perf_add_event_linux(yy_perf *perf, u64 ev_value, const char *ev_alias) {
-    if (!perf) return false;
-    if (perf->is_opened || perf->is_counting) return false;
-    if (!yy_perf_event_available_linux(perf, ev_value)) return false;
-
+/* Append an event without availability test. */
+static bool perf_append_event(yy_perf *perf, u64 ev_value, const char *ev_alias) {
     if (perf->count >= perf->capacity) {
         if (!perf_capacity_grow(perf, perf->capacity * 2)) {
             return false;
@@ -283,11 +453,22 @@ bool yy_perf_add_event_linux(yy_perf *perf, u64 ev_value, const char *ev_alias)
     }
 
     perf->events[perf->count] = ev_value;
+    memset(perf->exts + perf->count, 0, sizeof(perf_event_ext));
+    perf->exts[perf->count].config = PERF_EVENT_GET_CONFIG(ev_value);
     perf->names[perf->count] = ev_alias ? ev_alias : perf_event_get_name(ev_value);
     perf->count++;
+    perf->group_count = 0;
+    perf->is_scheduled = false;
     return true;
 }
 
+bool yy_perf_add_event_linux(yy_perf *perf, u64 ev_value, const char *ev_alias) {
+    if (!perf) return false;
+    if (perf->is_opened || perf->is_counting) return false;
+    if (!yy_perf_event_available_linux(perf, ev_value)) return false;
+    return perf_append_event(perf, ev_value, ev_alias);
+}
+
 bool yy_perf_event_available_linux(yy_perf *perf, u64 ev_value) {
     return perf_open_test(ev_value);
 }
@@ -302,44 +483,364 @@ const char **yy_perf_get_event_names(yy_perf *perf) {
     return perf->names;
 }
 
-bool yy_perf_open(yy_perf *perf) {
-    if (!perf) return false;
-    if (perf->count == 0) return false;
-    if (perf->is_opened) return true;
+/* Index of the i-th event, idxs can be NULL for all events. */
+#define PERF_IDX(idxs, i) ((idxs) ? (idxs)[i] : (i))
 
+/* Open the events (index array, NULL for all events) as a group for the
+   target (pid 0 and cpu -1 for the calling thread on any CPU), the fds and
+   ids are stored to fds[idx] and ids[idx]. Returns the group leader fd, or -1. */
+static int perf_open_group(yy_perf *perf, const u32 *idxs, u32 n,
+                           pid_t pid, int cpu, unsigned long flags,
+                           int *fds, u64 *ids) {
     struct perf_event_attr pe = {0};
     int ret = 0;
     int fd = 0;
-    pid_t pid = 0; // calling process
-    int cpu = -1; // any CPU
     int group = -1; // no group
-    unsigned long long flags = 0; // no flag
 
     pe.size = sizeof(struct perf_event_attr);
     pe.disabled = 1;
-    pe.exclude_kernel = 1;
-    pe.exclude_hv = 1;
-    pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
-
-    perf->fd = -1;
-    for (u32 i = 0; i < perf->count; i++) {
-        u64 ev = perf->events[i];
+    pe.inherit = perf->inherit;
+    pe.read_format = PERF_FORMAT_ID |
+                     PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    if (!perf->no_group_read) pe.read_format |= PERF_FORMAT_GROUP;
+
+    for (u32 i = 0; i < n; i++) {
+        u32 idx = PERF_IDX(idxs, i);
+        u64 ev = perf->events[idx];
         pe.type = PERF_EVENT_GET_TYPE(ev);
-        pe.config = PERF_EVENT_GET_CONFIG(ev);
+        pe.config = perf->exts[idx].config;
+        pe.config1 = perf->exts[idx].config1;
+        pe.config2 = perf->exts[idx].config2;
+        /* software events such as context switches are counted in kernel */
+        pe.exclude_kernel = pe.type != PERF_TYPE_SOFTWARE && !perf->exts[idx].no_exclude;
+        pe.exclude_hv = !perf->exts[idx].no_exclude;
         fd = yy_perf_event_open(&pe, pid, cpu, group, flags);
+        if (fd == -1 && i == 0 && perf->inherit && !perf->no_group_read &&
+            errno == EINVAL) {
+            /* old kernels reject inherit with PERF_FORMAT_GROUP,
+               the members are read one by one */
+            perf->no_group_read = true;
+            pe.read_format &= ~(u64)PERF_FORMAT_GROUP;
+            fd = yy_perf_event_open(&pe, pid, cpu, group, flags);
+        }
+        fds[idx] = fd;
+        if (fd != -1) ret = ioctl(fd, PERF_EVENT_IOC_ID, &ids[idx]);
+        if (fd == -1 || ret == -1) {
+            if (fd != -1) close(fd);
+            while (i-- > 0) close(fds[PERF_IDX(idxs, i)]);
+            return -1;
+        }
+        if (group == -1) group = fd; // add to same group
+    }
+    return group;
+}
+
+static void perf_close_group(const int *fds, const u32 *idxs, u32 n) {
+    /* close members before the leader */
+    for (u32 i = n; i-- > 0;) close(fds[PERF_IDX(idxs, i)]);
+}
+
+/* Read the group members one by one, layout: [value, time_enabled,
+   time_running, id], used when PERF_FORMAT_GROUP is not available. */
+static bool perf_read_members(yy_perf *perf, const int *fds, const u64 *ids,
+                              const u32 *idxs, u32 n) {
+    u64 *buf = perf->buffer;
+    buf[0] = n;
+    for (u32 i = 0; i < n; i++) {
+        u64 one[4];
+        u32 idx = PERF_IDX(idxs, i);
+        if (read(fds[idx], one, sizeof(one)) == -1) return false;
+        if (i == 0) {
+            buf[1] = one[1];
+            buf[2] = one[2];
+        }
+        buf[PERF_READ_HEADER_SIZE + i * 2] = one[0];
+        buf[PERF_READ_HEADER_SIZE + i * 2 + 1] = ids[idx];
+    }
+    return true;
+}
+
+/* Read a group (index array, NULL for all events) into vals[idx].
+   If scale is true, the values are scaled if the group was multiplexed.
+   Returns false on error. */
+static bool perf_read_group(yy_perf *perf, const int *fds, const u64 *ids,
+                            const u32 *idxs, u32 n, u64 *vals, bool scale,
+                            u64 *enabled_out, u64 *running_out) {
+    // read counter data
+    if (perf->no_group_read) {
+        if (!perf_read_members(perf, fds, ids, idxs, n)) return false;
+    } else {
+        usize size = PERF_READ_BUFFER_SIZE(n) * sizeof(u64);
+        if (read(fds[PERF_IDX(idxs, 0)], perf->buffer, size) == -1) return false;
+    }
+    
+    // the group was multiplexed if it ran for only part of the enabled time,
+    // the raw value is scaled to an estimate of the full enabled time
+    u64 nr = perf->buffer[0];
+    u64 enabled = perf->buffer[1];
+    u64 running = perf->buffer[2];
+    if (enabled_out) *enabled_out = enabled;
+    if (running_out) *running_out = running;
+    for (u32 i = 0; i < n; i++) vals[PERF_IDX(idxs, i)] = 0;
+    for (u64 k = 0; k < nr && k < n; k++) {
+        u64 val = perf->buffer[PERF_READ_HEADER_SIZE + k * 2];
+        u64 id = perf->buffer[PERF_READ_HEADER_SIZE + k * 2 + 1];
+        if (scale) {
+            if (running == 0) val = 0;
+            else if (running < enabled) val = (u64)((f64)val * (f64)enabled / (f64)running);
+        }
+        /* the values are in the order of group members */
+        u32 idx = PERF_IDX(idxs, k);
+        if (ids[idx] != id) {
+            for (u32 i = 0; i < n; i++) {
+                if (ids[PERF_IDX(idxs, i)] == id) {
+                    idx = PERF_IDX(idxs, i);
+                    break;
+                }
+            }
+        }
+        vals[idx] = val;
+    }
+    return true;
+}
+
+/*
+ User space counter read (x86 only): the kernel exports the counter index and
+ offset in a mmap'd page of each event, the counter is read with `rdpmc`.
+ The page is protected by a seqlock, see `struct perf_event_mmap_page` in
+ <linux/perf_event.h>.
+ */
+
+static void perf_unmap_pages(yy_perf *perf) {
+    usize page_size = (usize)sysconf(_SC_PAGESIZE);
+    for (u32 i = 0; i < perf->count; i++) {
+        if (perf->pages[i]) munmap((void *)perf->pages[i], page_size);
+        perf->pages[i] = NULL;
+    }
+}
+
+/* Map the page of each event, returns true if all counters can be read with
+   rdpmc. The group should be enabled. */
+static bool perf_map_pages(yy_perf *perf) {
+#if (YY_ARCH_X64 || YY_ARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+    usize page_size = (usize)sysconf(_SC_PAGESIZE);
+    bool suc = true;
+    for (u32 i = 0; i < perf->count; i++) {
+        void *page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, perf->fds[i], 0);
+        if (page == MAP_FAILED) {
+            perf->pages[i] = NULL;
+            suc = false;
+            continue;
+        }
+        perf->pages[i] = (struct perf_event_mmap_page *)page;
+        if (!perf->pages[i]->cap_user_rdpmc) suc = false;
+    }
+    if (!suc) perf_unmap_pages(perf);
+    return suc;
+#else
+    return false;
+#endif
+}
+
+#if (YY_ARCH_X64 || YY_ARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+static yy_inline u64 perf_rdpmc(u32 counter) {
+    u32 lo, hi;
+    __asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return (u64)lo | ((u64)hi << 32);
+}
+
+static yy_inline u64 perf_rdtsc(void) {
+    u32 lo, hi;
+    __asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (u64)lo | ((u64)hi << 32);
+}
+#endif
+
+/* Read raw values and group times in user space without syscall.
+   Returns false if any counter is not scheduled on hardware now. */
+static yy_inline bool perf_user_snapshot(yy_perf *perf, u64 *vals,
+                                         u64 *enabled_out, u64 *running_out) {
+#if (YY_ARCH_X64 || YY_ARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+    for (u32 i = 0; i < perf->count; i++) {
+        volatile struct perf_event_mmap_page *pc = perf->pages[i];
+        u32 seq, idx;
+        u64 count, enabled = 0, running = 0;
+        do {
+            seq = pc->lock;
+            __asm volatile("" ::: "memory");
+            idx = pc->index;
+            if (!pc->cap_user_rdpmc || idx == 0) return false;
+            count = (u64)pc->offset;
+            u32 width = pc->pmc_width;
+            i64 pmc = (i64)perf_rdpmc(idx - 1);
+            pmc <<= 64 - width;
+            pmc >>= 64 - width; /* sign extend */
+            count += (u64)pmc;
+            if (i == 0) {
+                /* the members of a group are scheduled together */
+                enabled = pc->time_enabled;
+                running = pc->time_running;
+                if (pc->cap_user_time) {
+                    u16 shift = pc->time_shift;
+                    u32 mult = pc->time_mult;
+                    u64 cyc = perf_rdtsc();
+                    u64 quot = cyc >> shift;
+                    u64 rem = cyc & (((u64)1 << shift) - 1);
+                    u64 delta = pc->time_offset + quot * mult + ((rem * mult) >> shift);
+                    enabled += delta;
+                    running += delta;
+                }
+            }
+            __asm volatile("" ::: "memory");
+        } while (pc->lock != seq);
+        vals[i] = count;
+        if (i == 0) {
+            *enabled_out = enabled;
+            *running_out = running;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Take a snapshot of raw values, with user space read if possible. */
+static yy_inline bool perf_snapshot(yy_perf *perf, u64 *vals,
+                                    u64 *enabled, u64 *running) {
+    if (perf_user_snapshot(perf, vals, enabled, running)) return true;
+    return perf_read_group(perf, perf->fds, perf->ids, NULL, perf->count,
+                           vals, false, enabled, running);
+}
+
+static bool perf_set_targets(yy_perf *perf, const int *tids, const int *cpus,
+                             u32 count, unsigned long flags);
+
+/* Restore the targets and inherit changed by yy_perf_open_pid() or
+   yy_perf_open_cgroup(), so a later yy_perf_open() counts the calling thread. */
+static void perf_detach(yy_perf *perf) {
+    if (perf->cgroup_fd != -1) {
+        close(perf->cgroup_fd);
+        perf->cgroup_fd = -1;
+    }
+    if (perf->is_attached) {
+        perf_set_targets(perf, NULL, NULL, 0, 0);
+        perf->inherit = perf->saved_inherit;
+        perf->is_attached = false;
+    }
+}
+
+/* Apply a group ioctl to the group leader of each target. */
+static bool perf_ioctl_groups(yy_perf *perf, unsigned long request) {
+    if (!perf->thread_count) {
+        return ioctl(perf->fd, request, PERF_IOC_FLAG_GROUP) != -1;
+    }
+    bool suc = true;
+    for (u32 t = 0; t < perf->thread_count; t++) {
+        int leader = perf->thread_fds[t * perf->count];
+        if (ioctl(leader, request, PERF_IOC_FLAG_GROUP) == -1) suc = false;
+    }
+    return suc;
+}
+
+static void perf_free_threads(yy_perf *perf) {
+    if (perf->thread_fds) free(perf->thread_fds);
+    if (perf->thread_ids) free(perf->thread_ids);
+    if (perf->thread_counters) free(perf->thread_counters);
+    perf->thread_fds = NULL;
+    perf->thread_ids = NULL;
+    perf->thread_counters = NULL;
+}
+
+/* Open one group for each target thread. */
+static bool perf_open_threads(yy_perf *perf) {
+    usize total = (usize)perf->thread_count * perf->count;
+    perf->thread_fds = (int *)calloc(total, sizeof(int));
+    perf->thread_ids = (u64 *)calloc(total, sizeof(u64));
+    perf->thread_counters = (u64 *)calloc(total, sizeof(u64));
+    if (!perf->thread_fds || !perf->thread_ids || !perf->thread_counters) {
+        perf_free_threads(perf);
+        return false;
+    }
+    for (u32 t = 0; t < perf->thread_count; t++) {
+        usize ofs = (usize)t * perf->count;
+        int cpu = perf->cpus ? perf->cpus[t] : -1;
+        int fd = perf_open_group(perf, NULL, perf->count, (pid_t)perf->tids[t],
+                                 cpu, perf->target_flags,
+                                 perf->thread_fds + ofs, perf->thread_ids + ofs);
         if (fd == -1) {
-            if (perf->fd != -1) close(perf->fd);
+            while (t-- > 0) {
+                perf_close_group(perf->thread_fds + (usize)t * perf->count,
+                                 NULL, perf->count);
+            }
+            perf_free_threads(perf);
             return false;
         }
-        if (perf->fd == -1) perf->fd = fd;
-        if (group == -1) group = fd; // add to same group
-        ret = ioctl(fd, PERF_EVENT_IOC_ID, &perf->ids[i]);
-        if (ret == -1) {
-            close(perf->fd);
+    }
+    return true;
+}
+
+static void perf_close_threads(yy_perf *perf) {
+    for (u32 t = 0; t < perf->thread_count; t++) {
+        perf_close_group(perf->thread_fds + (usize)t * perf->count,
+                         NULL, perf->count);
+    }
+    perf_free_threads(perf);
+}
+
+/* Read the group of each target thread, the results are summed. */
+static bool perf_read_threads(yy_perf *perf) {
+    u64 sum_enabled = 0, sum_running = 0;
+    memset(perf->counters, 0, perf->count * sizeof(u64));
+    for (u32 t = 0; t < perf->thread_count; t++) {
+        usize ofs = (usize)t * perf->count;
+        u64 *vals = perf->thread_counters + ofs;
+        u64 enabled = 0, running = 0;
+        if (!perf_read_group(perf, perf->thread_fds + ofs, perf->thread_ids + ofs,
+                             NULL, perf->count, vals, true, &enabled, &running)) {
             return false;
         }
+        for (u32 i = 0; i < perf->count; i++) perf->counters[i] += vals[i];
+        sum_enabled += enabled;
+        sum_running += running;
+    }
+    perf->time_enabled = sum_enabled;
+    perf->time_running = sum_running;
+    return true;
+}
+
+bool yy_perf_open(yy_perf *perf) {
+    if (!perf) return false;
+    if (perf->count == 0) return false;
+    if (perf->is_opened) return true;
+
+    perf->is_user_read = false;
+    if (perf->thread_count) {
+        if (!perf_open_threads(perf)) return false;
+        perf->fd = -1;
+    } else {
+        perf->fd = perf_open_group(perf, NULL, perf->count, 0, -1, 0,
+                                   perf->fds, perf->ids);
+        if (perf->fd == -1) return false;
+    }
+    /* rdpmc can only read the counters of the calling thread, the values
+       of inherited child threads are only summed by read(), and the topdown
+       metrics counter is encoded (not a plain counter) */
+    if (perf->user_read_enabled && !perf->thread_count && !perf->inherit &&
+        perf->topdown_kind != PERF_TOPDOWN_METRICS) {
+        /* the group keeps counting after open, start/stop take snapshots */
+        if (ioctl(perf->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != -1) {
+            if (perf_map_pages(perf)) {
+                perf->is_user_read = true;
+            } else {
+                ioctl(perf->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
     }
     memset(perf->counters, 0, perf->count * sizeof(u64));
+    perf->time_enabled = 0;
+    perf->time_running = 0;
+    perf->is_scheduled = false;
     perf->is_opened = true;
     return true;
 }
@@ -348,10 +849,17 @@ bool yy_perf_close(yy_perf *perf) {
     if (!perf) return false;
     if (perf->is_counting) yy_perf_stop_counting(perf);
     if (perf->is_opened) {
-        close(perf->fd);
+        if (perf->is_user_read) {
+            ioctl(perf->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            perf_unmap_pages(perf);
+            perf->is_user_read = false;
+        }
+        if (perf->thread_fds) perf_close_threads(perf);
+        else perf_close_group(perf->fds, NULL, perf->count);
         perf->is_opened = false;
         memset(perf->counters, 0, perf->count * sizeof(u64));
     }
+    perf_detach(perf);
     return true;
 }
 
@@ -359,17 +867,170 @@ bool yy_perf_is_opened(yy_perf *perf) {
     return perf ? perf->is_opened : false;
 }
 
-bool yy_perf_start_counting(yy_perf *perf) {
+bool yy_perf_set_user_read(yy_perf *perf, bool enabled) {
     if (!perf) return false;
-    if (!perf->is_opened) return false;
-    if (perf->is_counting) return true;
+    if (perf->is_opened) return false;
+    perf->user_read_enabled = enabled;
+    return true;
+}
+
+bool yy_perf_is_user_read(yy_perf *perf) {
+    return perf ? perf->is_user_read : false;
+}
+
+/* Set the targets (pid and cpu of each target, cpus can be NULL). */
+static bool perf_set_targets(yy_perf *perf, const int *tids, const int *cpus,
+                             u32 count, unsigned long flags) {
+    int *tids_copy = NULL, *cpus_copy = NULL;
+    if (count) {
+        tids_copy = (int *)malloc(count * sizeof(int));
+        if (cpus) cpus_copy = (int *)malloc(count * sizeof(int));
+        if (!tids_copy || (cpus && !cpus_copy)) {
+            free(tids_copy);
+            free(cpus_copy);
+            return false;
+        }
+        memcpy(tids_copy, tids, count * sizeof(int));
+        if (cpus) memcpy(cpus_copy, cpus, count * sizeof(int));
+    }
+    if (perf->tids) free(perf->tids);
+    if (perf->cpus) free(perf->cpus);
+    perf->tids = tids_copy;
+    perf->cpus = cpus_copy;
+    perf->thread_count = count;
+    perf->target_flags = flags;
+    return true;
+}
+
+bool yy_perf_set_threads(yy_perf *perf, const int *tids, u32 count) {
+    if (!perf) return false;
+    if (perf->is_opened) return false;
+    if (!tids) count = 0;
+    return perf_set_targets(perf, tids, NULL, count, 0);
+}
 
-    if (ioctl(perf->fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1) {
+bool yy_perf_open_pid(yy_perf *perf, int pid) {
+    char path[64];
+    DIR *dir;
+    struct dirent *ent;
+    yy_buf buf;
+    bool suc;
+    
+    if (!perf || pid <= 0) return false;
+    if (perf->is_opened) return false;
+    
+    /* a perf event follows one thread, so each existing thread is counted,
+       and the threads created later are inherited */
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    dir = opendir(path);
+    if (!dir) return false;
+    if (!yy_buf_init(&buf, 0)) {
+        closedir(dir);
         return false;
     }
-    if (ioctl(perf->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1) {
+    suc = true;
+    while ((ent = readdir(dir))) {
+        char *end;
+        long tid = strtol(ent->d_name, &end, 10);
+        if (end == ent->d_name || *end || tid <= 0) continue;
+        int val = (int)tid;
+        suc &= yy_buf_append(&buf, (u8 *)&val, sizeof(int));
+    }
+    closedir(dir);
+    u32 count = (u32)(yy_buf_len(&buf) / sizeof(int));
+    if (suc && count) {
+        suc = perf_set_targets(perf, (int *)buf.hdr, NULL, count, 0);
+    } else {
+        suc = false;
+    }
+    yy_buf_release(&buf);
+    if (!suc) return false;
+    perf->saved_inherit = perf->inherit;
+    perf->is_attached = true;
+    perf->inherit = true;
+    if (yy_perf_open(perf)) return true;
+    perf_detach(perf);
+    return false;
+}
+
+bool yy_perf_open_cgroup(yy_perf *perf, const char *path) {
+    char full[512];
+    int fd, *tids, *cpus;
+    u32 count;
+    bool suc;
+    
+    if (!perf || !path) return false;
+    if (perf->is_opened) return false;
+    
+    fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd == -1 && path[0] != '/') {
+        snprintf(full, sizeof(full), "/sys/fs/cgroup/%s", path);
+        fd = open(full, O_RDONLY | O_DIRECTORY);
+    }
+    if (fd == -1) return false;
+    
+    /* cgroup events are per-cpu, one group is opened for each online cpu */
+    count = yy_topo_get_cpu_count();
+    tids = (int *)malloc((count ? count : 1) * sizeof(int));
+    cpus = (int *)malloc((count ? count : 1) * sizeof(int));
+    suc = tids && cpus && count;
+    for (u32 i = 0; suc && i < count; i++) {
+        tids[i] = fd;
+        cpus[i] = yy_topo_get_cpu(i)->id;
+    }
+    if (suc) suc = perf_set_targets(perf, tids, cpus, count, PERF_FLAG_PID_CGROUP);
+    free(tids);
+    free(cpus);
+    if (!suc) {
+        close(fd);
         return false;
     }
+    /* the targets hold the cgroup fd, it's closed by perf_detach() */
+    perf->saved_inherit = perf->inherit;
+    perf->is_attached = true;
+    perf->cgroup_fd = fd;
+    perf->inherit = false;
+    if (yy_perf_open(perf)) return true;
+    perf_detach(perf);
+    return false;
+}
+
+int yy_perf_get_thread_id(void) {
+    return (int)syscall(__NR_gettid);
+}
+
+u32 yy_perf_get_thread_count(yy_perf *perf) {
+    return perf ? perf->thread_count : 0;
+}
+
+u64 *yy_perf_get_thread_counters(yy_perf *perf, u32 idx) {
+    if (!perf || !perf->thread_counters) return NULL;
+    if (idx >= perf->thread_count) return NULL;
+    return perf->thread_counters + (usize)idx * perf->count;
+}
+
+bool yy_perf_set_inherit(yy_perf *perf, bool inherit) {
+    if (!perf) return false;
+    if (perf->is_opened) return false;
+    perf->inherit = inherit;
+    return true;
+}
+
+bool yy_perf_start_counting(yy_perf *perf) {
+    if (!perf) return false;
+    if (!perf->is_opened) return false;
+    if (perf->is_counting) return true;
+
+    if (perf->is_user_read) {
+        if (!perf_snapshot(perf, perf->snap_begin,
+                           &perf->snap_begin_enabled, &perf->snap_begin_running)) {
+            return false;
+        }
+        perf->is_counting = true;
+        return true;
+    }
+    if (!perf_ioctl_groups(perf, PERF_EVENT_IOC_RESET)) return false;
+    if (!perf_ioctl_groups(perf, PERF_EVENT_IOC_ENABLE)) return false;
     perf->is_counting = true;
     return true;
 }
@@ -379,26 +1040,1022 @@ bool yy_perf_stop_counting(yy_perf *perf) {
     if (!perf->is_counting) return false;
 
     perf->is_counting = false;
-    if (ioctl(perf->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) == -1) return false;
+    if (perf->is_user_read) {
+        return perf_snapshot(perf, perf->snap_end,
+                             &perf->snap_end_enabled, &perf->snap_end_running);
+    }
+    return perf_ioctl_groups(perf, PERF_EVENT_IOC_DISABLE);
+}
+
+bool yy_perf_is_counting(yy_perf *perf) {
+    return perf ? perf->is_counting : false;
+}
+
+u64 *yy_perf_get_counters(yy_perf *perf) {
+    if (!perf) return false;
+    if (!perf->is_opened) return perf->is_scheduled ? perf->counters : NULL;
+
+    if (perf->is_user_read) {
+        if (perf->is_counting) {
+            if (!perf_snapshot(perf, perf->snap_end,
+                               &perf->snap_end_enabled, &perf->snap_end_running)) {
+                return NULL;
+            }
+        }
+        u64 enabled = perf->snap_end_enabled - perf->snap_begin_enabled;
+        u64 running = perf->snap_end_running - perf->snap_begin_running;
+        perf->time_enabled = enabled;
+        perf->time_running = running;
+        for (u32 i = 0; i < perf->count; i++) {
+            u64 val = perf->snap_end[i] - perf->snap_begin[i];
+            if (running && running < enabled) {
+                val = (u64)((f64)val * (f64)enabled / (f64)running);
+            }
+            perf->counters[i] = val;
+        }
+        return perf->counters;
+    }
+
+    if (perf->thread_count) {
+        return perf_read_threads(perf) ? perf->counters : NULL;
+    }
+    bool suc = perf_read_group(perf, perf->fds, perf->ids, NULL, perf->count,
+                               perf->counters, true,
+                               &perf->time_enabled, &perf->time_running);
+    return suc ? perf->counters : NULL;
+}
+
+f64 yy_perf_get_running_ratio(yy_perf *perf) {
+    if (!perf) return 0;
+    if (!perf->is_opened) return perf->is_scheduled ? perf->scheduled_ratio : 0;
+    if (!perf->time_enabled) return 1.0;
+    return (f64)perf->time_running / (f64)perf->time_enabled;
+}
+
+bool yy_perf_set_max_group_size(yy_perf *perf, u32 size) {
+    if (!perf) return false;
+    if (perf->is_opened) return false;
+    perf->max_group_size = size;
+    perf->group_count = 0;
+    return true;
+}
+
+u32 yy_perf_get_group_count(yy_perf *perf) {
+    return perf ? perf->group_count : 0;
+}
+
+/* Whether a group can be scheduled on hardware counters at the same time. */
+static bool perf_group_fits(yy_perf *perf, const u32 *idxs, u32 n) {
+    u64 enabled = 0, running = 0;
+    int fd = perf_open_group(perf, idxs, n, 0, -1, 0, perf->fds, perf->ids);
+    if (fd == -1) return false;
+    bool suc = ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) != -1 &&
+               ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != -1;
+    if (suc) {
+        yy_cpu_spin(0.002);
+        suc = ioctl(fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) != -1 &&
+              perf_read_group(perf, perf->fds, perf->ids, idxs, n,
+                              perf->counters, true, &enabled, &running);
+    }
+    perf_close_group(perf->fds, idxs, n);
+    return suc && enabled > 0 && running == enabled;
+}
+
+/* Whether the event is one of the top-down events. */
+static bool perf_is_topdown(yy_perf *perf, u32 idx) {
+    return perf->topdown_kind != PERF_TOPDOWN_NONE && idx >= perf->topdown_idx &&
+           idx < perf->topdown_idx + PERF_TOPDOWN_EVENT_COUNT;
+}
+
+/* Get the events of a scheduled group: the top-down events first (slots must
+   be the group leader), then the anchor event and others. Returns the count. */
+static u32 perf_group_members(yy_perf *perf, u32 group, int anchor, u32 *idxs) {
+    u32 n = 0;
+    bool has_topdown = perf->topdown_kind != PERF_TOPDOWN_NONE &&
+                       perf->groups[perf->topdown_idx] == group;
+    if (has_topdown) {
+        for (u32 k = 0; k < PERF_TOPDOWN_EVENT_COUNT; k++) {
+            idxs[n++] = perf->topdown_idx + k;
+        }
+    }
+    if (anchor >= 0 && !(has_topdown && perf_is_topdown(perf, (u32)anchor))) {
+        idxs[n++] = (u32)anchor;
+    }
+    for (u32 i = 0; i < perf->count; i++) {
+        if ((int)i == anchor || perf_is_topdown(perf, i)) continue;
+        if (perf->groups[i] == group) idxs[n++] = i;
+    }
+    return n;
+}
+
+/* Split events into groups, the anchor event is in every group, and the
+   top-down events are kept in the first group.
+   Greedy: add events to current group while the group still fits. */
+static bool perf_schedule(yy_perf *perf, int anchor) {
+    u32 *idxs = (u32 *)malloc((perf->count + 1) * sizeof(u32));
+    bool *done = (bool *)calloc(perf->count, sizeof(bool));
+    u32 remain = perf->count;
+    u32 group = 0;
+    if (!idxs || !done) {
+        free(idxs);
+        free(done);
+        return false;
+    }
+    if (anchor >= 0) {
+        done[anchor] = true;
+        perf->groups[anchor] = 0;
+        remain--;
+    }
+    while (remain > 0) {
+        u32 n = 0, added = 0;
+        if (group == 0 && perf->topdown_kind != PERF_TOPDOWN_NONE) {
+            /* the first events are always added, as below */
+            for (u32 k = 0; k < PERF_TOPDOWN_EVENT_COUNT; k++) {
+                u32 i = perf->topdown_idx + k;
+                idxs[n++] = i;
+                perf->groups[i] = group;
+                if (!done[i]) {
+                    done[i] = true;
+                    remain--;
+                    added++;
+                }
+            }
+        }
+        if (anchor >= 0 && !(n && perf_is_topdown(perf, (u32)anchor))) {
+            idxs[n++] = (u32)anchor;
+        }
+        for (u32 i = 0; i < perf->count; i++) {
+            if (done[i]) continue;
+            if (perf->max_group_size && n >= perf->max_group_size && added) break;
+            idxs[n] = i;
+            /* the first event is always added, or it may never be scheduled */
+            if (perf->max_group_size || added == 0 || perf_group_fits(perf, idxs, n + 1)) {
+                n++;
+                added++;
+                done[i] = true;
+                perf->groups[i] = group;
+                remain--;
+            }
+        }
+        group++;
+    }
+    perf->group_count = group ? group : 1;
+    free(idxs);
+    free(done);
+    return true;
+}
+
+bool yy_perf_run_scheduled(yy_perf *perf, int anchor,
+                           yy_perf_run_func func, void *ctx) {
+    if (!perf || !func) return false;
+    if (perf->is_opened || perf->count == 0) return false;
+    if (anchor >= (int)perf->count) return false;
+    if (anchor < 0) anchor = -1;
+    /* a metrics event cannot lead the other groups, only slots can */
+    if (anchor >= 0 && perf->topdown_kind == PERF_TOPDOWN_METRICS &&
+        perf_is_topdown(perf, (u32)anchor) && (u32)anchor != perf->topdown_idx) {
+        return false;
+    }
+
+    if (perf->group_count == 0 || perf->anchor != anchor) {
+        if (!perf_schedule(perf, anchor)) return false;
+        perf->anchor = anchor;
+    }
+
+    u32 *idxs = (u32 *)malloc((perf->count + 1) * sizeof(u32));
+    u64 *anchors = (u64 *)calloc(perf->group_count, sizeof(u64));
+    u64 *values = (u64 *)calloc(perf->count, sizeof(u64));
+    bool suc = idxs && anchors && values;
+    f64 ratio = 1.0;
+
+    for (u32 g = 0; suc && g < perf->group_count; g++) {
+        u64 enabled = 0, running = 0;
+        u32 n = perf_group_members(perf, g, anchor, idxs);
+        int fd = perf_open_group(perf, idxs, n, 0, -1, 0, perf->fds, perf->ids);
+        if (fd == -1) {
+            suc = false;
+            break;
+        }
+        if (ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1 ||
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1) {
+            suc = false;
+        } else {
+            func(ctx);
+            suc = ioctl(fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) != -1 &&
+                  perf_read_group(perf, perf->fds, perf->ids, idxs, n,
+                                  perf->counters, true, &enabled, &running);
+        }
+        perf_close_group(perf->fds, idxs, n);
+        if (!suc) break;
+        f64 r = enabled ? (f64)running / (f64)enabled : 1.0;
+        if (r < ratio) ratio = r;
+        for (u32 i = 0; i < n; i++) values[idxs[i]] = perf->counters[idxs[i]];
+        if (anchor >= 0) anchors[g] = perf->counters[anchor];
+    }
+
+    if (suc) {
+        /* normalize each group to the average anchor value */
+        if (anchor >= 0) {
+            f64 sum = 0;
+            for (u32 g = 0; g < perf->group_count; g++) sum += (f64)anchors[g];
+            f64 avg = sum / perf->group_count;
+            for (u32 i = 0; i < perf->count; i++) {
+                u64 a = anchors[perf->groups[i]];
+                if ((int)i == anchor) values[i] = (u64)avg;
+                else if (a) values[i] = (u64)((f64)values[i] * avg / (f64)a);
+            }
+        }
+        memcpy(perf->counters, values, perf->count * sizeof(u64));
+        perf->scheduled_ratio = ratio;
+        perf->is_scheduled = true;
+    }
+    free(idxs);
+    free(anchors);
+    free(values);
+    return suc;
+}
+
+
+/* Get the model of an Intel family 6 CPU, returns false for other CPUs. */
+static bool perf_cpu_intel_model(u32 *model) {
+#if (YY_ARCH_X64 || YY_ARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+    u32 a, b, c, d;
+    __asm volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(0), "c"(0));
+    if (b != 0x756E6547 || d != 0x49656E69 || c != 0x6C65746E) return false; /* GenuineIntel */
+    __asm volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1), "c"(0));
+    if (((a >> 8) & 0xF) != 6) return false;
+    *model = ((a >> 4) & 0xF) | (((a >> 16) & 0xF) << 4);
     return true;
+#else
+    (void)model;
+    return false;
+#endif
+}
+
+
+/*
+ Sysfs events: each PMU exports its type in
+ /sys/bus/event_source/devices/<pmu>/type, the named events in events/<name>
+ (such as "event=0x3c,umask=0x0") with an optional scale in events/<name>.scale,
+ and the bit fields of each term in format/<term> (such as "config:0-7").
+ */
+
+#define PERF_SYSFS_PATH "/sys/bus/event_source/devices"
+
+/* Root directory of the PMU descriptors, can be a fixture directory. */
+static char perf_sysfs_root[256] = PERF_SYSFS_PATH;
+
+/* Read a small sysfs file into buf (trailing whitespace trimmed). */
+static bool perf_sysfs_read(char *buf, usize size, const char *fmt, ...) {
+    char path[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(path, sizeof(path), fmt, args);
+    va_end(args);
+    
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+    usize len = fread(buf, 1, size - 1, file);
+    fclose(file);
+    while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' ')) len--;
+    buf[len] = '\0';
+    return len > 0;
+}
+
+/* Put a term value into the configs (config, config1, config2) with the
+   format, such as "config:0-7", "config:0-7,24-31" or "config1:0-63".
+   The bits of the field are replaced, so a later term overrides. */
+static bool perf_sysfs_put_term(u64 *configs, const char *format, u64 val) {
+    const char *cur = format;
+    u64 *config;
+    if (strncmp(cur, "config:", 7) == 0) {
+        config = configs;
+        cur += 7;
+    } else if (strncmp(cur, "config1:", 8) == 0) {
+        config = configs + 1;
+        cur += 8;
+    } else if (strncmp(cur, "config2:", 8) == 0) {
+        config = configs + 2;
+        cur += 8;
+    } else {
+        return false;
+    }
+    while (*cur) {
+        char *end;
+        u32 lo = (u32)strtoul(cur, &end, 10), hi = lo;
+        if (end == cur) return false;
+        cur = end;
+        if (*cur == '-') {
+            hi = (u32)strtoul(cur + 1, &end, 10);
+            cur = end;
+        }
+        if (hi < lo || hi >= 64) return false;
+        u32 width = hi - lo + 1;
+        u64 mask = width >= 64 ? ~(u64)0 : (((u64)1 << width) - 1);
+        *config = (*config & ~(mask << lo)) | ((val & mask) << lo);
+        val = width >= 64 ? 0 : val >> width;
+        if (*cur == ',') cur++;
+        else if (*cur) return false;
+    }
+    return true;
+}
+
+/* Get the type of a PMU, returns false if not found. */
+static bool perf_sysfs_pmu_type(const char *pmu, u32 *type) {
+    char buf[32];
+    if (!*pmu || strchr(pmu, '/') || strstr(pmu, "..")) return false;
+    if (!perf_sysfs_read(buf, sizeof(buf), "%s/%s/type", perf_sysfs_root, pmu)) return false;
+    *type = (u32)strtoul(buf, NULL, 10);
+    return true;
+}
+
+/* Whether a PMU exports the named event. */
+static bool perf_sysfs_has_event(const char *pmu, const char *name) {
+    char buf[256];
+    if (!*name || strchr(name, '/') || strstr(name, "..")) return false;
+    return perf_sysfs_read(buf, sizeof(buf), "%s/%s/events/%s", perf_sysfs_root, pmu, name);
+}
+
+/*
+ Common Intel core events that are only defined in perf's JSON tables (not
+ exported in sysfs), with the encoding shared by the big cores since Haswell.
+ Atom cores use other encodings, so they are only used on the listed models,
+ or on the "cpu_core" PMU of a hybrid CPU.
+ */
+static const char *perf_intel_events[][2] = {
+    { "mem_load_retired.l1_hit", "event=0xd1,umask=0x01" },
+    { "mem_load_retired.l2_hit", "event=0xd1,umask=0x02" },
+    { "mem_load_retired.l3_hit", "event=0xd1,umask=0x04" },
+    { "mem_load_retired.l1_miss", "event=0xd1,umask=0x08" },
+    { "mem_load_retired.l2_miss", "event=0xd1,umask=0x10" },
+    { "mem_load_retired.l3_miss", "event=0xd1,umask=0x20" },
+    { "longest_lat_cache.reference", "event=0x2e,umask=0x4f" },
+    { "longest_lat_cache.miss", "event=0x2e,umask=0x41" },
+    { "br_inst_retired.all_branches", "event=0xc4,umask=0x00" },
+    { "br_misp_retired.all_branches", "event=0xc5,umask=0x00" },
+    { "inst_retired.any_p", "event=0xc0,umask=0x00" },
+    { "cpu_clk_unhalted.thread_p", "event=0x3c,umask=0x00" },
+    { "uops_issued.any", "event=0x0e,umask=0x01" }
+};
+static const u8 perf_intel_event_models[] = {
+    0x3C, 0x3F, 0x45, 0x46, /* Haswell */
+    0x3D, 0x47, 0x4F, 0x56, /* Broadwell */
+    0x4E, 0x5E, 0x55, 0x8E, 0x9E, 0xA5, 0xA6, /* Skylake to Comet Lake */
+    0x66, 0x6A, 0x6C, 0x7D, 0x7E, 0xA7, /* Cannon Lake, Ice Lake, Rocket Lake */
+    0x8C, 0x8D, 0x8F, 0xCF, 0xAD, 0xAE /* Tiger Lake, Sapphire Rapids and later */
+};
+
+/* Get the terms of a common event for the core PMU, or NULL if not found. */
+static const char *perf_known_event(const char *pmu, const char *name) {
+    const char *terms = NULL;
+    u32 model;
+    if (strcmp(pmu, "cpu") != 0 && strcmp(pmu, "cpu_core") != 0) return NULL;
+    for (u32 i = 0; i < sizeof(perf_intel_events) / sizeof(perf_intel_events[0]); i++) {
+        if (strcmp(perf_intel_events[i][0], name) == 0) terms = perf_intel_events[i][1];
+    }
+    if (!terms || !perf_cpu_intel_model(&model)) return NULL;
+    if (strcmp(pmu, "cpu_core") == 0) return terms;
+    for (u32 i = 0; i < sizeof(perf_intel_event_models); i++) {
+        if (perf_intel_event_models[i] == model) return terms;
+    }
+    return NULL;
+}
+
+/* Put the terms (modified in place) into configs, such as
+   "event=0x3c,umask=0x0,cmask=1". A term without value is a named event of
+   the PMU (expanded once), or a flag with value 1, such as "inv". */
+static bool perf_sysfs_put_terms(const char *pmu, char *terms, u64 *configs,
+                                 bool expand) {
+    char fmt[64];
+    char *term = terms;
+    while (term && *term) {
+        char *next = strchr(term, ',');
+        if (next) *next++ = '\0';
+        char *eq = strchr(term, '=');
+        u64 val = 1;
+        if (eq) {
+            *eq = '\0';
+            char *end;
+            val = strtoull(eq + 1, &end, 0);
+            if (end == eq + 1 || *end) return false;
+        } else if (expand && perf_sysfs_has_event(pmu, term)) {
+            char buf[256];
+            perf_sysfs_read(buf, sizeof(buf), "%s/%s/events/%s", perf_sysfs_root, pmu, term);
+            if (!perf_sysfs_put_terms(pmu, buf, configs, false)) return false;
+            term = next;
+            continue;
+        } else if (expand && perf_known_event(pmu, term)) {
+            char buf[256];
+            snprintf(buf, sizeof(buf), "%s", perf_known_event(pmu, term));
+            if (!perf_sysfs_put_terms(pmu, buf, configs, false)) return false;
+            term = next;
+            continue;
+        }
+        if (!*term || strchr(term, '/') || strstr(term, "..")) return false;
+        if (!perf_sysfs_read(fmt, sizeof(fmt), "%s/%s/format/%s", perf_sysfs_root, pmu, term)) return false;
+        if (!perf_sysfs_put_term(configs, fmt, val)) return false;
+        term = next;
+    }
+    return true;
+}
+
+/* Get an event exported by a PMU in sysfs, returns 0 if not found or the
+   config doesn't fit in the event value. */
+static u64 perf_sysfs_event(const char *pmu, const char *name, f64 *scale) {
+    char buf[256], fmt[64];
+    u32 type;
+    u64 configs[3] = { 0 };
+    
+    if (scale) *scale = 1.0;
+    if (!perf_sysfs_pmu_type(pmu, &type)) return 0;
+    if (!perf_sysfs_read(buf, sizeof(buf), "%s/%s/events/%s", perf_sysfs_root, pmu, name)) return 0;
+    if (!perf_sysfs_put_terms(pmu, buf, configs, false)) return 0;
+    if (configs[0] > 0xFFFFFFFFu || configs[1] || configs[2]) return 0;
+    if (scale && perf_sysfs_read(fmt, sizeof(fmt), "%s/%s/events/%s.scale", perf_sysfs_root, pmu, name)) {
+        f64 val = strtod(fmt, NULL);
+        if (val > 0) *scale = val;
+    }
+    return PERF_EVENT_MAKE(type, configs[0]);
+}
+
+/* Parse an event name: "pmu/terms/" or an event name exported by a PMU.
+   Returns false if the PMU, event or term is not found. */
+static bool perf_sysfs_parse_name(const char *name, u32 *type, perf_event_ext *ext) {
+    static const char *pmus[] = { "cpu", "cpu_core", "cpu_atom" };
+    char buf[256];
+    u64 configs[3] = { 0 };
+    bool found = false;
+    usize len = strlen(name);
+    if (len == 0 || len >= sizeof(buf)) return false;
+    memcpy(buf, name, len + 1);
+    memset(ext, 0, sizeof(perf_event_ext));
+    
+    char *slash = strchr(buf, '/');
+    if (slash) {
+        /* "cpu/event=0xd1,umask=0x20/", modifiers (":u") are not supported */
+        if (buf[len - 1] != '/' || slash + 1 >= buf + len - 1) return false;
+        *slash = '\0';
+        buf[len - 1] = '\0';
+        const char *pmu = buf;
+        if (!perf_sysfs_pmu_type(pmu, type)) {
+            /* hybrid CPU has "cpu_core" and "cpu_atom" instead of "cpu" */
+            if (strcmp(pmu, "cpu") != 0) return false;
+            pmu = "cpu_core";
+            if (!perf_sysfs_pmu_type(pmu, type)) return false;
+        }
+        found = perf_sysfs_put_terms(pmu, slash + 1, configs, true);
+        goto done;
+    }
+    
+    /* event name without PMU: try the core PMUs first, then all PMUs */
+    for (u32 i = 0; i < sizeof(pmus) / sizeof(pmus[0]); i++) {
+        if ((perf_sysfs_has_event(pmus[i], buf) || perf_known_event(pmus[i], buf)) &&
+            perf_sysfs_pmu_type(pmus[i], type)) {
+            found = perf_sysfs_put_terms(pmus[i], buf, configs, true);
+            goto done;
+        }
+    }
+    DIR *dir = opendir(perf_sysfs_root);
+    if (!dir) return false;
+    struct dirent *ent;
+    while (!found && (ent = readdir(dir))) {
+        if (ent->d_name[0] == '.') continue;
+        if (perf_sysfs_has_event(ent->d_name, buf) && perf_sysfs_pmu_type(ent->d_name, type)) {
+            found = perf_sysfs_put_terms(ent->d_name, buf, configs, true);
+        }
+    }
+    closedir(dir);
+    
+done:
+    ext->config = configs[0];
+    ext->config1 = configs[1];
+    ext->config2 = configs[2];
+    return found;
+}
+
+bool yy_perf_add_event_by_name(yy_perf *perf, const char *ev_name, const char *ev_alias) {
+    u32 type;
+    perf_event_ext ext;
+    
+    if (!perf || !ev_name) return false;
+    if (perf->is_opened || perf->is_counting) return false;
+    if (!perf_sysfs_parse_name(ev_name, &type, &ext)) return false;
+    if (!perf_open_test_ext(type, &ext)) {
+        /* uncore and msr PMUs count all modes only */
+        ext.no_exclude = true;
+        if (!perf_open_test_ext(type, &ext)) return false;
+    }
+    char *name = yy_str_copy(ev_alias ? ev_alias : ev_name);
+    if (!name) return false;
+    if (!perf_append_event(perf, PERF_EVENT_MAKE(type, ext.config), name)) {
+        free(name);
+        return false;
+    }
+    ext.name = name;
+    perf->exts[perf->count - 1] = ext;
+    return true;
+}
+
+bool yy_perf_parse_event_name_linux(const char *ev_name, u32 *type, u64 *configs) {
+    perf_event_ext ext;
+    u32 ev_type;
+    if (!ev_name || !type || !configs) return false;
+    if (!perf_sysfs_parse_name(ev_name, &ev_type, &ext)) return false;
+    *type = ev_type;
+    configs[0] = ext.config;
+    configs[1] = ext.config1;
+    configs[2] = ext.config2;
+    return true;
+}
+
+void yy_perf_set_sysfs_path_linux(const char *path) {
+    snprintf(perf_sysfs_root, sizeof(perf_sysfs_root), "%s",
+             path ? path : PERF_SYSFS_PATH);
+}
+
+bool yy_perf_event_available_by_name(yy_perf *perf, const char *ev_name) {
+    u32 type;
+    perf_event_ext ext;
+    if (!perf || !ev_name) return false;
+    if (!perf_sysfs_parse_name(ev_name, &type, &ext)) return false;
+    if (perf_open_test_ext(type, &ext)) return true;
+    ext.no_exclude = true;
+    return perf_open_test_ext(type, &ext);
+}
+
+/*
+ Whether the raw top-down events can be used on current CPU: Intel family 6,
+ Sandy Bridge to Comet Lake (client and server). Atom and Xeon Phi share the
+ family but not the events, Ice Lake and later use the metrics events.
+ */
+static bool perf_cpu_has_topdown_raw(void) {
+    static const u8 models[] = {
+        0x2A, 0x2D, /* Sandy Bridge */
+        0x3A, 0x3E, /* Ivy Bridge */
+        0x3C, 0x3F, 0x45, 0x46, /* Haswell */
+        0x3D, 0x47, 0x4F, 0x56, /* Broadwell */
+        0x4E, 0x5E, 0x55, /* Skylake */
+        0x8E, 0x9E, /* Kaby Lake, Coffee Lake */
+        0xA5, 0xA6 /* Comet Lake */
+    };
+    u32 model;
+    if (!perf_cpu_intel_model(&model)) return false;
+    for (u32 i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+        if (models[i] == model) return true;
+    }
+    return false;
+}
+
+/*
+ Top-down level-1 events, in the order: total, and 4 events of each kind.
+ 
+ Metrics (Ice Lake and later): the kernel reports each topdown-* event as
+ (slots * fraction), the group leader should be `slots`.
+ 
+ Slots (Sandy Bridge to Skylake): 
+     frontend_bound  = fetch_bubbles / total_slots
+     bad_speculation = (slots_issued - slots_retired + recovery_bubbles) / total_slots
+     retiring        = slots_retired / total_slots
+     backend_bound   = 1 - others
+ If the kernel does not export them, the raw events are used with the same
+ encoding as the kernel (arch/x86/events/intel/core.c), 4-wide pipeline.
+ */
+static const char *perf_topdown_metrics_names[PERF_TOPDOWN_EVENT_COUNT] = {
+    "slots", "topdown-fe-bound", "topdown-bad-spec",
+    "topdown-be-bound", "topdown-retiring"
+};
+static const char *perf_topdown_slots_names[PERF_TOPDOWN_EVENT_COUNT] = {
+    "topdown-total-slots", "topdown-fetch-bubbles", "topdown-slots-issued",
+    "topdown-slots-retired", "topdown-recovery-bubbles"
+};
+static const u32 perf_topdown_slots_raw[PERF_TOPDOWN_EVENT_COUNT] = {
+    0x003C, 0x019C, 0x010E, 0x02C2, 0x0100030D
+};
+static const f64 perf_topdown_slots_raw_scale[PERF_TOPDOWN_EVENT_COUNT] = {
+    4, 1, 1, 1, 4
+};
+
+/* Get the topdown events of current CPU, returns the kind. */
+static u32 perf_topdown_events(u64 *evs, f64 *scales) {
+    const char *pmus[] = { "cpu", "cpu_core" }; /* cpu_core for hybrid CPU */
+    if (perf_software_only) return PERF_TOPDOWN_NONE;
+    for (u32 p = 0; p < sizeof(pmus) / sizeof(pmus[0]); p++) {
+        u32 kinds[2] = { PERF_TOPDOWN_METRICS, PERF_TOPDOWN_SLOTS };
+        const char **names[2] = { perf_topdown_metrics_names, perf_topdown_slots_names };
+        for (u32 k = 0; k < 2; k++) {
+            u32 i;
+            for (i = 0; i < PERF_TOPDOWN_EVENT_COUNT; i++) {
+                evs[i] = perf_sysfs_event(pmus[p], names[k][i], &scales[i]);
+                if (!evs[i]) break;
+            }
+            if (i == PERF_TOPDOWN_EVENT_COUNT) return kinds[k];
+        }
+    }
+    if (perf_cpu_has_topdown_raw()) {
+        for (u32 i = 0; i < PERF_TOPDOWN_EVENT_COUNT; i++) {
+            evs[i] = PERF_EVENT_MAKE(PERF_TYPE_RAW, perf_topdown_slots_raw[i]);
+            scales[i] = perf_topdown_slots_raw_scale[i];
+        }
+        return PERF_TOPDOWN_SLOTS;
+    }
+    return PERF_TOPDOWN_NONE;
+}
+
+bool yy_perf_topdown_available(void) {
+    u64 evs[PERF_TOPDOWN_EVENT_COUNT];
+    f64 scales[PERF_TOPDOWN_EVENT_COUNT];
+    return perf_topdown_events(evs, scales) != PERF_TOPDOWN_NONE;
+}
+
+bool yy_perf_add_topdown_events(yy_perf *perf) {
+    static const char *aliases[PERF_TOPDOWN_EVENT_COUNT] = {
+        "topdown-slots", "topdown-frontend", "topdown-bad-spec",
+        "topdown-backend", "topdown-retiring"
+    };
+    u64 evs[PERF_TOPDOWN_EVENT_COUNT];
+    f64 scales[PERF_TOPDOWN_EVENT_COUNT];
+    u32 ids[PERF_TOPDOWN_EVENT_COUNT];
+    
+    if (!perf) return false;
+    if (perf->is_opened || perf->is_counting) return false;
+    if (perf->topdown_kind != PERF_TOPDOWN_NONE) return false;
+    /* slots must be the group leader (the first event) for the metrics */
+    if (perf->count != 0) return false;
+    u32 kind = perf_topdown_events(evs, scales);
+    if (kind == PERF_TOPDOWN_NONE) return false;
+    
+    /* the metrics events can only be opened in a group with slots leader,
+       so the events are tested as a group */
+    u32 base = perf->count;
+    for (u32 i = 0; i < PERF_TOPDOWN_EVENT_COUNT; i++) {
+        if (!perf_append_event(perf, evs[i], aliases[i])) {
+            perf->count = base;
+            return false;
+        }
+        ids[i] = base + i;
+    }
+    if (perf_open_group(perf, ids, PERF_TOPDOWN_EVENT_COUNT, 0, -1, 0,
+                        perf->fds, perf->ids) == -1) {
+        perf->count = base;
+        return false;
+    }
+    perf_close_group(perf->fds, ids, PERF_TOPDOWN_EVENT_COUNT);
+    
+    perf->topdown_kind = kind;
+    perf->topdown_idx = base;
+    memcpy(perf->topdown_scale, scales, sizeof(scales));
+    return true;
+}
+
+bool yy_perf_get_topdown(yy_perf *perf, yy_perf_topdown *td) {
+    f64 v[PERF_TOPDOWN_EVENT_COUNT];
+    
+    if (!perf || !td) return false;
+    memset(td, 0, sizeof(yy_perf_topdown));
+    if (perf->topdown_kind == PERF_TOPDOWN_NONE) return false;
+    u64 *vals = yy_perf_get_counters(perf);
+    if (!vals) return false;
+    for (u32 i = 0; i < PERF_TOPDOWN_EVENT_COUNT; i++) {
+        v[i] = (f64)vals[perf->topdown_idx + i] * perf->topdown_scale[i];
+    }
+    if (v[0] <= 0) return false;
+    
+    if (perf->topdown_kind == PERF_TOPDOWN_METRICS) {
+        td->frontend_bound = v[1] / v[0];
+        td->bad_speculation = v[2] / v[0];
+        td->backend_bound = v[3] / v[0];
+        td->retiring = v[4] / v[0];
+    } else {
+        td->frontend_bound = v[1] / v[0];
+        td->bad_speculation = (v[2] - v[3] + v[4]) / v[0];
+        td->retiring = v[3] / v[0];
+        td->backend_bound = 1.0 - td->frontend_bound - td->bad_speculation - td->retiring;
+    }
+    
+    /* clamp the noise of multiplexing, and normalize to 1.0 */
+    f64 *parts[4] = { &td->frontend_bound, &td->bad_speculation,
+                      &td->backend_bound, &td->retiring };
+    f64 sum = 0;
+    for (u32 i = 0; i < 4; i++) {
+        if (*parts[i] < 0) *parts[i] = 0;
+        sum += *parts[i];
+    }
+    if (sum <= 0) return false;
+    for (u32 i = 0; i < 4; i++) *parts[i] /= sum;
+    return true;
+}
+
+/*
+ Sampling: the kernel writes a PERF_RECORD_SAMPLE record into the mmap'd ring
+ buffer every `sample_period` events (or `sample_freq` times per second), the
+ records are drained in user space by moving `data_tail` to `data_head`, see
+ `struct perf_event_mmap_page` in <linux/perf_event.h>.
+ */
+
+#define PERF_SAMPLE_PAGES 256 /* ring buffer data pages, should be power of 2 */
+#define PERF_SAMPLE_MAX_STACK 128
+
+struct yy_perf_sampler {
+    int fd;
+    struct perf_event_mmap_page *page; /* header page of the ring buffer */
+    u8 *data; /* data pages of the ring buffer */
+    u64 data_size;
+    usize map_size;
+    bool callchain;
+    bool is_sampling;
+    u64 sample_count;
+    u64 lost_count;
+    u64 *keys; /* address histogram, open addressing, 0 for empty slot */
+    u64 *selfs;
+    u64 *totals;
+    u32 hist_count;
+    u32 hist_capacity;
+    u8 *record; /* a record which wraps around the ring buffer end */
+    u64 frames[PERF_SAMPLE_MAX_STACK]; /* user frames of current sample */
+    yy_perf_sample_func callback;
+    void *ctx;
+    yy_sym *sym; /* symbolizer of the last yy_perf_sampler_get_hot() */
+};
+
+static yy_inline u32 perf_hist_hash(u64 addr) {
+    return (u32)((addr * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static bool perf_hist_grow(yy_perf_sampler *s) {
+    u32 capacity = s->hist_capacity ? s->hist_capacity * 2 : 1024;
+    u64 *keys = (u64 *)calloc(capacity, sizeof(u64));
+    u64 *selfs = (u64 *)calloc(capacity, sizeof(u64));
+    u64 *totals = (u64 *)calloc(capacity, sizeof(u64));
+    if (!keys || !selfs || !totals) {
+        free(keys);
+        free(selfs);
+        free(totals);
+        return false;
+    }
+    for (u32 i = 0; i < s->hist_capacity; i++) {
+        if (!s->keys[i]) continue;
+        u32 j = perf_hist_hash(s->keys[i]) & (capacity - 1);
+        while (keys[j]) j = (j + 1) & (capacity - 1);
+        keys[j] = s->keys[i];
+        selfs[j] = s->selfs[i];
+        totals[j] = s->totals[i];
+    }
+    free(s->keys);
+    free(s->selfs);
+    free(s->totals);
+    s->keys = keys;
+    s->selfs = selfs;
+    s->totals = totals;
+    s->hist_capacity = capacity;
+    return true;
+}
+
+static yy_inline void perf_hist_add(yy_perf_sampler *s, u64 addr,
+                                    u64 self, u64 total) {
+    if (!addr) return;
+    if ((s->hist_count + 1) * 2 > s->hist_capacity && !perf_hist_grow(s)) return;
+    u32 mask = s->hist_capacity - 1;
+    u32 i = perf_hist_hash(addr) & mask;
+    while (s->keys[i] && s->keys[i] != addr) i = (i + 1) & mask;
+    if (!s->keys[i]) {
+        s->keys[i] = addr;
+        s->hist_count++;
+    }
+    s->selfs[i] += self;
+    s->totals[i] += total;
+}
+
+/* record layout: header, ip, pid, tid, [nr, ips[nr]] */
+static void perf_sampler_add_sample(yy_perf_sampler *s, const u8 *rec, u32 size) {
+    const u8 *cur = rec + sizeof(struct perf_event_header);
+    const u8 *end = rec + size;
+    u64 ip;
+    u32 tid, frame_count = 0;
+    
+    if (cur + 16 > end) return;
+    memcpy(&ip, cur, 8);
+    memcpy(&tid, cur + 12, 4);
+    cur += 16;
+    s->sample_count++;
+    perf_hist_add(s, ip, 1, 1);
+    
+    if (s->callchain && cur + 8 <= end) {
+        u64 nr;
+        memcpy(&nr, cur, 8);
+        cur += 8;
+        if (nr > (u64)(end - cur) / 8) nr = (u64)(end - cur) / 8;
+        for (u64 k = 0; k < nr && frame_count < PERF_SAMPLE_MAX_STACK; k++) {
+            u64 frame;
+            memcpy(&frame, cur + k * 8, 8);
+            if (frame >= (u64)PERF_CONTEXT_MAX) continue; /* context marker */
+            s->frames[frame_count++] = frame;
+        }
+        /* the first frame is the sample ip, and a recursive caller is
+           counted once in a sample */
+        for (u32 k = 1; k < frame_count; k++) {
+            u64 frame = s->frames[k];
+            bool dup = frame == ip;
+            for (u32 j = 1; j < k && !dup; j++) dup = s->frames[j] == frame;
+            if (!dup) perf_hist_add(s, frame, 0, 1);
+        }
+    }
+    if (s->callback) {
+        if (!s->callchain) {
+            s->frames[0] = ip;
+            frame_count = 1;
+        }
+        s->callback(s->ctx, tid, ip, s->frames, frame_count);
+    }
+}
+
+yy_perf_sampler *yy_perf_sampler_new(yy_perf_event event, u64 period,
+                                     u32 freq, bool callchain) {
+    struct perf_event_attr pe = {0};
+    usize page_size = (usize)sysconf(_SC_PAGESIZE);
+    u64 ev;
+    
+    if (event == YY_PERF_EVENT_NONE) {
+        event = perf_software_only ? YY_PERF_EVENT_TASK_CLOCK : YY_PERF_EVENT_CYCLES;
+    }
+    ev = perf_event_conv(event);
+    if (!ev) return NULL;
+    
+    yy_perf_sampler *s = (yy_perf_sampler *)calloc(1, sizeof(yy_perf_sampler));
+    if (!s) return NULL;
+    s->fd = -1;
+    s->callchain = callchain;
+    s->record = (u8 *)malloc(65536); /* max record size (u16) */
+    if (!s->record || !perf_hist_grow(s)) goto fail;
+    
+    pe.size = sizeof(struct perf_event_attr);
+    pe.type = PERF_EVENT_GET_TYPE(ev);
+    pe.config = PERF_EVENT_GET_CONFIG(ev);
+    pe.disabled = 1;
+    pe.exclude_kernel = 1; /* only the user space code is symbolized */
+    pe.exclude_hv = 1;
+    if (period) {
+        pe.sample_period = period;
+    } else {
+        pe.freq = 1;
+        pe.sample_freq = freq ? freq : 4000;
+    }
+    pe.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+    if (callchain) {
+        pe.sample_type |= PERF_SAMPLE_CALLCHAIN;
+        pe.exclude_callchain_kernel = 1;
+    }
+    s->fd = yy_perf_event_open(&pe, 0, -1, -1, 0);
+    if (s->fd == -1) goto fail;
+    
+    s->data_size = (u64)PERF_SAMPLE_PAGES * page_size;
+    s->map_size = (PERF_SAMPLE_PAGES + 1) * page_size;
+    void *map = mmap(NULL, s->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (map == MAP_FAILED) goto fail;
+    s->page = (struct perf_event_mmap_page *)map;
+    s->data = (u8 *)map + page_size;
+    return s;
+    
+fail:
+    yy_perf_sampler_free(s);
+    return NULL;
+}
+
+void yy_perf_sampler_free(yy_perf_sampler *s) {
+    if (!s) return;
+    if (s->page) munmap((void *)s->page, s->map_size);
+    if (s->fd != -1) close(s->fd);
+    if (s->keys) free(s->keys);
+    if (s->selfs) free(s->selfs);
+    if (s->totals) free(s->totals);
+    if (s->record) free(s->record);
+    if (s->sym) yy_sym_free(s->sym);
+    free(s);
+}
+
+bool yy_perf_sampler_set_callback(yy_perf_sampler *s,
+                                  yy_perf_sample_func func, void *ctx) {
+    if (!s) return false;
+    s->callback = func;
+    s->ctx = ctx;
+    return true;
+}
+
+bool yy_perf_sampler_start(yy_perf_sampler *s) {
+    if (!s) return false;
+    if (s->is_sampling) return true;
+    if (ioctl(s->fd, PERF_EVENT_IOC_ENABLE, 0) == -1) return false;
+    s->is_sampling = true;
+    return true;
+}
+
+bool yy_perf_sampler_stop(yy_perf_sampler *s) {
+    if (!s) return false;
+    if (!s->is_sampling) return false;
+    s->is_sampling = false;
+    if (ioctl(s->fd, PERF_EVENT_IOC_DISABLE, 0) == -1) return false;
+    yy_perf_sampler_poll(s);
+    return true;
+}
+
+u32 yy_perf_sampler_poll(yy_perf_sampler *s) {
+    if (!s) return 0;
+    u64 begin_count = s->sample_count;
+    u64 head = __atomic_load_n(&s->page->data_head, __ATOMIC_ACQUIRE);
+    u64 tail = s->page->data_tail;
+    u64 mask = s->data_size - 1;
+    
+    while (tail + sizeof(struct perf_event_header) <= head) {
+        struct perf_event_header hdr;
+        u64 ofs = tail & mask;
+        const u8 *rec;
+        if (ofs + sizeof(hdr) <= s->data_size) {
+            memcpy(&hdr, s->data + ofs, sizeof(hdr));
+        } else {
+            usize first = (usize)(s->data_size - ofs);
+            memcpy(&hdr, s->data + ofs, first);
+            memcpy((u8 *)&hdr + first, s->data, sizeof(hdr) - first);
+        }
+        if (hdr.size < sizeof(hdr) || tail + hdr.size > head) break;
+        if (ofs + hdr.size <= s->data_size) {
+            rec = s->data + ofs;
+        } else {
+            usize first = (usize)(s->data_size - ofs);
+            memcpy(s->record, s->data + ofs, first);
+            memcpy(s->record + first, s->data, hdr.size - first);
+            rec = s->record;
+        }
+        if (hdr.type == PERF_RECORD_SAMPLE) {
+            perf_sampler_add_sample(s, rec, hdr.size);
+        } else if (hdr.type == PERF_RECORD_LOST && hdr.size >= sizeof(hdr) + 16) {
+            u64 lost; /* layout: header, id, lost */
+            memcpy(&lost, rec + sizeof(hdr) + 8, 8);
+            s->lost_count += lost;
+        }
+        tail += hdr.size;
+    }
+    __atomic_store_n(&s->page->data_tail, tail, __ATOMIC_RELEASE);
+    return (u32)(s->sample_count - begin_count);
+}
+
+u64 yy_perf_sampler_get_sample_count(yy_perf_sampler *s) {
+    return s ? s->sample_count : 0;
+}
+
+u64 yy_perf_sampler_get_lost_count(yy_perf_sampler *s) {
+    return s ? s->lost_count : 0;
 }
 
-bool yy_perf_is_counting(yy_perf *perf) {
-    return perf ? perf->is_counting : false;
+void yy_perf_sampler_reset(yy_perf_sampler *s) {
+    if (!s) return;
+    yy_perf_sampler_poll(s);
+    memset(s->keys, 0, s->hist_capacity * sizeof(u64));
+    memset(s->selfs, 0, s->hist_capacity * sizeof(u64));
+    memset(s->totals, 0, s->hist_capacity * sizeof(u64));
+    s->hist_count = 0;
+    s->sample_count = 0;
+    s->lost_count = 0;
 }
 
-u64 *yy_perf_get_counters(yy_perf *perf) {
-    if (!perf) return false;
-    if (!perf->is_opened) return false;
+static int perf_hot_cmp(const void *a, const void *b) {
+    const yy_perf_hot *x = (const yy_perf_hot *)a;
+    const yy_perf_hot *y = (const yy_perf_hot *)b;
+    if (x->self != y->self) return x->self > y->self ? -1 : 1;
+    if (x->total != y->total) return x->total > y->total ? -1 : 1;
+    return x->addr < y->addr ? -1 : (x->addr > y->addr ? 1 : 0);
+}
 
-    // read counter data
-    if (read(perf->fd, perf->buffer, (perf->count * 2 + 1) * sizeof(u64)) == -1) return false;
+u32 yy_perf_sampler_get_hot(yy_perf_sampler *s, bool symbolize,
+                            yy_perf_hot **hot) {
+    if (!hot) return 0;
+    *hot = NULL;
+    if (!s || !s->hist_count) return 0;
     
-    // data layout: [count, val1, id1, val2, id2, ...]
-    for (u32 i = 0; i < perf->count; i++) {
-        perf->counters[i] = perf->buffer[i * 2 + 1];
+    yy_perf_hot *arr = (yy_perf_hot *)calloc(s->hist_count, sizeof(yy_perf_hot));
+    if (!arr) return 0;
+    u32 count = 0;
+    for (u32 i = 0; i < s->hist_capacity; i++) {
+        if (!s->keys[i]) continue;
+        arr[count].addr = s->keys[i];
+        arr[count].self = s->selfs[i];
+        arr[count].total = s->totals[i];
+        count++;
     }
-    return perf->counters;
+    qsort(arr, count, sizeof(yy_perf_hot), perf_hot_cmp);
+    
+    if (symbolize) {
+        /* reload the mappings, the code may be loaded after last call */
+        if (s->sym) yy_sym_free(s->sym);
+        s->sym = yy_sym_new();
+        for (u32 i = 0; s->sym && i < count; i++) {
+            yy_sym_info info;
+            if (!yy_sym_lookup(s->sym, arr[i].addr, &info)) continue;
+            arr[i].module = info.module;
+            arr[i].symbol = info.name;
+            arr[i].offset = info.offset;
+        }
+    }
+    *hot = arr;
+    return count;
 }
 
 #endif
@@ -691,6 +2348,21 @@ bool yy_perf_event_available_linux(yy_perf *perf, u64 ev_value) {
     return false;
 }
 
+bool yy_perf_parse_event_name_linux(const char *ev_name, u32 *type, u64 *configs) {
+    return false;
+}
+
+void yy_perf_set_sysfs_path_linux(const char *path) {
+}
+
+bool yy_perf_add_event_by_name(yy_perf *perf, const char *ev_name, const char *ev_alias) {
+    return yy_perf_add_event_apple(perf, ev_name, ev_alias);
+}
+
+bool yy_perf_event_available_by_name(yy_perf *perf, const char *ev_name) {
+    return yy_perf_event_available_apple(perf, ev_name);
+}
+
 u32 yy_perf_get_event_count(yy_perf *perf) {
     if (!perf) return 0;
     usize count = 0;
@@ -748,6 +2420,7 @@ bool yy_perf_close(yy_perf *perf) {
     ret = kpc_set_config(0, buf);
     if (ret != 0) return false;
     
+    perf->is_opened = false;
     return true;
 }
 
@@ -799,6 +2472,136 @@ u64 *yy_perf_get_counters(yy_perf *perf) {
 }
 
 
+
+f64 yy_perf_get_running_ratio(yy_perf *perf) {
+    /* kpc doesn't use multiplexing */
+    return (perf && perf->is_opened) ? 1.0 : 0;
+}
+
+
+bool yy_perf_is_software_only(void) {
+    return false;
+}
+
+bool yy_perf_set_user_read(yy_perf *perf, bool enabled) {
+    return perf != NULL;
+}
+
+bool yy_perf_is_user_read(yy_perf *perf) {
+    return false;
+}
+
+bool yy_perf_set_max_group_size(yy_perf *perf, u32 size) {
+    return perf != NULL;
+}
+
+u32 yy_perf_get_group_count(yy_perf *perf) {
+    return yy_perf_get_event_count(perf) ? 1 : 0;
+}
+
+bool yy_perf_run_scheduled(yy_perf *perf, int anchor,
+                           yy_perf_run_func func, void *ctx) {
+    /* kpc rejects the events which don't fit the counters when they are
+       added, so all events are always in one group */
+    if (!perf || !func) return false;
+    if (perf->is_opened) return false;
+    if (!yy_perf_open(perf)) return false;
+    bool suc = yy_perf_start_counting(perf);
+    if (suc) {
+        func(ctx);
+        suc = yy_perf_stop_counting(perf);
+    }
+    /* the counters are kept after close */
+    yy_perf_close(perf);
+    return suc;
+}
+
+bool yy_perf_set_threads(yy_perf *perf, const int *tids, u32 count) {
+    /* kpc only counts the calling thread */
+    return perf != NULL && (!tids || count == 0);
+}
+
+int yy_perf_get_thread_id(void) {
+    return -1;
+}
+
+u32 yy_perf_get_thread_count(yy_perf *perf) {
+    return 0;
+}
+
+u64 *yy_perf_get_thread_counters(yy_perf *perf, u32 idx) {
+    return NULL;
+}
+
+bool yy_perf_set_inherit(yy_perf *perf, bool inherit) {
+    return perf != NULL && !inherit;
+}
+
+bool yy_perf_open_pid(yy_perf *perf, int pid) {
+    return false;
+}
+
+bool yy_perf_open_cgroup(yy_perf *perf, const char *path) {
+    return false;
+}
+
+yy_perf_sampler *yy_perf_sampler_new(yy_perf_event event, u64 period,
+                                     u32 freq, bool callchain) {
+    return NULL;
+}
+
+void yy_perf_sampler_free(yy_perf_sampler *s) {
+
+}
+
+bool yy_perf_sampler_set_callback(yy_perf_sampler *s,
+                                  yy_perf_sample_func func, void *ctx) {
+    return false;
+}
+
+bool yy_perf_sampler_start(yy_perf_sampler *s) {
+    return false;
+}
+
+bool yy_perf_sampler_stop(yy_perf_sampler *s) {
+    return false;
+}
+
+u32 yy_perf_sampler_poll(yy_perf_sampler *s) {
+    return 0;
+}
+
+u64 yy_perf_sampler_get_sample_count(yy_perf_sampler *s) {
+    return 0;
+}
+
+u64 yy_perf_sampler_get_lost_count(yy_perf_sampler *s) {
+    return 0;
+}
+
+void yy_perf_sampler_reset(yy_perf_sampler *s) {
+
+}
+
+u32 yy_perf_sampler_get_hot(yy_perf_sampler *s, bool symbolize,
+                            yy_perf_hot **hot) {
+    if (hot) *hot = NULL;
+    return 0;
+}
+
+bool yy_perf_topdown_available(void) {
+    return false;
+}
+
+bool yy_perf_add_topdown_events(yy_perf *perf) {
+    return false;
+}
+
+bool yy_perf_get_topdown(yy_perf *perf, yy_perf_topdown *td) {
+    if (td) memset(td, 0, sizeof(yy_perf_topdown));
+    return false;
+}
+
 #endif
 
 
@@ -861,6 +2664,21 @@ bool yy_perf_event_available_linux(yy_perf *perf, u64 ev_value) {
     return false;
 }
 
+bool yy_perf_parse_event_name_linux(const char *ev_name, u32 *type, u64 *configs) {
+    return false;
+}
+
+void yy_perf_set_sysfs_path_linux(const char *path) {
+}
+
+bool yy_perf_add_event_by_name(yy_perf *perf, const char *ev_name, const char *ev_alias) {
+    return false;
+}
+
+bool yy_perf_event_available_by_name(yy_perf *perf, const char *ev_name) {
+    return false;
+}
+
 u32 yy_perf_get_event_count(yy_perf *perf) {
     return 0;
 }
@@ -897,4 +2715,379 @@ u64 *yy_perf_get_counters(yy_perf *perf) {
     return NULL;
 }
 
+f64 yy_perf_get_running_ratio(yy_perf *perf) {
+    return 0;
+}
+
+bool yy_perf_is_software_only(void) {
+    return false;
+}
+
+bool yy_perf_set_user_read(yy_perf *perf, bool enabled) {
+    return false;
+}
+
+bool yy_perf_is_user_read(yy_perf *perf) {
+    return false;
+}
+
+bool yy_perf_set_max_group_size(yy_perf *perf, u32 size) {
+    return false;
+}
+
+u32 yy_perf_get_group_count(yy_perf *perf) {
+    return 0;
+}
+
+bool yy_perf_run_scheduled(yy_perf *perf, int anchor,
+                           yy_perf_run_func func, void *ctx) {
+    return false;
+}
+
+
+bool yy_perf_set_threads(yy_perf *perf, const int *tids, u32 count) {
+    return false;
+}
+
+int yy_perf_get_thread_id(void) {
+    return -1;
+}
+
+u32 yy_perf_get_thread_count(yy_perf *perf) {
+    return 0;
+}
+
+u64 *yy_perf_get_thread_counters(yy_perf *perf, u32 idx) {
+    return NULL;
+}
+
+bool yy_perf_set_inherit(yy_perf *perf, bool inherit) {
+    return false;
+}
+
+bool yy_perf_open_pid(yy_perf *perf, int pid) {
+    return false;
+}
+
+bool yy_perf_open_cgroup(yy_perf *perf, const char *path) {
+    return false;
+}
+
+yy_perf_sampler *yy_perf_sampler_new(yy_perf_event event, u64 period,
+                                     u32 freq, bool callchain) {
+    return NULL;
+}
+
+void yy_perf_sampler_free(yy_perf_sampler *s) {
+
+}
+
+bool yy_perf_sampler_set_callback(yy_perf_sampler *s,
+                                  yy_perf_sample_func func, void *ctx) {
+    return false;
+}
+
+bool yy_perf_sampler_start(yy_perf_sampler *s) {
+    return false;
+}
+
+bool yy_perf_sampler_stop(yy_perf_sampler *s) {
+    return false;
+}
+
+u32 yy_perf_sampler_poll(yy_perf_sampler *s) {
+    return 0;
+}
+
+u64 yy_perf_sampler_get_sample_count(yy_perf_sampler *s) {
+    return 0;
+}
+
+u64 yy_perf_sampler_get_lost_count(yy_perf_sampler *s) {
+    return 0;
+}
+
+void yy_perf_sampler_reset(yy_perf_sampler *s) {
+
+}
+
+u32 yy_perf_sampler_get_hot(yy_perf_sampler *s, bool symbolize,
+                            yy_perf_hot **hot) {
+    if (hot) *hot = NULL;
+    return 0;
+}
+
+bool yy_perf_topdown_available(void) {
+    return false;
+}
+
+bool yy_perf_add_topdown_events(yy_perf *perf) {
+    return false;
+}
+
+bool yy_perf_get_topdown(yy_perf *perf, yy_perf_topdown *td) {
+    if (td) memset(td, 0, sizeof(yy_perf_topdown));
+    return false;
+}
+
+#endif
+
+
+
+/*==============================================================================
+ * Periodic Sampling
+ *
+ * Built on the public API, so it works on all platforms.
+ *============================================================================*/
+
+static void perf_sleep(f64 seconds) {
+    if (seconds <= 0) return;
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (f64)ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
 #endif
+}
+
+bool yy_perf_sample_series(yy_perf *perf, f64 interval, u32 count,
+                           yy_perf_series *series) {
+    u32 ev_count;
+    f64 *times, begin;
+    u64 *values, *prev;
+    bool suc = true;
+    
+    if (!series) return false;
+    memset(series, 0, sizeof(yy_perf_series));
+    if (!perf || !yy_perf_is_opened(perf)) return false;
+    if (!(interval > 0) || count == 0) return false;
+    ev_count = yy_perf_get_event_count(perf);
+    if (ev_count == 0) return false;
+    
+    times = (f64 *)calloc(count, sizeof(f64));
+    values = (u64 *)calloc((usize)count * ev_count, sizeof(u64));
+    prev = (u64 *)calloc(ev_count, sizeof(u64));
+    if (!times || !values || !prev) goto fail;
+    if (!yy_perf_start_counting(perf)) goto fail;
+    
+    /* sleep to a fixed schedule, so the read time does not drift */
+    begin = yy_time_get_seconds();
+    for (u32 i = 0; i < count; i++) {
+        perf_sleep(begin + interval * (i + 1) - yy_time_get_seconds());
+        u64 *vals = yy_perf_get_counters(perf);
+        f64 now = yy_time_get_seconds();
+        if (!vals) {
+            suc = false;
+            break;
+        }
+        times[i] = now - begin;
+        for (u32 e = 0; e < ev_count; e++) {
+            /* scaled values may step back a little when multiplexed */
+            u64 val = vals[e] > prev[e] ? vals[e] - prev[e] : 0;
+            values[(usize)i * ev_count + e] = val;
+            if (vals[e] > prev[e]) prev[e] = vals[e];
+        }
+    }
+    yy_perf_stop_counting(perf);
+    if (!suc) goto fail;
+    
+    series->event_count = ev_count;
+    series->sample_count = count;
+    series->names = yy_perf_get_event_names(perf);
+    series->times = times;
+    series->values = values;
+    free(prev);
+    return true;
+    
+fail:
+    free(times);
+    free(values);
+    free(prev);
+    return false;
+}
+
+void yy_perf_series_release(yy_perf_series *series) {
+    if (!series) return;
+    if (series->times) free(series->times);
+    if (series->values) free(series->values);
+    memset(series, 0, sizeof(yy_perf_series));
+}
+
+bool yy_perf_report_series(yy_report *report, const yy_perf_series *series,
+                           const char *title) {
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+    
+    if (!report || !series || !series->sample_count) return false;
+    
+    yy_chart_options_init(&op);
+    op.title = title ? title : "Performance Counters";
+    op.subtitle = "events per second of each sampling interval";
+    op.type = YY_CHART_LINE;
+    op.h_axis.title = "time (s)";
+    op.v_axis.title = "events per second";
+    op.tooltip.value_decimals = 0;
+    op.tooltip.shared = true;
+    op.tooltip.crosshairs = true;
+    
+    chart = yy_chart_new();
+    if (!chart) return false;
+    suc &= yy_chart_set_options(chart, &op);
+    for (u32 e = 0; e < series->event_count; e++) {
+        suc &= yy_chart_item_begin(chart, series->names[e]);
+        for (u32 i = 0; i < series->sample_count; i++) {
+            f64 prev = i ? series->times[i - 1] : 0;
+            f64 dur = series->times[i] - prev;
+            u64 val = series->values[(usize)i * series->event_count + e];
+            f64 rate = dur > 0 ? (f64)val / dur : 0;
+            suc &= yy_chart_item_add_point(chart, (float)series->times[i],
+                                           (float)rate);
+        }
+        suc &= yy_chart_item_end(chart);
+    }
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    return suc;
+}
+
+
+
+/*==============================================================================
+ * Sampling Report
+ *============================================================================*/
+
+bool yy_perf_sampler_report(yy_perf_sampler *s, yy_report *report, u32 top) {
+    yy_chart_options op;
+    yy_chart *chart;
+    yy_perf_hot *hot;
+    const char **labels;
+    bool suc = true, has_total = false;
+    
+    if (!s || !report) return false;
+    u32 count = yy_perf_sampler_get_hot(s, true, &hot);
+    if (!count) return false;
+    if (top == 0) top = 20;
+    if (count > top) count = top;
+    for (u32 i = 0; i < count; i++) has_total |= hot[i].total != hot[i].self;
+    
+    /* label: symbol+offset (module), or address if not symbolized */
+    labels = (const char **)calloc(count + 1, sizeof(char *));
+    if (!labels) {
+        free(hot);
+        return false;
+    }
+    for (u32 i = 0; i < count && suc; i++) {
+        char buf[512];
+        const char *module = hot[i].module ? hot[i].module : "";
+        const char *slash = strrchr(module, '/');
+        if (slash) module = slash + 1;
+        if (hot[i].symbol) {
+            snprintf(buf, sizeof(buf), "%s+0x%llx (%s)", hot[i].symbol,
+                     (unsigned long long)hot[i].offset, module);
+        } else if (hot[i].module) {
+            snprintf(buf, sizeof(buf), "0x%llx (%s+0x%llx)",
+                     (unsigned long long)hot[i].addr, module,
+                     (unsigned long long)hot[i].offset);
+        } else {
+            snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)hot[i].addr);
+        }
+        labels[i] = yy_str_copy(buf);
+        if (!labels[i]) suc = false;
+    }
+    
+    yy_chart_options_init(&op);
+    op.title = "Hot Instructions";
+    op.subtitle = "samples per instruction address";
+    op.type = YY_CHART_BAR;
+    op.h_axis.title = "samples";
+    op.v_axis.categories = labels;
+    op.tooltip.value_decimals = 0;
+    op.tooltip.shared = true;
+    
+    chart = suc ? yy_chart_new() : NULL;
+    if (chart) {
+        suc &= yy_chart_set_options(chart, &op);
+        suc &= yy_chart_item_begin(chart, "self");
+        for (u32 i = 0; i < count; i++) {
+            suc &= yy_chart_item_add_int(chart, (int)hot[i].self);
+        }
+        suc &= yy_chart_item_end(chart);
+        if (has_total) {
+            suc &= yy_chart_item_begin(chart, "total");
+            for (u32 i = 0; i < count; i++) {
+                suc &= yy_chart_item_add_int(chart, (int)hot[i].total);
+            }
+            suc &= yy_chart_item_end(chart);
+        }
+        if (suc) suc = yy_report_add_chart(report, chart);
+        yy_chart_free(chart);
+    } else {
+        suc = false;
+    }
+    for (u32 i = 0; i < count; i++) free((void *)labels[i]);
+    free(labels);
+    free(hot);
+    return suc;
+}
+
+
+
+/*==============================================================================
+ * Top-down Report
+ *============================================================================*/
+
+bool yy_perf_report_topdown(yy_report *report, const char *title,
+                            const char **names, const yy_perf_topdown *results,
+                            u32 count) {
+    yy_chart_options op;
+    yy_chart *chart;
+    bool suc = true;
+    const char *parts[4] = { "retiring", "bad speculation",
+                             "frontend bound", "backend bound" };
+    /* the colors are not copied by the chart, so they should be static */
+    static const char *colors[5] = { "#50B432", "#ED561B", "#058DC7", "#DDDF00", NULL };
+    
+    if (!report || !names || !results || !count) return false;
+    const char **categories = (const char **)calloc(count + 1, sizeof(char *));
+    if (!categories) return false;
+    for (u32 i = 0; i < count; i++) categories[i] = names[i];
+    
+    yy_chart_options_init(&op);
+    op.title = title ? title : "Top-down Analysis";
+    op.subtitle = "level-1 breakdown of pipeline slots";
+    op.type = YY_CHART_BAR;
+    op.colors = colors;
+    op.v_axis.categories = categories;
+    op.h_axis.title = "pipeline slots (%)";
+    op.h_axis.min = 0;
+    op.h_axis.max = 100;
+    op.tooltip.value_decimals = 1;
+    op.tooltip.value_suffix = "%";
+    op.tooltip.shared = true;
+    op.plot.group_stacked = true;
+    
+    chart = yy_chart_new();
+    if (!chart) {
+        free(categories);
+        return false;
+    }
+    suc &= yy_chart_set_options(chart, &op);
+    for (u32 p = 0; p < 4; p++) {
+        suc &= yy_chart_item_begin(chart, parts[p]);
+        for (u32 i = 0; i < count; i++) {
+            const yy_perf_topdown *td = results + i;
+            f64 val = p == 0 ? td->retiring :
+                      p == 1 ? td->bad_speculation :
+                      p == 2 ? td->frontend_bound : td->backend_bound;
+            suc &= yy_chart_item_add_float(chart, (float)(val * 100.0));
+        }
+        suc &= yy_chart_item_end(chart);
+    }
+    if (suc) suc = yy_report_add_chart(report, chart);
+    yy_chart_free(chart);
+    free(categories);
+    return suc;
+}
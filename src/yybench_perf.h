@@ -7,6 +7,7 @@
 #define yybench_perf_h
 
 #include "yybench_def.h"
+#include "yybench_chart.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,6 +31,7 @@ extern "C" {
      // load perf module
      bool loaded = yy_perf_load(true);
      if (!loaded) return;
+     if (yy_perf_is_software_only()) return; // no hardware events
      
      // create perf config, add event
      yy_perf *perf = yy_perf_new();
@@ -54,6 +56,9 @@ extern "C" {
         printf("%s: %llu\n",names[i], vals[i]);
      }
      
+     // check multiplexing, the values are estimated if ratio < 1.0
+     if (yy_perf_get_running_ratio(perf) < 0.9) printf("under-sampled\n");
+     
      // close and free resource
      yy_perf_close(perf);
      yy_perf_free(perf);
@@ -113,6 +118,30 @@ typedef enum yy_perf_event {
     
     /* Last-Level Cache store miss count */
     YY_PERF_EVENT_LLC_STORE_MISSES,
+    
+    /* Software events, counted by kernel (Linux only), they are available
+       without hardware PMU, for example in a VM without virtual PMU. */
+    
+    /* Task clock in nanoseconds, the time the task was running on CPU */
+    YY_PERF_EVENT_TASK_CLOCK,
+    
+    /* Page fault count */
+    YY_PERF_EVENT_PAGE_FAULTS,
+    
+    /* Minor page fault count (no disk I/O) */
+    YY_PERF_EVENT_PAGE_FAULTS_MINOR,
+    
+    /* Major page fault count (disk I/O) */
+    YY_PERF_EVENT_PAGE_FAULTS_MAJOR,
+    
+    /* Context switch count */
+    YY_PERF_EVENT_CONTEXT_SWITCHES,
+    
+    /* CPU migration count */
+    YY_PERF_EVENT_CPU_MIGRATIONS,
+    
+    /* Alignment fault count */
+    YY_PERF_EVENT_ALIGNMENT_FAULTS,
 } yy_perf_event;
 
 
@@ -122,11 +151,17 @@ typedef struct yy_perf yy_perf;
 /**
  Load perf module.
  This function should be called once before any other functions in this file..
+ On Linux, if hardware events are not available (such as in a VM without
+ virtual PMU), it still succeeds in software-only mode when software events
+ are available, see yy_perf_is_software_only().
  @param print_message_on_error true to print error message on error.
  @return true on success.
  */
 bool yy_perf_load(bool print_message_on_error);
 
+/** Whether only software events are available (valid after load). */
+bool yy_perf_is_software_only(void);
+
 /** Creates a perf object. */
 yy_perf *yy_perf_new(void);
 
@@ -177,6 +212,41 @@ bool yy_perf_add_event_linux(yy_perf *perf, u64 ev_value, const char *ev_alias);
 /** Whether an event is availabie for current host. */
 bool yy_perf_event_available_linux(yy_perf *perf, u64 ev_value);
 
+/** Add an event by symbolic name.
+    Return false if the event is not supported.
+    
+    @param ev_name
+    On Linux, the name is resolved with the PMU descriptors in sysfs
+    (/sys/bus/event_source/devices/<pmu>/{type,events,format}):
+    "pmu/terms/", such as "cpu/event=0xd1,umask=0x20/" or
+    "cpu/event=0xa3,umask=0x14,cmask=20/", a term may be a named event of the
+    PMU ("cpu/mem-loads,ldlat=30/") or a flag without value ("inv");
+    or an event name exported by a PMU, such as "cache-misses".
+    Events that are only defined in perf's JSON tables are not exported in
+    sysfs; a few common Intel core events are built in, such as
+    "mem_load_retired.l3_miss", "longest_lat_cache.miss" and
+    "br_misp_retired.all_branches", use the terms from vendor's event list
+    for others.
+    On macOS/iOS, this is same as yy_perf_add_event_apple().
+ 
+    @param ev_alias
+    You can give an alias name for this event, or NULL to use ev_name.
+ */
+bool yy_perf_add_event_by_name(yy_perf *perf, const char *ev_name, const char *ev_alias);
+
+/** Whether an event is availabie for current host. */
+bool yy_perf_event_available_by_name(yy_perf *perf, const char *ev_name);
+
+/** Parse an event name to the type and the configs (config, config1 and
+    config2 of perf_event_attr) without opening it, the name is resolved same
+    as yy_perf_add_event_by_name(). Available for Linux. */
+bool yy_perf_parse_event_name_linux(const char *ev_name, u32 *type, u64 *configs);
+
+/** Set the sysfs directory of the PMU descriptors, such as a fixture directory
+    for tests, or NULL to restore "/sys/bus/event_source/devices".
+    This function is not thread-safe. Available for Linux. */
+void yy_perf_set_sysfs_path_linux(const char *path);
+
 /** Get current event count. */
 u32 yy_perf_get_event_count(yy_perf *perf);
 
@@ -193,6 +263,18 @@ bool yy_perf_close(yy_perf *perf);
 /** Whether perf is opened. */
 bool yy_perf_is_opened(yy_perf *perf);
 
+/** Allow reading counters in user space without syscall (default is true),
+    should be called before open.
+    On Linux x86, if the kernel allows `rdpmc` for all events (cap_user_rdpmc),
+    the group keeps counting after open, and start/stop/get_counters read the
+    counters from the mmap'd event pages with `rdpmc`, so they are cheap enough
+    to be used in a hot loop. Otherwise, or if a counter is not scheduled on
+    hardware at the moment, the read falls back to syscall. */
+bool yy_perf_set_user_read(yy_perf *perf, bool enabled);
+
+/** Whether the counters are read in user space (valid after open). */
+bool yy_perf_is_user_read(yy_perf *perf);
+
 /** Start perf counting. */
 bool yy_perf_start_counting(yy_perf *perf);
 
@@ -202,9 +284,291 @@ bool yy_perf_stop_counting(yy_perf *perf);
 /** Whether perf is counting. */
 bool yy_perf_is_counting(yy_perf *perf);
 
-/** Get counter values. */
+/** Get counter values.
+    On Linux, if the kernel multiplexed the counters (there are more events
+    than hardware counters), the raw values are scaled by
+    time_enabled / time_running to estimate the full counting time. */
 u64 *yy_perf_get_counters(yy_perf *perf);
 
+/** Get the ratio of time the counters were actually running to the time they
+    were enabled (0.0 to 1.0), updated by yy_perf_get_counters().
+    1.0 means the counters were not multiplexed and the values are exact,
+    a small ratio means the values are extrapolated from a short sample and
+    the run may be rejected. Returns 0 if perf is not opened. */
+f64 yy_perf_get_running_ratio(yy_perf *perf);
+
+
+/** The measured region for yy_perf_run_scheduled(). */
+typedef void (*yy_perf_run_func)(void *ctx);
+
+/** Set the max event count of each scheduled group (including the anchor),
+    pass 0 to detect by hardware (default): events are added to a group while
+    the group can still be counted without multiplexing. */
+bool yy_perf_set_max_group_size(yy_perf *perf, u32 size);
+
+/** Split the events into groups that fit the hardware counters, and run the
+    measured region once per group (perf should not be opened).
+    The results are merged into one counter vector, which can be read by
+    yy_perf_get_counters(), and yy_perf_get_running_ratio() returns the min
+    ratio of all groups.
+    
+    @param anchor The index of an anchor event (such as cycles) which is
+        counted in every group, values of each group are normalized with
+        (average anchor / anchor of the group). Pass -1 to disable.
+    @param func The measured region, it should do the same work in each call.
+    @param ctx The context passed to func.
+    
+    On Apple platforms, all events are always in one group, because kpc
+    rejects the events which don't fit the counters when they are added. */
+bool yy_perf_run_scheduled(yy_perf *perf, int anchor,
+                           yy_perf_run_func func, void *ctx);
+
+/** Get the group count of the last yy_perf_run_scheduled(). */
+u32 yy_perf_get_group_count(yy_perf *perf);
+
+
+/** Count a set of threads instead of the calling thread, should be called
+    before open. Each thread is counted by its own group, the values of all
+    threads are summed by yy_perf_get_counters(), and the values of each
+    thread can be read by yy_perf_get_thread_counters().
+    The counters are read with syscall in this mode (no user space read),
+    and yy_perf_run_scheduled() still counts the calling thread only.
+    Available for Linux (counting other threads requires ptrace permission).
+    
+    @param tids Thread ids from yy_perf_get_thread_id(), the threads should
+        be alive when perf is opened. Pass NULL to count the calling thread
+        (default).
+    @param count The thread count. */
+bool yy_perf_set_threads(yy_perf *perf, const int *tids, u32 count);
+
+/** Returns the kernel thread id of the calling thread (gettid() on Linux),
+    or -1 if not supported. */
+int yy_perf_get_thread_id(void);
+
+/** Get the thread count set by yy_perf_set_threads(). */
+u32 yy_perf_get_thread_count(yy_perf *perf);
+
+/** Get the counter values of a thread set by yy_perf_set_threads(),
+    updated by yy_perf_get_counters(). Returns NULL if not available. */
+u64 *yy_perf_get_thread_counters(yy_perf *perf, u32 idx);
+
+/** Count the threads created by the counted threads after open (inherit),
+    should be called before open. The kernel adds the values of the child
+    threads to the parent counters, so only the summed values are available.
+    The counters are read with syscall in this mode (no user space read).
+    Old kernels reject inherit with group read format, in that case the
+    events are read one by one. Available for Linux. */
+bool yy_perf_set_inherit(yy_perf *perf, bool inherit);
+
+/** Open perf to count an external process (such as a live service), instead
+    of the calling thread. Each existing thread of the process is counted by
+    its own group (same as yy_perf_set_threads() with all threads listed in
+    /proc/pid/task), and inherit is enabled to count the threads created later.
+    The per-thread values are available with yy_perf_get_thread_counters().
+    This requires ptrace permission to the process. Available for Linux.
+    The targets and inherit are restored by yy_perf_close() (or on failure),
+    so a later yy_perf_open() counts the calling thread again. */
+bool yy_perf_open_pid(yy_perf *perf, int pid);
+
+/** Open perf to count all tasks in a cgroup (cgroup v2 or the perf_event
+    controller of cgroup v1). The kernel counts cgroup events per CPU, so one
+    group is opened for each online CPU, yy_perf_get_thread_counters() returns
+    the values of each CPU (in the order of yy_topo_get_cpu()).
+    This usually requires root privileges. Available for Linux.
+    The targets are restored by yy_perf_close() (or on failure), same as
+    yy_perf_open_pid().
+    @param path The cgroup directory, such as "/sys/fs/cgroup/system.slice",
+        or a path relative to "/sys/fs/cgroup". */
+bool yy_perf_open_cgroup(yy_perf *perf, const char *path);
+
+
+/** Counter values sampled periodically. */
+typedef struct yy_perf_series {
+    u32 event_count;
+    u32 sample_count;
+    const char **names; /* event names, owned by the perf object */
+    f64 *times; /* end time of each interval, seconds from the start */
+    u64 *values; /* counter delta of each interval: [sample][event] */
+} yy_perf_series;
+
+/** Sample the counters periodically, this function blocks for about
+    (interval * count) seconds. The perf should be opened, for example with
+    yy_perf_open_pid() or yy_perf_open_cgroup() to monitor a live service.
+    @param interval The sampling interval in seconds, such as 0.1.
+    @param count The sample count.
+    @param series The result, should be released with yy_perf_series_release().
+    @return false on error. */
+bool yy_perf_sample_series(yy_perf *perf, f64 interval, u32 count,
+                           yy_perf_series *series);
+
+/** Release the memory of the series. */
+void yy_perf_series_release(yy_perf_series *series);
+
+/** Add an events-per-second vs time line chart of the series to report.
+    @param title The chart title, or NULL to use the default. */
+bool yy_perf_report_series(yy_report *report, const yy_perf_series *series,
+                           const char *title);
+
+
+
+/*==============================================================================
+ Top-down Analysis
+ 
+ Top-down microarchitecture analysis (TMA) level 1: the pipeline slots are
+ split into frontend bound, bad speculation, backend bound and retiring.
+ The kernel's topdown-* events in /sys/bus/event_source/devices/cpu/events
+ are preferred (Intel Sandy Bridge and later), and the raw events are used for
+ Intel Sandy Bridge to Comet Lake if the kernel doesn't export them.
+ Available for Linux.
+ 
+ Usage:
+ 
+     yy_perf *perf = yy_perf_new();
+     if (!yy_perf_add_topdown_events(perf)) return;
+     yy_perf_open(perf);
+     yy_perf_start_counting(perf);
+     // code to profile...
+     yy_perf_stop_counting(perf);
+     
+     yy_perf_topdown td;
+     yy_perf_get_topdown(perf, &td);
+     printf("retiring: %.1f%%\n", td.retiring * 100);
+ 
+ *============================================================================*/
+
+/** Top-down level-1 breakdown, fractions of the pipeline slots (sum is 1.0). */
+typedef struct yy_perf_topdown {
+    f64 frontend_bound; /* slots not filled by the frontend (fetch, decode) */
+    f64 bad_speculation; /* slots wasted by mispredicted speculation */
+    f64 backend_bound; /* slots stalled by the backend (memory, execution) */
+    f64 retiring; /* slots used by retired uops */
+} yy_perf_topdown;
+
+/** Whether the top-down events are available for current CPU. */
+bool yy_perf_topdown_available(void);
+
+/** Add the top-down events (5 events) to perf.
+    The events are counted in one group led by the first event (slots), so
+    they must be added before other events, it returns false if perf already
+    has events. Avoid adding too many other events. With
+    yy_perf_run_scheduled(), the 5 events are kept in the first group. */
+bool yy_perf_add_topdown_events(yy_perf *perf);
+
+/** Compute the top-down breakdown from the counters, it reads the counters
+    with yy_perf_get_counters(). */
+bool yy_perf_get_topdown(yy_perf *perf, yy_perf_topdown *td);
+
+/** Add a stacked bar chart of top-down breakdowns to report.
+    @param title The chart title, or NULL to use the default.
+    @param names The name of each result, such as the benchmark name.
+    @param results The top-down results.
+    @param count The result count. */
+bool yy_perf_report_topdown(yy_report *report, const char *title,
+                            const char **names, const yy_perf_topdown *results,
+                            u32 count);
+
+
+
+/*==============================================================================
+ Sampling Profiler
+ 
+ The sampler takes a sample (instruction address, thread id, and optionally
+ the user space call chain) of the calling thread every `period` events, and
+ builds an address histogram, which can be symbolized with the ELF symbols of
+ the mapped files (see yybench_sym.h), so we can see which instructions got
+ hot in a benchmark. The samples are written by kernel into a ring buffer
+ (1MB), and drained by yy_perf_sampler_poll() without syscall or blocking,
+ it should be called periodically in a long run, or the samples may be lost.
+ Available for Linux.
+ 
+ Usage:
+ 
+     yy_perf_sampler *s = yy_perf_sampler_new(YY_PERF_EVENT_CYCLES, 0, 0, false);
+     yy_perf_sampler_start(s);
+     for (int i = 0; i < 100; i++) {
+         // code to profile...
+         yy_perf_sampler_poll(s);
+     }
+     yy_perf_sampler_stop(s);
+     
+     yy_perf_hot *hot;
+     u32 count = yy_perf_sampler_get_hot(s, true, &hot);
+     for (u32 i = 0; i < count && i < 10; i++) {
+         printf("%llu %s+0x%llx\n", hot[i].self, hot[i].symbol, hot[i].offset);
+     }
+     free(hot);
+     yy_perf_sampler_free(s);
+ 
+ *============================================================================*/
+
+/** A sampling profiler. */
+typedef struct yy_perf_sampler yy_perf_sampler;
+
+/** A sampled instruction address. */
+typedef struct yy_perf_hot {
+    u64 addr; /* instruction address (or return address for callers) */
+    u64 self; /* samples at this address */
+    u64 total; /* samples with this address in the call chain (including self),
+                  same as self if call chain is not sampled */
+    const char *module; /* mapped file, NULL if not symbolized */
+    const char *symbol; /* function name, NULL if not found */
+    u64 offset; /* offset from the function (or file) start */
+} yy_perf_hot;
+
+/** Sample callback, frames[0] is the sample ip, followed by the return
+    addresses of the user space call chain if it's sampled. */
+typedef void (*yy_perf_sample_func)(void *ctx, u32 tid, u64 ip,
+                                    const u64 *frames, u32 frame_count);
+
+/** Creates a sampler for the calling thread (user space code only).
+    @param event The event, pass YY_PERF_EVENT_NONE to use cycles
+        (or task clock in software-only mode).
+    @param period Take a sample every `period` events, pass 0 to use freq.
+    @param freq Samples per second when period is 0 (the kernel adjusts the
+        period dynamically), pass 0 to use the default (4000).
+    @param callchain Whether to sample the user space call chain.
+    @return NULL if not supported. */
+yy_perf_sampler *yy_perf_sampler_new(yy_perf_event event, u64 period,
+                                     u32 freq, bool callchain);
+
+/** Stop and free the sampler. */
+void yy_perf_sampler_free(yy_perf_sampler *s);
+
+/** Set a callback for each drained sample, pass NULL to remove. */
+bool yy_perf_sampler_set_callback(yy_perf_sampler *s,
+                                  yy_perf_sample_func func, void *ctx);
+
+/** Start sampling. */
+bool yy_perf_sampler_start(yy_perf_sampler *s);
+
+/** Stop sampling and drain the remaining samples. */
+bool yy_perf_sampler_stop(yy_perf_sampler *s);
+
+/** Drain the samples from the ring buffer into the histogram (non-blocking).
+    Returns the number of drained samples. */
+u32 yy_perf_sampler_poll(yy_perf_sampler *s);
+
+/** Get the number of drained samples. */
+u64 yy_perf_sampler_get_sample_count(yy_perf_sampler *s);
+
+/** Get the number of samples lost because the ring buffer was full. */
+u64 yy_perf_sampler_get_lost_count(yy_perf_sampler *s);
+
+/** Clear the histogram and the sample counts. */
+void yy_perf_sampler_reset(yy_perf_sampler *s);
+
+/** Get the address histogram, sorted by self samples (descending).
+    @param symbolize Whether to symbolize the addresses, the strings are owned
+        by the sampler and valid until the next call or free.
+    @param hot Output the histogram, should be released with free().
+    @return The entry count. */
+u32 yy_perf_sampler_get_hot(yy_perf_sampler *s, bool symbolize,
+                            yy_perf_hot **hot);
+
+/** Add a bar chart of the top hot addresses (symbolized) to report.
+    @param top Max number of addresses, pass 0 to use the default (20). */
+bool yy_perf_sampler_report(yy_perf_sampler *s, yy_report *report, u32 top);
+
 
 /*==============================================================================
  * Linux
@@ -16,30 +16,21 @@
 #define YY_RANDOM_INC_INIT (((u64)0xDA3E39CBU << 32) + 0x94B95BDBU)
 #define YY_RANDOM_MUL (((u64)0x5851F42DU << 32) + 0x4C957F2DU)
 
-static u64 yy_random_state = YY_RANDOM_STATE_INIT;
-static u64 yy_random_inc = YY_RANDOM_INC_INIT;
+static yy_random_state yy_random_global = {
+    YY_RANDOM_STATE_INIT, YY_RANDOM_INC_INIT
+};
 
 void yy_random_reset(void) {
-    yy_random_state = YY_RANDOM_STATE_INIT;
-    yy_random_inc = YY_RANDOM_INC_INIT;
+    yy_random_global.state = YY_RANDOM_STATE_INIT;
+    yy_random_global.inc = YY_RANDOM_INC_INIT;
 }
 
 u32 yy_random32(void) {
-    u32 xorshifted, rot;
-    u64 oldstate = yy_random_state;
-    yy_random_state = oldstate * YY_RANDOM_MUL + yy_random_inc;
-    xorshifted = (u32)(((oldstate >> 18) ^ oldstate) >> 27);
-    rot = (u32)(oldstate >> 59);
-    return (xorshifted >> rot) | (xorshifted << (((u32)-(i32)rot) & 31));
+    return yy_random32_r(&yy_random_global);
 }
 
 u32 yy_random32_uniform(u32 bound) {
-    u32 r, threshold = (u32)(-(i32)bound) % bound;
-    if (bound < 2) return 0;
-    while (true) {
-        r = yy_random32();
-        if (r >= threshold) return r % bound;
-    }
+    return yy_random32_uniform_r(&yy_random_global, bound);
 }
 
 u32 yy_random32_range(u32 min, u32 max) {
@@ -47,20 +38,58 @@ u32 yy_random32_range(u32 min, u32 max) {
 }
 
 u64 yy_random64(void) {
-    return (u64)yy_random32() << 32 | yy_random32();
+    return yy_random64_r(&yy_random_global);
 }
 
 u64 yy_random64_uniform(u64 bound) {
-    u64 r, threshold = ((u64)-(i64)bound) % bound;
+    return yy_random64_uniform_r(&yy_random_global, bound);
+}
+
+u64 yy_random64_range(u64 min, u64 max) {
+    return yy_random64_uniform(max - min + 1) + min;
+}
+
+void yy_random_seed_r(yy_random_state *rs, u64 seed) {
+    /* same as pcg32_srandom_r() with the default stream */
+    rs->state = 0;
+    rs->inc = YY_RANDOM_INC_INIT;
+    yy_random32_r(rs);
+    rs->state += seed;
+    yy_random32_r(rs);
+}
+
+u32 yy_random32_r(yy_random_state *rs) {
+    u32 xorshifted, rot;
+    u64 oldstate = rs->state;
+    rs->state = oldstate * YY_RANDOM_MUL + rs->inc;
+    xorshifted = (u32)(((oldstate >> 18) ^ oldstate) >> 27);
+    rot = (u32)(oldstate >> 59);
+    return (xorshifted >> rot) | (xorshifted << (((u32)-(i32)rot) & 31));
+}
+
+u32 yy_random32_uniform_r(yy_random_state *rs, u32 bound) {
+    u32 r, threshold;
     if (bound < 2) return 0;
+    threshold = (u32)(-(i32)bound) % bound;
     while (true) {
-        r = yy_random64();
+        r = yy_random32_r(rs);
         if (r >= threshold) return r % bound;
     }
 }
 
-u64 yy_random64_range(u64 min, u64 max) {
-    return yy_random64_uniform(max - min + 1) + min;
+u64 yy_random64_r(yy_random_state *rs) {
+    u64 hi = yy_random32_r(rs);
+    return hi << 32 | yy_random32_r(rs);
+}
+
+u64 yy_random64_uniform_r(yy_random_state *rs, u64 bound) {
+    u64 r, threshold;
+    if (bound < 2) return 0;
+    threshold = ((u64)-(i64)bound) % bound;
+    while (true) {
+        r = yy_random64_r(rs);
+        if (r >= threshold) return r % bound;
+    }
 }
 
 
@@ -39,6 +39,30 @@ u64 yy_random64_uniform(u64 bound);
 u64 yy_random64_range(u64 min, u64 max);
 
 
+/** State of a random number generator, for the reentrant functions below.
+    A module can own a state to get a reproducible sequence without
+    affecting the global sequence. */
+typedef struct yy_random_state {
+    u64 state;
+    u64 inc;
+} yy_random_state;
+
+/** Init the state with a seed, the same seed gives the same sequence. */
+void yy_random_seed_r(yy_random_state *rs, u64 seed);
+
+/** Generate a uniformly distributed 32-bit random number. */
+u32 yy_random32_r(yy_random_state *rs);
+
+/** Generate a uniformly distributed number, where 0 <= r < bound. */
+u32 yy_random32_uniform_r(yy_random_state *rs, u32 bound);
+
+/** Generate a uniformly distributed 64-bit random number. */
+u64 yy_random64_r(yy_random_state *rs);
+
+/** Generate a uniformly distributed number, where 0 <= r < bound. */
+u64 yy_random64_uniform_r(yy_random_state *rs, u64 bound);
+
+
 #ifdef __cplusplus
 }
 #endif
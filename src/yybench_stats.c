@@ -0,0 +1,349 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_stats.h"
+#include "yybench_rand.h"
+
+#define STATS_DEF_THRESHOLD 3.5
+#define STATS_DEF_CONFIDENCE 0.95
+#define STATS_DEF_RESAMPLES 2000
+#define STATS_BOOTSTRAP_SEED 0x5EED5EED5EED5EEDULL /* fixed, reproducible CI */
+
+/* MAD and mean absolute deviation to standard deviation (normal distribution) */
+#define STATS_MAD_TO_SD 1.482602218505602
+#define STATS_MEANAD_TO_SD 1.253314137315500
+
+
+
+/*==============================================================================
+ * Selection
+ *============================================================================*/
+
+static u64 stats_select_range(u64 *arr, i64 lo, i64 hi, i64 k);
+
+/* Returns the median of the medians of 5 element groups in [lo, hi], the
+   group medians are moved to the front of the range. At least 30% of the
+   values are not less (and not greater) than it. */
+static u64 stats_median_of_medians(u64 *arr, i64 lo, i64 hi) {
+    i64 n = 0;
+    for (i64 g = lo; g <= hi; g += 5) {
+        i64 end = g + 4 < hi ? g + 4 : hi;
+        for (i64 i = g + 1; i <= end; i++) {
+            u64 val = arr[i];
+            i64 j = i;
+            for (; j > g && arr[j - 1] > val; j--) arr[j] = arr[j - 1];
+            arr[j] = val;
+        }
+        i64 mid = g + (end - g) / 2;
+        u64 tmp = arr[lo + n];
+        arr[lo + n] = arr[mid];
+        arr[mid] = tmp;
+        n++;
+    }
+    return stats_select_range(arr, lo, lo + n - 1, lo + (n - 1) / 2);
+}
+
+/* Returns the k-th smallest value in [lo, hi], the range is partially
+   reordered. Introselect: quickselect with median-of-three pivot, linear time
+   on average; after 2 log2(n) rounds the pivot is the median of medians, so
+   the worst case is also linear. */
+static u64 stats_select_range(u64 *arr, i64 lo, i64 hi, i64 k) {
+    u32 depth = 0;
+    for (i64 n = hi - lo + 1; n > 1; n >>= 1) depth += 2;
+    while (hi > lo) {
+        i64 mid = lo + (hi - lo) / 2;
+        u64 tmp, pivot;
+#define stats_swap(x, y) (tmp = arr[x], arr[x] = arr[y], arr[y] = tmp)
+        if (depth > 0) {
+            depth--;
+            if (arr[mid] < arr[lo]) stats_swap(mid, lo);
+            if (arr[hi] < arr[lo]) stats_swap(hi, lo);
+            if (arr[hi] < arr[mid]) stats_swap(hi, mid);
+            pivot = arr[mid];
+        } else {
+            pivot = stats_median_of_medians(arr, lo, hi);
+        }
+        i64 i = lo, j = hi;
+        while (i <= j) {
+            while (arr[i] < pivot) i++;
+            while (arr[j] > pivot) j--;
+            if (i <= j) {
+                stats_swap(i, j);
+                i++;
+                j--;
+            }
+        }
+#undef stats_swap
+        /* [lo, j] <= pivot, [i, hi] >= pivot, (j, i) == pivot */
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else return arr[k];
+    }
+    return arr[k];
+}
+
+/* Returns the k-th smallest value, the array is partially reordered. */
+static u64 stats_select(u64 *arr, u32 count, u32 k) {
+    return stats_select_range(arr, 0, (i64)count - 1, (i64)k);
+}
+
+/* Percentile of the array, the array is partially reordered. */
+static f64 stats_percentile_inplace(u64 *arr, u32 count, f64 p) {
+    if (p < 0) p = 0;
+    if (p > 1) p = 1;
+    f64 pos = p * (f64)(count - 1);
+    u32 k = (u32)pos;
+    f64 frac = pos - (f64)k;
+    f64 val = (f64)stats_select(arr, count, k);
+    if (frac > 0 && k + 1 < count) {
+        /* the next value is the min of the upper part after selection */
+        u64 next = arr[k + 1];
+        for (u32 i = k + 2; i < count; i++) {
+            if (arr[i] < next) next = arr[i];
+        }
+        val += ((f64)next - val) * frac;
+    }
+    return val;
+}
+
+static u64 *stats_copy(const u64 *samples, u32 count) {
+    u64 *buf = (u64 *)malloc(count * sizeof(u64));
+    if (buf) memcpy(buf, samples, count * sizeof(u64));
+    return buf;
+}
+
+static int stats_f64_cmp(const void *a, const void *b) {
+    f64 x = *(const f64 *)a;
+    f64 y = *(const f64 *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Percentile of sorted values. */
+static f64 stats_sorted_percentile(const f64 *sorted, u32 count, f64 p) {
+    f64 pos = p * (f64)(count - 1);
+    u32 k = (u32)pos;
+    if (k + 1 >= count) return sorted[count - 1];
+    return sorted[k] + (sorted[k + 1] - sorted[k]) * (pos - (f64)k);
+}
+
+
+
+/*==============================================================================
+ * Summary
+ *============================================================================*/
+
+f64 yy_stats_mean(const u64 *samples, u32 count) {
+    if (!samples || !count) return 0;
+    f64 sum = 0;
+    for (u32 i = 0; i < count; i++) sum += (f64)samples[i];
+    return sum / (f64)count;
+}
+
+f64 yy_stats_percentile(const u64 *samples, u32 count, f64 p) {
+    if (!samples || !count) return 0;
+    u64 *buf = stats_copy(samples, count);
+    if (!buf) return NAN;
+    f64 val = stats_percentile_inplace(buf, count, p);
+    free(buf);
+    return val;
+}
+
+f64 yy_stats_median(const u64 *samples, u32 count) {
+    return yy_stats_percentile(samples, count, 0.5);
+}
+
+f64 yy_stats_mad(const u64 *samples, u32 count) {
+    if (!samples || !count) return 0;
+    u64 *buf = stats_copy(samples, count);
+    if (!buf) return NAN;
+    /* the deviations are doubled to keep them integral,
+       since the median may be a half value */
+    u64 median2 = (u64)(stats_percentile_inplace(buf, count, 0.5) * 2.0);
+    for (u32 i = 0; i < count; i++) {
+        u64 x2 = samples[i] * 2;
+        buf[i] = x2 > median2 ? x2 - median2 : median2 - x2;
+    }
+    f64 mad = stats_percentile_inplace(buf, count, 0.5) / 2.0;
+    free(buf);
+    return mad;
+}
+
+
+
+/*==============================================================================
+ * Outliers
+ *============================================================================*/
+
+bool yy_stats_classify_outliers(const u64 *samples, u32 count, f64 threshold,
+                                yy_stats_outliers *outliers, i8 *classes) {
+    yy_stats_outliers out = { 0 };
+    if (!samples || !count) return false;
+    if (threshold <= 0) threshold = STATS_DEF_THRESHOLD;
+
+    out.median = yy_stats_median(samples, count);
+    out.mad = yy_stats_mad(samples, count);
+    f64 sd = out.mad * STATS_MAD_TO_SD;
+    if (sd == 0) {
+        /* more than half of the samples are same,
+           use the mean absolute deviation instead */
+        f64 sum = 0;
+        for (u32 i = 0; i < count; i++) sum += fabs((f64)samples[i] - out.median);
+        sd = sum / (f64)count * STATS_MEANAD_TO_SD;
+    }
+    out.low_fence = out.median - threshold * sd;
+    out.high_fence = out.median + threshold * sd;
+    for (u32 i = 0; i < count; i++) {
+        f64 x = (f64)samples[i];
+        i8 cls = 0;
+        if (x < out.low_fence) {
+            out.low_count++;
+            cls = -1;
+        } else if (x > out.high_fence) {
+            out.high_count++;
+            cls = 1;
+        }
+        if (classes) classes[i] = cls;
+    }
+    if (outliers) *outliers = out;
+    return true;
+}
+
+u32 yy_stats_remove_outliers(const u64 *samples, u32 count, f64 threshold,
+                             u64 *dst) {
+    yy_stats_outliers out;
+    if (!dst || !yy_stats_classify_outliers(samples, count, threshold, &out, NULL)) return 0;
+    u32 n = 0;
+    for (u32 i = 0; i < count; i++) {
+        f64 x = (f64)samples[i];
+        if (x < out.low_fence || x > out.high_fence) continue;
+        dst[n++] = samples[i];
+    }
+    return n;
+}
+
+
+
+/*==============================================================================
+ * Bootstrap
+ *============================================================================*/
+
+static bool stats_bootstrap(const u64 *samples, u32 count, f64 confidence,
+                            u32 resamples, bool median, yy_stats_ci *ci) {
+    if (!samples || !count || !ci) return false;
+    if (confidence <= 0 || confidence >= 1) confidence = STATS_DEF_CONFIDENCE;
+    if (resamples == 0) resamples = STATS_DEF_RESAMPLES;
+
+    u64 *buf = (u64 *)malloc(count * sizeof(u64));
+    f64 *ests = (f64 *)malloc(resamples * sizeof(f64));
+    if (!buf || !ests) {
+        if (buf) free(buf);
+        if (ests) free(ests);
+        return false;
+    }
+
+    yy_random_state rs;
+    yy_random_seed_r(&rs, STATS_BOOTSTRAP_SEED);
+    for (u32 r = 0; r < resamples; r++) {
+        if (median) {
+            for (u32 i = 0; i < count; i++) {
+                buf[i] = samples[yy_random32_uniform_r(&rs, count)];
+            }
+            ests[r] = stats_percentile_inplace(buf, count, 0.5);
+        } else {
+            f64 sum = 0;
+            for (u32 i = 0; i < count; i++) {
+                sum += (f64)samples[yy_random32_uniform_r(&rs, count)];
+            }
+            ests[r] = sum / (f64)count;
+        }
+    }
+    qsort(ests, resamples, sizeof(f64), stats_f64_cmp);
+
+    f64 alpha = (1.0 - confidence) / 2.0;
+    ci->estimate = median ? yy_stats_median(samples, count) : yy_stats_mean(samples, count);
+    ci->low = stats_sorted_percentile(ests, resamples, alpha);
+    ci->high = stats_sorted_percentile(ests, resamples, 1.0 - alpha);
+    ci->confidence = confidence;
+    free(buf);
+    free(ests);
+    return true;
+}
+
+bool yy_stats_bootstrap_median(const u64 *samples, u32 count, f64 confidence,
+                               u32 resamples, yy_stats_ci *ci) {
+    return stats_bootstrap(samples, count, confidence, resamples, true, ci);
+}
+
+bool yy_stats_bootstrap_mean(const u64 *samples, u32 count, f64 confidence,
+                             u32 resamples, yy_stats_ci *ci) {
+    return stats_bootstrap(samples, count, confidence, resamples, false, ci);
+}
+
+
+
+/*==============================================================================
+ * Mann-Whitney U Test
+ *============================================================================*/
+
+typedef struct {
+    u64 val;
+    bool is_a;
+} stats_rank_item;
+
+static int stats_rank_item_cmp(const void *a, const void *b) {
+    u64 x = ((const stats_rank_item *)a)->val;
+    u64 y = ((const stats_rank_item *)b)->val;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+bool yy_stats_mann_whitney(const u64 *a, u32 a_count,
+                           const u64 *b, u32 b_count, yy_stats_mwu *mwu) {
+    if (!a || !b || !a_count || !b_count || !mwu) return false;
+    u32 n = a_count + b_count;
+    stats_rank_item *items = (stats_rank_item *)malloc(n * sizeof(stats_rank_item));
+    if (!items) return false;
+    for (u32 i = 0; i < a_count; i++) {
+        items[i].val = a[i];
+        items[i].is_a = true;
+    }
+    for (u32 i = 0; i < b_count; i++) {
+        items[a_count + i].val = b[i];
+        items[a_count + i].is_a = false;
+    }
+    qsort(items, n, sizeof(stats_rank_item), stats_rank_item_cmp);
+
+    /* rank sum of a, tied values get the average rank */
+    f64 rank_sum = 0, tie_sum = 0;
+    for (u32 i = 0; i < n;) {
+        u32 j = i + 1;
+        while (j < n && items[j].val == items[i].val) j++;
+        f64 rank = (f64)(i + 1 + j) / 2.0;
+        for (u32 k = i; k < j; k++) {
+            if (items[k].is_a) rank_sum += rank;
+        }
+        f64 t = (f64)(j - i);
+        tie_sum += t * t * t - t;
+        i = j;
+    }
+    free(items);
+
+    f64 na = (f64)a_count, nb = (f64)b_count, nn = (f64)n;
+    f64 u = rank_sum - na * (na + 1) / 2.0;
+    f64 mu = na * nb / 2.0;
+    f64 var = na * nb / 12.0 * ((nn + 1) - (n > 1 ? tie_sum / (nn * (nn - 1)) : 0));
+    f64 z = 0;
+    if (var > 0) {
+        f64 diff = u - mu;
+        if (diff > 0.5) diff -= 0.5;
+        else if (diff < -0.5) diff += 0.5;
+        else diff = 0;
+        z = diff / sqrt(var);
+    }
+    mwu->u = u;
+    mwu->z = z;
+    mwu->p_value = erfc(fabs(z) / sqrt(2.0));
+    mwu->effect = u / (na * nb);
+    return true;
+}
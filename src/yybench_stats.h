@@ -0,0 +1,118 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_stats_h
+#define yybench_stats_h
+
+#include "yybench_def.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * Statistics
+
+ Robust statistics over samples, such as the ticks of each benchmark
+ repetition. The input samples are not modified.
+
+ Usage:
+
+     yy_stats_ci ci;
+     yy_stats_bootstrap_median(samples, count, 0.95, 0, &ci);
+     printf("median: %.1f [%.1f, %.1f]\n", ci.estimate, ci.low, ci.high);
+
+     yy_stats_mwu mwu;
+     yy_stats_mann_whitney(old_samples, old_count, new_samples, new_count, &mwu);
+     if (mwu.p_value < 0.01) printf("significant\n");
+
+ *============================================================================*/
+
+/** Returns the mean of samples, or 0 if count is 0. */
+f64 yy_stats_mean(const u64 *samples, u32 count);
+
+/** Returns the p-th percentile (p is in [0, 1]) of samples with linear
+    interpolation between the closest ranks, or 0 if count is 0.
+    It runs in linear time, also in the worst case (selection instead of
+    sorting). */
+f64 yy_stats_percentile(const u64 *samples, u32 count, f64 p);
+
+/** Returns the median of samples, or 0 if count is 0. */
+f64 yy_stats_median(const u64 *samples, u32 count);
+
+/** Returns the median absolute deviation: median(|x - median(x)|).
+    Multiply it by 1.4826 to estimate the standard deviation of a normal
+    distribution. */
+f64 yy_stats_mad(const u64 *samples, u32 count);
+
+/** Outliers classified by modified z-score: 0.6745 * (x - median) / MAD. */
+typedef struct yy_stats_outliers {
+    f64 median;
+    f64 mad;
+    f64 low_fence; /* samples below this are low outliers */
+    f64 high_fence; /* samples above this are high outliers */
+    u32 low_count;
+    u32 high_count;
+} yy_stats_outliers;
+
+/** Classify outliers of samples.
+    @param threshold The modified z-score threshold, 0 to use default (3.5).
+    @param outliers The result.
+    @param classes Optional, receives -1 for low outlier, 1 for high outlier
+        and 0 for others of each sample.
+    @return false if count is 0. */
+bool yy_stats_classify_outliers(const u64 *samples, u32 count, f64 threshold,
+                                yy_stats_outliers *outliers, i8 *classes);
+
+/** Copy the samples that are not outliers to dst (can be same as samples).
+    Returns the copied count. */
+u32 yy_stats_remove_outliers(const u64 *samples, u32 count, f64 threshold,
+                             u64 *dst);
+
+/** Confidence interval of an estimate. */
+typedef struct yy_stats_ci {
+    f64 estimate; /* the estimate of the samples */
+    f64 low;
+    f64 high;
+    f64 confidence; /* such as 0.95 */
+} yy_stats_ci;
+
+/** Bootstrap (percentile method) confidence interval of the median.
+    The resampling uses a fixed seed, so the result is reproducible.
+    @param confidence The confidence level, 0 to use default (0.95).
+    @param resamples The resample count, 0 to use default (2000).
+    @return false if count is 0 or out of memory. */
+bool yy_stats_bootstrap_median(const u64 *samples, u32 count, f64 confidence,
+                               u32 resamples, yy_stats_ci *ci);
+
+/** Bootstrap (percentile method) confidence interval of the mean.
+    Same as yy_stats_bootstrap_median(). */
+bool yy_stats_bootstrap_mean(const u64 *samples, u32 count, f64 confidence,
+                             u32 resamples, yy_stats_ci *ci);
+
+/** Result of Mann-Whitney U test. */
+typedef struct yy_stats_mwu {
+    f64 u; /* U statistic of sample set a */
+    f64 z; /* normal approximation with tie and continuity correction,
+              negative if a tends to be smaller than b */
+    f64 p_value; /* two-sided p-value */
+    f64 effect; /* probability that a sample of a is greater than a sample of
+                   b (ties count half), 0.5 if no difference */
+} yy_stats_mwu;
+
+/** Mann-Whitney U test (Wilcoxon rank-sum test) of two sample sets,
+    to check whether one tends to be greater than the other without
+    assumption of normal distribution.
+    @return false if a set is empty or out of memory. */
+bool yy_stats_mann_whitney(const u64 *a, u32 a_count,
+                           const u64 *b, u32 b_count, yy_stats_mwu *mwu);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,321 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_sym.h"
+#include "yybench_file.h"
+#include "yybench_str.h"
+
+#if defined(__linux__) && yy_has_include(<elf.h>)
+#define YY_SYM_AVAILABLE 1
+#include <elf.h>
+#else
+#define YY_SYM_AVAILABLE 0
+#endif
+
+#if YY_SYM_AVAILABLE
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define SYM_ELF_CLASS ELFCLASS64
+#define SYM_ST_TYPE(info) ELF64_ST_TYPE(info)
+typedef Elf64_Ehdr sym_ehdr;
+typedef Elf64_Phdr sym_phdr;
+typedef Elf64_Shdr sym_shdr;
+typedef Elf64_Sym sym_elf_sym;
+#else
+#define SYM_ELF_CLASS ELFCLASS32
+#define SYM_ST_TYPE(info) ELF32_ST_TYPE(info)
+typedef Elf32_Ehdr sym_ehdr;
+typedef Elf32_Phdr sym_phdr;
+typedef Elf32_Shdr sym_shdr;
+typedef Elf32_Sym sym_elf_sym;
+#endif
+
+/* A function symbol, addr is the virtual address in the ELF file. */
+typedef struct {
+    u64 addr;
+    u64 size;
+    u32 name; /* offset in module names */
+} sym_func;
+
+/* A loadable segment of the ELF file. */
+typedef struct {
+    u64 offset;
+    u64 vaddr;
+    u64 filesz;
+} sym_seg;
+
+/* A mapped file, the symbols are loaded on first lookup. */
+typedef struct {
+    char *path;
+    bool loaded;
+    sym_func *funcs;
+    u32 func_count;
+    char *names;
+    sym_seg *segs;
+    u32 seg_count;
+} sym_module;
+
+/* An executable mapping. */
+typedef struct {
+    u64 start;
+    u64 end;
+    u64 offset;
+    u32 module;
+} sym_map;
+
+struct yy_sym {
+    sym_map *maps;
+    u32 map_count;
+    sym_module *modules;
+    u32 module_count;
+};
+
+
+
+/*==============================================================================
+ * ELF
+ *============================================================================*/
+
+static int sym_func_cmp(const void *a, const void *b) {
+    u64 x = ((const sym_func *)a)->addr;
+    u64 y = ((const sym_func *)b)->addr;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Find a section by type, returns NULL if not found. */
+static const sym_shdr *sym_find_section(const u8 *dat, usize len, u32 type) {
+    const sym_ehdr *eh = (const sym_ehdr *)dat;
+    if (eh->e_shoff == 0 || eh->e_shentsize != sizeof(sym_shdr)) return NULL;
+    if (eh->e_shoff + (u64)eh->e_shnum * sizeof(sym_shdr) > len) return NULL;
+    const sym_shdr *sh = (const sym_shdr *)(dat + eh->e_shoff);
+    for (u32 i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type == type) return sh + i;
+    }
+    return NULL;
+}
+
+/* Read the loadable segments and the function symbols of an ELF file. */
+static bool sym_module_load(sym_module *mod) {
+    u8 *dat = NULL;
+    usize len = 0;
+    const sym_ehdr *eh;
+    const sym_shdr *symtab, *strtab;
+    bool suc = false;
+
+    mod->loaded = true;
+    if (mod->path[0] != '/') return false; /* [vdso], [anon] */
+    if (!yy_file_read(mod->path, &dat, &len)) return false;
+    if (len < sizeof(sym_ehdr)) goto done;
+    eh = (const sym_ehdr *)dat;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0) goto done;
+    if (eh->e_ident[EI_CLASS] != SYM_ELF_CLASS) goto done;
+
+    /* segments, used to convert file offset to virtual address */
+    if (eh->e_phentsize != sizeof(sym_phdr)) goto done;
+    if (eh->e_phoff + (u64)eh->e_phnum * sizeof(sym_phdr) > len) goto done;
+    const sym_phdr *ph = (const sym_phdr *)(dat + eh->e_phoff);
+    mod->segs = (sym_seg *)calloc(eh->e_phnum ? eh->e_phnum : 1, sizeof(sym_seg));
+    if (!mod->segs) goto done;
+    for (u32 i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD) continue;
+        sym_seg *seg = mod->segs + mod->seg_count++;
+        seg->offset = ph[i].p_offset;
+        seg->vaddr = ph[i].p_vaddr;
+        seg->filesz = ph[i].p_filesz;
+    }
+
+    /* function symbols, .dynsym is used if the file is stripped */
+    symtab = sym_find_section(dat, len, SHT_SYMTAB);
+    if (!symtab) symtab = sym_find_section(dat, len, SHT_DYNSYM);
+    if (!symtab) {
+        suc = true;
+        goto done;
+    }
+    if (symtab->sh_link >= eh->e_shnum) goto done;
+    strtab = (const sym_shdr *)(dat + eh->e_shoff) + symtab->sh_link;
+    if (symtab->sh_offset + symtab->sh_size > len) goto done;
+    if (strtab->sh_offset + strtab->sh_size > len || strtab->sh_size == 0) goto done;
+
+    usize sym_count = (usize)(symtab->sh_size / sizeof(sym_elf_sym));
+    const sym_elf_sym *syms = (const sym_elf_sym *)(dat + symtab->sh_offset);
+    mod->funcs = (sym_func *)calloc(sym_count ? sym_count : 1, sizeof(sym_func));
+    mod->names = (char *)malloc((usize)strtab->sh_size + 1);
+    if (!mod->funcs || !mod->names) goto done;
+    memcpy(mod->names, dat + strtab->sh_offset, (usize)strtab->sh_size);
+    mod->names[strtab->sh_size] = '\0';
+    for (usize i = 0; i < sym_count; i++) {
+        const sym_elf_sym *s = syms + i;
+        u32 type = SYM_ST_TYPE(s->st_info);
+        if (type != STT_FUNC && type != STT_GNU_IFUNC) continue;
+        if (s->st_shndx == SHN_UNDEF || s->st_value == 0) continue;
+        if (s->st_name >= strtab->sh_size) continue;
+        sym_func *func = mod->funcs + mod->func_count++;
+        func->addr = s->st_value;
+        func->size = s->st_size;
+        func->name = s->st_name;
+    }
+    qsort(mod->funcs, mod->func_count, sizeof(sym_func), sym_func_cmp);
+    suc = true;
+
+done:
+    free(dat);
+    return suc;
+}
+
+/* Find the function contains the virtual address, or NULL. */
+static const sym_func *sym_module_find(const sym_module *mod, u64 vaddr) {
+    u32 lo = 0, hi = mod->func_count;
+    while (lo < hi) { /* first function with addr > vaddr */
+        u32 mid = lo + (hi - lo) / 2;
+        if (mod->funcs[mid].addr <= vaddr) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return NULL;
+    const sym_func *func = mod->funcs + lo - 1;
+    /* a symbol without size extends to the next symbol */
+    if (func->size && vaddr >= func->addr + func->size) return NULL;
+    return func;
+}
+
+
+
+/*==============================================================================
+ * Symbolizer
+ *============================================================================*/
+
+static u32 sym_add_module(yy_sym *sym, const char *path, u32 *capacity) {
+    for (u32 i = 0; i < sym->module_count; i++) {
+        if (strcmp(sym->modules[i].path, path) == 0) return i;
+    }
+    if (sym->module_count >= *capacity) {
+        u32 cap = *capacity ? *capacity * 2 : 16;
+        sym_module *modules = realloc(sym->modules, cap * sizeof(sym_module));
+        if (!modules) return (u32)-1;
+        sym->modules = modules;
+        *capacity = cap;
+    }
+    sym_module *mod = sym->modules + sym->module_count;
+    memset(mod, 0, sizeof(sym_module));
+    mod->path = yy_str_copy(path);
+    if (!mod->path) return (u32)-1;
+    return sym->module_count++;
+}
+
+yy_sym *yy_sym_new(void) {
+    yy_dat dat;
+    char *line;
+    usize len;
+    u32 map_capacity = 0, module_capacity = 0;
+
+    yy_sym *sym = (yy_sym *)calloc(1, sizeof(yy_sym));
+    if (!sym) return NULL;
+    if (!yy_dat_init_with_file(&dat, "/proc/self/maps")) {
+        free(sym);
+        return NULL;
+    }
+    /* line: start-end perms offset dev inode path */
+    while ((line = yy_dat_copy_line(&dat, &len))) {
+        unsigned long long start, end, offset;
+        char perms[8];
+        int path_pos = 0;
+        bool added = false;
+        if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n",
+                   &start, &end, perms, &offset, &path_pos) >= 4 &&
+            strchr(perms, 'x')) {
+            const char *path = path_pos ? line + path_pos : "";
+            if (!*path) path = "[anon]";
+            u32 mod = sym_add_module(sym, path, &module_capacity);
+            if (mod != (u32)-1 && sym->map_count >= map_capacity) {
+                u32 cap = map_capacity ? map_capacity * 2 : 64;
+                sym_map *maps = realloc(sym->maps, cap * sizeof(sym_map));
+                if (maps) {
+                    sym->maps = maps;
+                    map_capacity = cap;
+                }
+            }
+            if (mod != (u32)-1 && sym->map_count < map_capacity) {
+                sym_map *map = sym->maps + sym->map_count++;
+                map->start = start;
+                map->end = end;
+                map->offset = offset;
+                map->module = mod;
+                added = true;
+            }
+            if (!added) {
+                free(line);
+                yy_dat_release(&dat);
+                yy_sym_free(sym);
+                return NULL;
+            }
+        }
+        free(line);
+    }
+    yy_dat_release(&dat);
+    return sym;
+}
+
+void yy_sym_free(yy_sym *sym) {
+    if (!sym) return;
+    for (u32 i = 0; i < sym->module_count; i++) {
+        sym_module *mod = sym->modules + i;
+        if (mod->path) free(mod->path);
+        if (mod->funcs) free(mod->funcs);
+        if (mod->names) free(mod->names);
+        if (mod->segs) free(mod->segs);
+    }
+    if (sym->modules) free(sym->modules);
+    if (sym->maps) free(sym->maps);
+    free(sym);
+}
+
+bool yy_sym_lookup(yy_sym *sym, u64 addr, yy_sym_info *info) {
+    if (!sym || !info) return false;
+    memset(info, 0, sizeof(yy_sym_info));
+
+    /* the mappings are sorted by address in /proc/self/maps */
+    u32 lo = 0, hi = sym->map_count;
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (sym->maps[mid].end <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo >= sym->map_count || addr < sym->maps[lo].start) return false;
+    const sym_map *map = sym->maps + lo;
+    sym_module *mod = sym->modules + map->module;
+    u64 file_ofs = addr - map->start + map->offset;
+    info->module = mod->path;
+    info->offset = file_ofs;
+
+    if (!mod->loaded) sym_module_load(mod);
+    for (u32 i = 0; i < mod->seg_count; i++) {
+        const sym_seg *seg = mod->segs + i;
+        if (file_ofs < seg->offset || file_ofs >= seg->offset + seg->filesz) continue;
+        u64 vaddr = file_ofs - seg->offset + seg->vaddr;
+        const sym_func *func = sym_module_find(mod, vaddr);
+        if (func) {
+            info->name = mod->names + func->name;
+            info->offset = vaddr - func->addr;
+        }
+        break;
+    }
+    return true;
+}
+
+#else
+
+yy_sym *yy_sym_new(void) {
+    return NULL;
+}
+
+void yy_sym_free(yy_sym *sym) {
+
+}
+
+bool yy_sym_lookup(yy_sym *sym, u64 addr, yy_sym_info *info) {
+    if (info) memset(info, 0, sizeof(yy_sym_info));
+    return false;
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_sym_h
+#define yybench_sym_h
+
+#include "yybench_def.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * Symbolizer
+
+ Map code addresses of current process to the mapped file and the function
+ symbol. The executable mappings are read from /proc/self/maps, and the
+ symbols are read from the ELF symbol table (.symtab, or .dynsym if the file
+ is stripped) of each mapped file on first lookup.
+
+ It's available on Linux only.
+
+ Usage:
+
+     yy_sym *sym = yy_sym_new();
+     yy_sym_info info;
+     if (yy_sym_lookup(sym, (u64)(usize)addr, &info)) {
+         printf("%s+0x%llx (%s)\n", info.name ? info.name : "??",
+                info.offset, info.module);
+     }
+     yy_sym_free(sym);
+
+ *============================================================================*/
+
+/** Symbol information of an address. */
+typedef struct yy_sym_info {
+    const char *module; /* path of the mapped file, such as "[vdso]" */
+    const char *name; /* function name, NULL if not found */
+    u64 offset; /* offset from the function start, or the file offset
+                   if the function is not found */
+} yy_sym_info;
+
+/** A symbolizer. */
+typedef struct yy_sym yy_sym;
+
+/** Creates a symbolizer with the executable mappings of current process.
+    The code loaded after this call (such as dlopen) is not included.
+    Returns NULL if it's not supported. */
+yy_sym *yy_sym_new(void);
+
+/** Free the symbolizer. */
+void yy_sym_free(yy_sym *sym);
+
+/** Lookup an address. The strings in info are owned by the symbolizer.
+    Returns false if the address is not in an executable mapping. */
+bool yy_sym_lookup(yy_sym *sym, u64 addr, yy_sym_info *info);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_thread.h"
+#include "yybench_cpu.h"
+#include "yybench_topo.h"
+
+
+
+/*==============================================================================
+ * Spin Barrier
+ *============================================================================*/
+
+void yy_spin_barrier_init(yy_spin_barrier *barrier, u32 total) {
+    memset(barrier, 0, sizeof(yy_spin_barrier));
+    barrier->total = total;
+}
+
+bool yy_spin_barrier_wait(yy_spin_barrier *barrier) {
+#if !defined(_WIN32)
+    u32 gen = __atomic_load_n(&barrier->gen, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&barrier->aborted, __ATOMIC_ACQUIRE)) return false;
+    if (barrier->total <= 1) return true;
+    if (__atomic_add_fetch(&barrier->count, 1, __ATOMIC_ACQ_REL) == barrier->total) {
+        __atomic_store_n(&barrier->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&barrier->gen, gen + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+    /* no pause instruction, it delays the wakeup and increases skew */
+    u32 spin = 0;
+    while (__atomic_load_n(&barrier->gen, __ATOMIC_ACQUIRE) == gen) {
+        if (__atomic_load_n(&barrier->aborted, __ATOMIC_ACQUIRE)) return false;
+        /* yield when threads are more than cpus */
+        if (++spin >= 4096) {
+            spin = 0;
+            sched_yield();
+        }
+    }
+    return true;
+#else
+    return !barrier->aborted;
+#endif
+}
+
+void yy_spin_barrier_abort(yy_spin_barrier *barrier) {
+#if !defined(_WIN32)
+    __atomic_store_n(&barrier->aborted, true, __ATOMIC_RELEASE);
+#else
+    barrier->aborted = true;
+#endif
+}
+
+bool yy_spin_barrier_is_aborted(yy_spin_barrier *barrier) {
+#if !defined(_WIN32)
+    return __atomic_load_n(&barrier->aborted, __ATOMIC_ACQUIRE);
+#else
+    return barrier->aborted;
+#endif
+}
+
+
+
+/*==============================================================================
+ * CPU Order
+ *============================================================================*/
+
+u32 yy_thread_get_cpu_order(int *cpus, u32 max) {
+    u32 count = yy_topo_get_cpu_count();
+    u32 *ranks;
+    bool *used;
+    u32 n = 0;
+
+    if (!count) return 0;
+    ranks = (u32 *)calloc(count, sizeof(u32));
+    used = (bool *)calloc(count, sizeof(bool));
+    if (!ranks || !used) {
+        if (ranks) free(ranks);
+        if (used) free(used);
+        return 0;
+    }
+
+    /* rank of each allowed cpu in its (node, smt) group */
+    for (u32 i = 0; i < count; i++) {
+        const yy_topo_cpu *cpu = yy_topo_get_cpu(i);
+        used[i] = !yy_cpu_is_allowed(cpu->id);
+        if (used[i]) continue;
+        for (u32 j = 0; j < i; j++) {
+            const yy_topo_cpu *prev = yy_topo_get_cpu(j);
+            if (!used[j] && prev->node == cpu->node && prev->smt == cpu->smt) ranks[i]++;
+        }
+    }
+
+    /* order by (smt, rank, node) with selection, the count is small */
+    while (n < max) {
+        u32 best = count;
+        for (u32 i = 0; i < count; i++) {
+            if (used[i]) continue;
+            if (best == count) {
+                best = i;
+                continue;
+            }
+            const yy_topo_cpu *c1 = yy_topo_get_cpu(i);
+            const yy_topo_cpu *c2 = yy_topo_get_cpu(best);
+            if (c1->smt != c2->smt) {
+                if (c1->smt < c2->smt) best = i;
+            } else if (ranks[i] != ranks[best]) {
+                if (ranks[i] < ranks[best]) best = i;
+            } else if (c1->node < c2->node) {
+                best = i;
+            }
+        }
+        if (best == count) break;
+        used[best] = true;
+        cpus[n++] = yy_topo_get_cpu(best)->id;
+    }
+    free(used);
+    free(ranks);
+    return n;
+}
+
+u32 yy_thread_get_cpu_count(void) {
+    u32 count = yy_topo_get_cpu_count();
+    u32 n = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (yy_cpu_is_allowed(yy_topo_get_cpu(i)->id)) n++;
+    }
+    return n;
+}
+
+u32 yy_thread_get_core_count(void) {
+    u32 count = yy_topo_get_cpu_count();
+    u32 n = 0;
+    for (u32 i = 0; i < count; i++) {
+        const yy_topo_cpu *cpu = yy_topo_get_cpu(i);
+        if (!yy_cpu_is_allowed(cpu->id)) continue;
+        bool dup = false;
+        for (u32 j = 0; j < i && !dup; j++) {
+            const yy_topo_cpu *prev = yy_topo_get_cpu(j);
+            dup = prev->core == cpu->core && yy_cpu_is_allowed(prev->id);
+        }
+        if (!dup) n++;
+    }
+    return n;
+}
+
+
+
+/*==============================================================================
+ * Runner
+ *============================================================================*/
+
+typedef struct {
+    yy_thread_func func;
+    void *ctx;
+    u32 index;
+    int cpu; /* cpu to pin, -1 to not pin */
+    bool pinned;
+} thread_worker;
+
+static void thread_worker_run(thread_worker *worker) {
+    yy_cpu_pin_scope scope;
+    if (worker->cpu >= 0) worker->pinned = yy_cpu_pin_scope_begin(&scope, worker->cpu);
+    worker->func(worker->ctx, worker->index);
+    if (worker->pinned) yy_cpu_pin_scope_end(&scope);
+}
+
+#if !defined(_WIN32)
+static void *thread_worker_entry(void *arg) {
+    thread_worker_run((thread_worker *)arg);
+    return NULL;
+}
+#endif
+
+bool yy_thread_run(u32 thread_count, yy_thread_func func, void *ctx,
+                   yy_spin_barrier *barrier, u32 *unpinned_count) {
+    thread_worker *workers;
+    int *cpus;
+    u32 cpu_count;
+    bool suc = true;
+
+    if (unpinned_count) *unpinned_count = 0;
+    if (!func || thread_count < 1) return false;
+#if defined(_WIN32)
+    if (thread_count > 1) return false;
+#endif
+    workers = (thread_worker *)calloc(thread_count, sizeof(thread_worker));
+    cpus = (int *)calloc(thread_count, sizeof(int));
+    if (!workers || !cpus) {
+        if (workers) free(workers);
+        if (cpus) free(cpus);
+        return false;
+    }
+    cpu_count = yy_thread_get_cpu_order(cpus, thread_count);
+    for (u32 i = 0; i < thread_count; i++) {
+        workers[i].func = func;
+        workers[i].ctx = ctx;
+        workers[i].index = i;
+        workers[i].cpu = cpu_count ? cpus[i % cpu_count] : -1;
+    }
+
+#if defined(_WIN32)
+    thread_worker_run(workers);
+#else
+    pthread_t *threads = (pthread_t *)calloc(thread_count, sizeof(pthread_t));
+    u32 created = 1;
+    if (!threads) suc = false;
+    for (u32 i = 1; suc && i < thread_count; i++) {
+        if (pthread_create(&threads[i], NULL, thread_worker_entry, &workers[i]) != 0) {
+            suc = false;
+            break;
+        }
+        created++;
+    }
+    if (suc) {
+        thread_worker_run(workers);
+    } else if (created > 1 && barrier) {
+        /* release the created threads from the barriers */
+        yy_spin_barrier_abort(barrier);
+    }
+    for (u32 i = 1; i < created; i++) pthread_join(threads[i], NULL);
+    if (threads) free(threads);
+#endif
+
+    if (suc && unpinned_count) {
+        for (u32 i = 0; i < thread_count; i++) {
+            if (!workers[i].pinned) (*unpinned_count)++;
+        }
+    }
+    free(workers);
+    free(cpus);
+    return suc;
+}
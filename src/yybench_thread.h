@@ -0,0 +1,91 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_thread_h
+#define yybench_thread_h
+
+#include "yybench_def.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * Pinned Threads (internal)
+
+ The threads shared by the parallel runners (yy_bench_run_parallel() and
+ yy_mem_measure_bandwidth()), not included by yybench.h:
+ 1. The threads are pinned to the cpus allowed by the affinity or cpuset, one
+    hardware thread of each core first, interleaved across NUMA nodes.
+ 2. The thread function runs after the thread is pinned, so the memory first
+    touched by the function is allocated on the local node.
+ 3. The threads are synchronized with a spin barrier, which can be aborted if
+    a thread fails or cannot be created.
+ Multiple threads are not supported on Windows.
+ *============================================================================*/
+
+/** A spin barrier, the arrival counter and the generation are in different
+    cache lines (128 bytes, for adjacent line prefetch), so the arrivals do not
+    disturb the spinning threads, and the release is a single store observed
+    by all threads. */
+typedef struct yy_spin_barrier {
+    volatile u32 count;
+    u8 pad1[128 - sizeof(u32)];
+    volatile u32 gen;
+    u8 pad2[128 - sizeof(u32)];
+    u32 total;
+    volatile bool aborted; /* release all waiting and later threads */
+} yy_spin_barrier;
+
+/** Init the barrier for a thread count. */
+void yy_spin_barrier_init(yy_spin_barrier *barrier, u32 total);
+
+/** Wait for all threads to arrive.
+    Returns false if the barrier is aborted. */
+bool yy_spin_barrier_wait(yy_spin_barrier *barrier);
+
+/** Release the threads waiting in the barrier, the later waits return false
+    immediately, the total is not changed while threads are waiting. */
+void yy_spin_barrier_abort(yy_spin_barrier *barrier);
+
+/** Whether the barrier is aborted. */
+bool yy_spin_barrier_is_aborted(yy_spin_barrier *barrier);
+
+/** Get the cpu order to pin threads: one hardware thread of each core first,
+    interleaved across NUMA nodes, the cpus excluded by the affinity or cpuset
+    are skipped. Returns the cpu count (0 if unknown). */
+u32 yy_thread_get_cpu_order(int *cpus, u32 max);
+
+/** Returns the count of cpus allowed by the affinity or cpuset,
+    or 0 if unknown. */
+u32 yy_thread_get_cpu_count(void);
+
+/** Returns the count of cores allowed by the affinity or cpuset,
+    or 0 if unknown. */
+u32 yy_thread_get_core_count(void);
+
+/** A thread function, the index is from 0 to thread_count - 1. */
+typedef void (*yy_thread_func)(void *ctx, u32 index);
+
+/** Run a function on pinned threads, the calling thread is thread 0.
+    Thread i is pinned to the i-th cpu of yy_thread_get_cpu_order() (wrapped
+    if threads are more than cpus), and the previous affinity is restored
+    after the function returns.
+    If a thread cannot be created, the barrier is aborted (the function should
+    stop when a wait returns false), and the created threads are joined.
+    @param barrier The barrier used by the function, can be NULL.
+    @param unpinned_count Receives the count of threads which are not pinned,
+        can be NULL.
+    @return false if a thread cannot be created or out of memory. */
+bool yy_thread_run(u32 thread_count, yy_thread_func func, void *ctx,
+                   yy_spin_barrier *barrier, u32 *unpinned_count);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,3 +4,155 @@
  *============================================================================*/
 
 #include "yybench_time.h"
+
+
+/*==============================================================================
+ * Clock Source
+ *============================================================================*/
+
+yy_time_clock yy_time_clock_selected = YY_TIME_CLOCK_DEFAULT;
+
+bool yy_time_set_clock(yy_time_clock clock) {
+    if (!yy_time_clock_available(clock)) return false;
+    yy_time_clock_selected = clock;
+    return true;
+}
+
+yy_time_clock yy_time_get_clock(void) {
+    return yy_time_clock_selected;
+}
+
+bool yy_time_clock_available(yy_time_clock clock) {
+#if defined(_WIN32)
+    return clock == YY_TIME_CLOCK_DEFAULT;
+#else
+    switch (clock) {
+        case YY_TIME_CLOCK_DEFAULT: return true;
+        case YY_TIME_CLOCK_WALL: return true;
+#   if YY_TIME_HAS_MONOTONIC
+        case YY_TIME_CLOCK_MONOTONIC: return true;
+#   endif
+#   if YY_TIME_HAS_MONOTONIC_RAW
+        case YY_TIME_CLOCK_MONOTONIC_RAW: return true;
+#   endif
+        default: return false;
+    }
+#endif
+}
+
+/* Returns (t2 - t1) in nanoseconds. */
+static f64 yy_time_diff_ns(yy_time *t1, yy_time *t2) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    return (f64)(t2->counter.QuadPart - t1->counter.QuadPart) *
+           1000.0 * 1000.0 * 1000.0 / (f64)freq.QuadPart;
+#else
+    return (f64)(t2->now.tv_sec - t1->now.tv_sec) * 1000.0 * 1000.0 * 1000.0 +
+           (f64)(t2->now.tv_nsec - t1->now.tv_nsec);
+#endif
+}
+
+bool yy_time_get_clock_info(yy_time_clock clock, yy_time_clock_info *info) {
+#define precision_count 1024
+#define cost_count 16384
+    yy_time t1, t2;
+    f64 ns, min;
+    
+    if (!info) return false;
+    memset(info, 0, sizeof(yy_time_clock_info));
+    if (!yy_time_clock_available(clock)) return false;
+    
+    /* name and resolution reported by OS */
+#if defined(_WIN32)
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    info->name = "QueryPerformanceCounter";
+    info->resolution = 1000.0 * 1000.0 * 1000.0 / (f64)freq.QuadPart;
+#else
+    struct timespec res = { 0 };
+    switch (clock) {
+#   if YY_TIME_HAS_MONOTONIC_RAW
+        case YY_TIME_CLOCK_DEFAULT:
+        case YY_TIME_CLOCK_MONOTONIC_RAW:
+            info->name = "CLOCK_MONOTONIC_RAW";
+            clock_getres(CLOCK_MONOTONIC_RAW, &res);
+            break;
+        case YY_TIME_CLOCK_MONOTONIC:
+            info->name = "CLOCK_MONOTONIC";
+            clock_getres(CLOCK_MONOTONIC, &res);
+            break;
+#   elif YY_TIME_HAS_MONOTONIC
+        case YY_TIME_CLOCK_DEFAULT:
+        case YY_TIME_CLOCK_MONOTONIC:
+            info->name = "CLOCK_MONOTONIC";
+            clock_getres(CLOCK_MONOTONIC, &res);
+            break;
+#   endif
+        default:
+            info->name = "gettimeofday";
+            res.tv_nsec = 1000;
+            break;
+    }
+    info->resolution = (f64)res.tv_sec * 1000.0 * 1000.0 * 1000.0 +
+                       (f64)res.tv_nsec;
+#endif
+    
+    /* minimum observed step between two different readings */
+    min = 0;
+    for (int i = 0; i < precision_count; i++) {
+        yy_time_get_current_with_clock(&t1, clock);
+        do {
+            yy_time_get_current_with_clock(&t2, clock);
+            ns = yy_time_diff_ns(&t1, &t2);
+        } while (ns == 0);
+        if (ns > 0 && (min == 0 || ns < min)) min = ns;
+    }
+    info->precision = min;
+    
+    /* average cost of one reading */
+    yy_time_get_current_with_clock(&t1, clock);
+    for (int i = 0; i < cost_count; i++) {
+        yy_time_get_current_with_clock(&t2, clock);
+    }
+    info->read_cost = yy_time_diff_ns(&t1, &t2) / cost_count;
+    return true;
+#undef precision_count
+#undef cost_count
+}
+
+
+/*==============================================================================
+ * Timer
+ *============================================================================*/
+
+
+u64 yy_time_get_ticks_overhead(void) {
+#define warmup_count 64
+#define measure_count 4096
+    static u64 overhead = 0;
+    static bool measured = false;
+    if (measured) return overhead;
+    
+    /* warm up the instruction cache and branch predictor */
+    for (int i = 0; i < warmup_count; i++) {
+        u64 t1 = yy_time_get_ticks_begin();
+        u64 t2 = yy_time_get_ticks_end();
+        (void)t1; (void)t2;
+    }
+    
+    /* the minimum value is the fixed cost, larger values are caused by
+       interrupts, context switching, etc. */
+    u64 min = (u64)-1;
+    for (int i = 0; i < measure_count; i++) {
+        u64 t1 = yy_time_get_ticks_begin();
+        u64 t2 = yy_time_get_ticks_end();
+        u64 ticks = t2 - t1;
+        if (ticks < min) min = ticks;
+    }
+    overhead = min;
+    measured = true;
+    return overhead;
+#undef warmup_count
+#undef measure_count
+}
@@ -20,30 +20,101 @@ extern "C" {
 /** Structure holding a timestamp. */
 typedef struct yy_time yy_time;
 
-/** Get current wall time to a structure. */
+/** Clock source of the timestamp. */
+typedef enum yy_time_clock {
+    /* The best available clock source: CLOCK_MONOTONIC_RAW or CLOCK_MONOTONIC
+       on POSIX, QueryPerformanceCounter on Windows. */
+    YY_TIME_CLOCK_DEFAULT = 0,
+    
+    /* Wall clock (gettimeofday), microsecond resolution,
+       may jump when the system time is adjusted. */
+    YY_TIME_CLOCK_WALL,
+    
+    /* CLOCK_MONOTONIC, nanosecond resolution,
+       the rate may be adjusted by NTP. */
+    YY_TIME_CLOCK_MONOTONIC,
+    
+    /* CLOCK_MONOTONIC_RAW, nanosecond resolution,
+       not affected by NTP adjustment. */
+    YY_TIME_CLOCK_MONOTONIC_RAW,
+} yy_time_clock;
+
+/** Clock source information. */
+typedef struct yy_time_clock_info {
+    const char *name; /* clock name, such as "CLOCK_MONOTONIC" */
+    f64 resolution; /* resolution reported by OS, in nanoseconds */
+    f64 precision; /* minimum observed non-zero step, in nanoseconds */
+    f64 read_cost; /* average cost of one read, in nanoseconds */
+} yy_time_clock_info;
+
+/** Set the clock source used by yy_time_get_current().
+    Returns false if the clock source is not available on this platform. */
+bool yy_time_set_clock(yy_time_clock clock);
+
+/** Returns the clock source used by yy_time_get_current(). */
+yy_time_clock yy_time_get_clock(void);
+
+/** Returns whether a clock source is available on this platform. */
+bool yy_time_clock_available(yy_time_clock clock);
+
+/** Get the resolution and read cost of a clock source.
+    This function may take several milliseconds.
+    Returns false if the clock source is not available on this platform. */
+bool yy_time_get_clock_info(yy_time_clock clock, yy_time_clock_info *info);
+
+/** Get current time to a structure, with the clock source selected by
+    yy_time_set_clock() (default is YY_TIME_CLOCK_DEFAULT). */
 static yy_inline void yy_time_get_current(yy_time *t);
 
+/** Get current time to a structure, with a specified clock source.
+    The clock source should be available on this platform. */
+static yy_inline void yy_time_get_current_with_clock(yy_time *t,
+                                                     yy_time_clock clock);
+
 /** Convert time structure to seconds. */
 static yy_inline f64 yy_time_to_seconds(yy_time *t);
 
-/** Get current wall time in seconds. */
+/** Get current time in seconds. */
 static yy_inline f64 yy_time_get_seconds(void);
 
 /** A high-resolution, low-overhead, fixed-frequency timer for benchmark. */
 static yy_inline u64 yy_time_get_ticks(void);
 
+/** Same as yy_time_get_ticks(), but serialized for the beginning of a measured
+    region: previous instructions are completed before the timer is read, and
+    the following instructions are not started before the timer is read. */
+static yy_inline u64 yy_time_get_ticks_begin(void);
+
+/** Same as yy_time_get_ticks(), but serialized for the end of a measured
+    region: all instructions of the region are completed before the timer is
+    read, and the following instructions are not started before it. */
+static yy_inline u64 yy_time_get_ticks_end(void);
+
+/** Returns the fixed cost of an empty yy_time_get_ticks_begin()/end() pair.
+    The value is measured on first call and cached, it should be subtracted
+    from (end - begin) to get the ticks of the measured region. */
+u64 yy_time_get_ticks_overhead(void);
+
+/** Returns (end - begin - overhead), or 0 if the result would be negative. */
+static yy_inline u64 yy_time_ticks_elapsed(u64 begin, u64 end);
+
 
 /*==============================================================================
  * Timer (Private)
  *============================================================================*/
 
+/* The clock source selected by yy_time_set_clock(), do not modify it. */
+extern yy_time_clock yy_time_clock_selected;
+
 #if defined(_WIN32)
 
 struct yy_time {
     LARGE_INTEGER counter;
 };
 
-static yy_inline void yy_time_get_current(yy_time *t) {
+static yy_inline void yy_time_get_current_with_clock(yy_time *t,
+                                                     yy_time_clock clock) {
+    (void)clock;
     QueryPerformanceCounter(&t->counter);
 }
 
@@ -55,20 +126,60 @@ static yy_inline f64 yy_time_to_seconds(yy_time *t) {
 
 #else
 
+#include <time.h>
+
+#ifndef YY_TIME_HAS_MONOTONIC
+#   if defined(CLOCK_MONOTONIC)
+#       define YY_TIME_HAS_MONOTONIC 1
+#   endif
+#endif
+
+#ifndef YY_TIME_HAS_MONOTONIC_RAW
+#   if YY_TIME_HAS_MONOTONIC && defined(CLOCK_MONOTONIC_RAW)
+#       define YY_TIME_HAS_MONOTONIC_RAW 1
+#   endif
+#endif
+
 struct yy_time {
-    struct timeval now;
+    struct timespec now;
 };
 
-static yy_inline void yy_time_get_current(yy_time *t) {
-    gettimeofday(&t->now, NULL);
+static yy_inline void yy_time_get_current_with_clock(yy_time *t,
+                                                     yy_time_clock clock) {
+    struct timeval tv;
+    switch (clock) {
+#if YY_TIME_HAS_MONOTONIC_RAW
+        case YY_TIME_CLOCK_DEFAULT:
+        case YY_TIME_CLOCK_MONOTONIC_RAW:
+            clock_gettime(CLOCK_MONOTONIC_RAW, &t->now);
+            return;
+        case YY_TIME_CLOCK_MONOTONIC:
+            clock_gettime(CLOCK_MONOTONIC, &t->now);
+            return;
+#elif YY_TIME_HAS_MONOTONIC
+        case YY_TIME_CLOCK_DEFAULT:
+        case YY_TIME_CLOCK_MONOTONIC:
+            clock_gettime(CLOCK_MONOTONIC, &t->now);
+            return;
+#endif
+        default:
+            gettimeofday(&tv, NULL);
+            t->now.tv_sec = tv.tv_sec;
+            t->now.tv_nsec = (long)tv.tv_usec * 1000;
+            return;
+    }
 }
 
 static yy_inline f64 yy_time_to_seconds(yy_time *t) {
-    return (f64)t->now.tv_sec + (f64)t->now.tv_usec / 1000.0 / 1000.0;
+    return (f64)t->now.tv_sec + (f64)t->now.tv_nsec / 1000.0 / 1000.0 / 1000.0;
 }
 
 #endif
 
+static yy_inline void yy_time_get_current(yy_time *t) {
+    yy_time_get_current_with_clock(t, yy_time_clock_selected);
+}
+
 static yy_inline f64 yy_time_get_seconds(void) {
     yy_time t;
     yy_time_get_current(&t);
@@ -144,6 +255,88 @@ defined(__amd64__) || defined(__amd64)
 #endif
 }
 
+/*
+ LFENCE waits for all previous instructions to complete locally, and later
+ instructions do not begin execution until LFENCE completes. RDTSCP waits for
+ all previous instructions to be executed, but later instructions may still
+ begin before it reads the counter, so a LFENCE is required after it.
+ On AArch64, ISB flushes the pipeline, so the counter read can not be executed
+ speculatively out of order.
+ See: Intel "How to Benchmark Code Execution Times on Intel IA-32 and IA-64
+ Instruction Set Architectures", and Arm ARM "Reading the Generic Timer".
+ */
+static yy_inline u64 yy_time_get_ticks_begin(void) {
+#if defined(_WIN32) && (defined(_M_IX86) || defined(_M_AMD64))
+    u64 tsc;
+    _mm_lfence();
+    tsc = __rdtsc();
+    _mm_lfence();
+    return tsc;
+    
+#elif defined(__i386__) || defined(__i386)
+    u64 tsc;
+    __asm volatile("lfence\n\trdtsc\n\tlfence" : "=A"(tsc) :: "memory");
+    return tsc;
+    
+#elif defined(__x86_64__) || defined(__x86_64) || \
+defined(__amd64__) || defined(__amd64)
+    u64 lo, hi;
+    __asm volatile("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi) :: "memory");
+    return (hi << 32u) | lo;
+    
+#elif defined(__aarch64__)
+    u64 tsc;
+#   if defined(__APPLE__)
+    __asm volatile("isb\n\tmrs %0, cntpct_el0\n\tisb" : "=r"(tsc) :: "memory");
+#   else
+    __asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(tsc) :: "memory");
+#   endif
+    return tsc;
+    
+#else
+    return yy_time_get_ticks();
+#endif
+}
+
+static yy_inline u64 yy_time_get_ticks_end(void) {
+#if defined(_WIN32) && (defined(_M_IX86) || defined(_M_AMD64))
+    u64 tsc;
+    unsigned int aux;
+    tsc = __rdtscp(&aux);
+    _mm_lfence();
+    return tsc;
+    
+#elif defined(__i386__) || defined(__i386)
+    u64 tsc;
+    __asm volatile("rdtscp\n\tlfence" : "=A"(tsc) :: "ecx", "memory");
+    return tsc;
+    
+#elif defined(__x86_64__) || defined(__x86_64) || \
+defined(__amd64__) || defined(__amd64)
+    u64 lo, hi;
+    __asm volatile("rdtscp\n\tlfence" : "=a"(lo), "=d"(hi) :: "rcx", "memory");
+    return (hi << 32u) | lo;
+    
+#elif defined(__aarch64__)
+    u64 tsc;
+#   if defined(__APPLE__)
+    __asm volatile("isb\n\tmrs %0, cntpct_el0\n\tisb" : "=r"(tsc) :: "memory");
+#   else
+    __asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(tsc) :: "memory");
+#   endif
+    return tsc;
+    
+#else
+    return yy_time_get_ticks();
+#endif
+}
+
+static yy_inline u64 yy_time_ticks_elapsed(u64 begin, u64 end) {
+    u64 ticks = end - begin;
+    u64 overhead = yy_time_get_ticks_overhead();
+    return ticks > overhead ? ticks - overhead : 0;
+}
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,609 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#include "yybench_topo.h"
+#include "yybench_file.h"
+#include "yybench_str.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#define TOPO_MAX_CPU 1024
+
+static yy_topo_cpu *topo_cpus = NULL;
+static u32 topo_cpu_count = 0;
+static u32 topo_core_count = 0;
+static u32 topo_package_count = 0;
+static u32 topo_node_count = 0;
+static yy_topo_cache *topo_caches = NULL;
+static u32 topo_cache_count = 0;
+static u32 topo_cache_capacity = 0;
+
+
+/*==============================================================================
+ * Topology Utils
+ *============================================================================*/
+
+/* Add a cache instance, the same instance shared by multiple cpus is ignored.
+   The `shared_cpus` string is copied. */
+static bool topo_add_cache(yy_topo_cache *cache) {
+    for (u32 i = 0; i < topo_cache_count; i++) {
+        yy_topo_cache *cur = topo_caches + i;
+        if (cur->level == cache->level && cur->type == cache->type &&
+            strcmp(cur->shared_cpus, cache->shared_cpus) == 0) return true;
+    }
+    if (topo_cache_count >= topo_cache_capacity) {
+        u32 capacity = topo_cache_capacity ? topo_cache_capacity * 2 : 16;
+        yy_topo_cache *caches = realloc(topo_caches,
+                                        capacity * sizeof(yy_topo_cache));
+        if (!caches) return false;
+        topo_caches = caches;
+        topo_cache_capacity = capacity;
+    }
+    const char *shared_cpus = yy_str_copy(cache->shared_cpus);
+    if (!shared_cpus) return false;
+    topo_caches[topo_cache_count] = *cache;
+    topo_caches[topo_cache_count].shared_cpus = shared_cpus;
+    topo_cache_count++;
+    return true;
+}
+
+/* Sort caches by level, and then data, instruction, unified. */
+static int topo_cache_cmp(const void *p1, const void *p2) {
+    const yy_topo_cache *c1 = (const yy_topo_cache *)p1;
+    const yy_topo_cache *c2 = (const yy_topo_cache *)p2;
+    int t1 = c1->type == YY_TOPO_CACHE_UNIFIED ? 3 : (int)c1->type;
+    int t2 = c2->type == YY_TOPO_CACHE_UNIFIED ? 3 : (int)c2->type;
+    if (c1->level != c2->level) return c1->level < c2->level ? -1 : 1;
+    if (t1 != t2) return t1 < t2 ? -1 : 1;
+    return strcmp(c1->shared_cpus, c2->shared_cpus);
+}
+
+u32 yy_topo_parse_cpu_list(const char *str, u8 *flags, u32 max) {
+    u32 count = 0;
+    const char *cur = str;
+    if (!str) return 0;
+    while (*cur) {
+        char *end;
+        long begin = strtol(cur, &end, 10);
+        if (end == cur) break;
+        long last = begin;
+        cur = end;
+        while (*cur == ' ' || *cur == '\t') cur++;
+        if (*cur == '-') {
+            cur++;
+            last = strtol(cur, &end, 10);
+            if (end == cur) break;
+            cur = end;
+            while (*cur == ' ' || *cur == '\t') cur++;
+        }
+        if (last >= begin) count += (u32)(last - begin + 1);
+        for (long i = begin; flags && i <= last && i < (long)max; i++) {
+            if (i >= 0) flags[i] = 1;
+        }
+        if (*cur != ',') break;
+        cur++;
+    }
+    return count;
+}
+
+static void topo_format_size(char *buf, usize size, u64 bytes) {
+    if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+        snprintf(buf, size, "%lluM", (unsigned long long)(bytes / 1024 / 1024));
+    } else {
+        snprintf(buf, size, "%lluK", (unsigned long long)(bytes / 1024));
+    }
+}
+
+
+
+/*==============================================================================
+ * Topology Loader
+ *============================================================================*/
+
+#if defined(__linux__)
+
+/* Read a text file, remove the trailing line break. */
+static char *topo_read_str(const char *path) {
+    u8 *dat;
+    usize len;
+    if (!yy_file_read(path, &dat, &len)) return NULL;
+    while (len > 0 && (dat[len - 1] == '\n' || dat[len - 1] == '\r')) {
+        dat[--len] = '\0';
+    }
+    return (char *)dat;
+}
+
+static bool topo_read_int(const char *path, long long *val) {
+    char *str = topo_read_str(path);
+    if (!str) return false;
+    char *end;
+    *val = strtoll(str, &end, 10);
+    bool suc = end != str;
+    free(str);
+    return suc;
+}
+
+/* Parse size such as "32K", "8M". */
+static u64 topo_parse_size(const char *str) {
+    char *end;
+    u64 size = (u64)strtoull(str, &end, 10);
+    switch (*end) {
+        case 'K': case 'k': return size * 1024;
+        case 'M': case 'm': return size * 1024 * 1024;
+        case 'G': case 'g': return size * 1024 * 1024 * 1024;
+        default: return size;
+    }
+}
+
+static void topo_load_caches(int cpu) {
+    char path[256];
+    long long val;
+    for (int i = 0; ; i++) {
+        yy_topo_cache cache;
+        memset(&cache, 0, sizeof(cache));
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, i);
+        if (!topo_read_int(path, &val)) break;
+        cache.level = (int)val;
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, i);
+        char *type = topo_read_str(path);
+        if (type) {
+            if (strcmp(type, "Data") == 0) cache.type = YY_TOPO_CACHE_DATA;
+            else if (strcmp(type, "Instruction") == 0) cache.type = YY_TOPO_CACHE_INSTRUCTION;
+            else cache.type = YY_TOPO_CACHE_UNIFIED;
+            free(type);
+        }
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, i);
+        char *size = topo_read_str(path);
+        if (size) {
+            cache.size = topo_parse_size(size);
+            free(size);
+        }
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/coherency_line_size", cpu, i);
+        if (topo_read_int(path, &val)) cache.line_size = (u32)val;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/ways_of_associativity", cpu, i);
+        if (topo_read_int(path, &val)) cache.ways = (u32)val;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/number_of_sets", cpu, i);
+        if (topo_read_int(path, &val)) cache.sets = (u32)val;
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+        char *shared = topo_read_str(path);
+        char self[16];
+        if (!shared) snprintf(self, sizeof(self), "%d", cpu);
+        cache.shared_cpus = shared ? shared : self;
+        cache.cpu_count = yy_topo_parse_cpu_list(cache.shared_cpus, NULL, 0);
+        topo_add_cache(&cache);
+        if (shared) free(shared);
+    }
+}
+
+static void topo_load(void) {
+    static u8 online[TOPO_MAX_CPU];
+    static u8 node_cpus[TOPO_MAX_CPU];
+    static int raw_core[TOPO_MAX_CPU];
+    char path[256];
+    long long val;
+
+    memset(online, 0, sizeof(online));
+    char *list = topo_read_str("/sys/devices/system/cpu/online");
+    if (list) {
+        yy_topo_parse_cpu_list(list, online, TOPO_MAX_CPU);
+        free(list);
+    } else {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < n && i < TOPO_MAX_CPU; i++) online[i] = 1;
+    }
+
+    u32 count = 0;
+    for (int i = 0; i < TOPO_MAX_CPU; i++) count += online[i];
+    if (!count) return;
+    topo_cpus = calloc(count, sizeof(yy_topo_cpu));
+    if (!topo_cpus) return;
+
+    for (int i = 0; i < TOPO_MAX_CPU; i++) {
+        if (!online[i]) continue;
+        yy_topo_cpu *cpu = topo_cpus + topo_cpu_count;
+        cpu->id = i;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+        cpu->package = topo_read_int(path, &val) && val >= 0 ? (int)val : 0;
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/core_id", i);
+        raw_core[topo_cpu_count] = topo_read_int(path, &val) ? (int)val : i;
+
+        /* core_id is unique only in the package, convert it to core index */
+        cpu->core = -1;
+        for (u32 j = 0; j < topo_cpu_count; j++) {
+            yy_topo_cpu *prev = topo_cpus + j;
+            if (prev->package == cpu->package &&
+                raw_core[j] == raw_core[topo_cpu_count]) {
+                cpu->core = prev->core;
+                cpu->smt++;
+            }
+        }
+        if (cpu->core < 0) cpu->core = (int)topo_core_count++;
+
+        bool new_package = true;
+        for (u32 j = 0; j < topo_cpu_count; j++) {
+            if (topo_cpus[j].package == cpu->package) new_package = false;
+        }
+        if (new_package) topo_package_count++;
+
+        topo_load_caches(i);
+        topo_cpu_count++;
+    }
+
+    /* NUMA nodes */
+    int dir_count = 0;
+    char **names = yy_dir_read("/sys/devices/system/node", &dir_count);
+    for (int n = 0; n < dir_count; n++) {
+        int node;
+        if (sscanf(names[n], "node%d", &node) != 1) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        list = topo_read_str(path);
+        if (!list) continue;
+        memset(node_cpus, 0, sizeof(node_cpus));
+        yy_topo_parse_cpu_list(list, node_cpus, TOPO_MAX_CPU);
+        free(list);
+        topo_node_count++;
+        for (u32 i = 0; i < topo_cpu_count; i++) {
+            if (node_cpus[topo_cpus[i].id]) topo_cpus[i].node = node;
+        }
+    }
+    yy_dir_free(names);
+    if (!topo_node_count) topo_node_count = 1;
+}
+
+#elif defined(__APPLE__)
+
+static u64 topo_sysctl(const char *name) {
+    u64 val = 0;
+    usize size = sizeof(val);
+    if (sysctlbyname(name, &val, &size, NULL, 0) != 0) return 0;
+    if (size == sizeof(u32)) return *(u32 *)&val;
+    return val;
+}
+
+static void topo_load(void) {
+    u32 logical = (u32)topo_sysctl("hw.logicalcpu");
+    u32 physical = (u32)topo_sysctl("hw.physicalcpu");
+    u32 packages = (u32)topo_sysctl("hw.packages");
+    u32 line_size = (u32)topo_sysctl("hw.cachelinesize");
+    char shared[64];
+
+    if (!logical) return;
+    if (!physical) physical = logical;
+    if (!packages) packages = 1;
+    topo_cpus = calloc(logical, sizeof(yy_topo_cpu));
+    if (!topo_cpus) return;
+
+    u32 smt = logical / physical ? logical / physical : 1;
+    for (u32 i = 0; i < logical; i++) {
+        topo_cpus[i].id = (int)i;
+        topo_cpus[i].core = (int)(i / smt);
+        topo_cpus[i].package = (int)(i * packages / logical);
+        topo_cpus[i].smt = (int)(i % smt);
+    }
+    topo_cpu_count = logical;
+    topo_core_count = physical;
+    topo_package_count = packages;
+    topo_node_count = 1;
+
+    /* sysctl only reports the cache size of each level, assume L1 and L2 are
+       shared by SMT siblings, L3 is shared by all cpus */
+    static const struct {
+        const char *name;
+        int level;
+        yy_topo_cache_type type;
+    } caches[] = {
+        { "hw.l1dcachesize", 1, YY_TOPO_CACHE_DATA },
+        { "hw.l1icachesize", 1, YY_TOPO_CACHE_INSTRUCTION },
+        { "hw.l2cachesize", 2, YY_TOPO_CACHE_UNIFIED },
+        { "hw.l3cachesize", 3, YY_TOPO_CACHE_UNIFIED },
+    };
+    for (usize i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
+        yy_topo_cache cache;
+        memset(&cache, 0, sizeof(cache));
+        cache.size = topo_sysctl(caches[i].name);
+        if (!cache.size) continue;
+        cache.level = caches[i].level;
+        cache.type = caches[i].type;
+        cache.line_size = line_size;
+        cache.cpu_count = cache.level >= 3 ? logical : smt;
+        if (cache.cpu_count > 1) snprintf(shared, sizeof(shared), "0-%u", cache.cpu_count - 1);
+        else snprintf(shared, sizeof(shared), "0");
+        cache.shared_cpus = shared;
+        topo_add_cache(&cache);
+    }
+}
+
+#elif defined(_WIN32)
+
+/* Write a cpu list such as "0-3,8" from flags. */
+static void topo_write_list(char *buf, usize size, const u8 *flags, int max) {
+    usize len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < max; i++) {
+        if (!flags[i]) continue;
+        int last = i;
+        while (last + 1 < max && flags[last + 1]) last++;
+        int n;
+        if (last == i) n = snprintf(buf + len, size - len, "%s%d",
+                                    len ? "," : "", i);
+        else n = snprintf(buf + len, size - len, "%s%d-%d",
+                          len ? "," : "", i, last);
+        if (n < 0 || (usize)n >= size - len) break;
+        len += (usize)n;
+        i = last;
+    }
+}
+
+static void topo_load(void) {
+    DWORD len = 0;
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info, *cur;
+    u8 flags[64];
+    char shared[256];
+
+    GetLogicalProcessorInformation(NULL, &len);
+    if (!len) return;
+    info = malloc(len);
+    if (!info) return;
+    if (!GetLogicalProcessorInformation(info, &len)) {
+        free(info);
+        return;
+    }
+    usize count = len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+
+    /* logical cpus, limited to current processor group */
+    int index[64];
+    for (int i = 0; i < 64; i++) index[i] = -1;
+    for (usize n = 0; n < count; n++) {
+        for (int i = 0; i < 64; i++) {
+            if (info[n].ProcessorMask & ((ULONG_PTR)1 << i)) index[i] = 0;
+        }
+    }
+    for (int i = 0; i < 64; i++) {
+        if (index[i] >= 0) index[i] = (int)topo_cpu_count++;
+    }
+    if (!topo_cpu_count) {
+        free(info);
+        return;
+    }
+    topo_cpus = calloc(topo_cpu_count, sizeof(yy_topo_cpu));
+    if (!topo_cpus) {
+        topo_cpu_count = 0;
+        free(info);
+        return;
+    }
+    for (int i = 0; i < 64; i++) {
+        if (index[i] >= 0) topo_cpus[index[i]].id = i;
+    }
+
+    for (usize n = 0; n < count; n++) {
+        cur = info + n;
+        int smt = 0;
+        memset(flags, 0, sizeof(flags));
+        for (int i = 0; i < 64; i++) {
+            if (!(cur->ProcessorMask & ((ULONG_PTR)1 << i))) continue;
+            yy_topo_cpu *cpu = topo_cpus + index[i];
+            flags[i] = 1;
+            switch (cur->Relationship) {
+                case RelationProcessorCore:
+                    cpu->core = (int)topo_core_count;
+                    cpu->smt = smt++;
+                    break;
+                case RelationProcessorPackage:
+                    cpu->package = (int)topo_package_count;
+                    break;
+                case RelationNumaNode:
+                    cpu->node = (int)cur->NumaNode.NodeNumber;
+                    break;
+                default:
+                    break;
+            }
+        }
+        switch (cur->Relationship) {
+            case RelationProcessorCore: topo_core_count++; break;
+            case RelationProcessorPackage: topo_package_count++; break;
+            case RelationNumaNode: topo_node_count++; break;
+            case RelationCache: {
+                yy_topo_cache cache;
+                CACHE_DESCRIPTOR *desc = &cur->Cache;
+                if (desc->Type == CacheTrace) break;
+                memset(&cache, 0, sizeof(cache));
+                cache.level = desc->Level;
+                cache.type = desc->Type == CacheData ? YY_TOPO_CACHE_DATA :
+                             desc->Type == CacheInstruction ? YY_TOPO_CACHE_INSTRUCTION :
+                             YY_TOPO_CACHE_UNIFIED;
+                cache.size = desc->Size;
+                cache.line_size = desc->LineSize;
+                cache.ways = desc->Associativity;
+                if (cache.ways && cache.line_size && cache.ways != 0xFF) {
+                    cache.sets = (u32)(cache.size / cache.ways / cache.line_size);
+                }
+                topo_write_list(shared, sizeof(shared), flags, 64);
+                cache.shared_cpus = shared;
+                cache.cpu_count = yy_topo_parse_cpu_list(shared, NULL, 0);
+                topo_add_cache(&cache);
+                break;
+            }
+            default: break;
+        }
+    }
+    if (!topo_package_count) topo_package_count = 1;
+    if (!topo_node_count) topo_node_count = 1;
+    free(info);
+}
+
+#else
+
+static void topo_load(void) {
+}
+
+#endif
+
+static void topo_load_sorted(void) {
+    topo_load();
+    if (topo_cache_count > 1) {
+        qsort(topo_caches, topo_cache_count, sizeof(yy_topo_cache), topo_cache_cmp);
+    }
+}
+
+/* Load the topology once, the other threads wait until it's loaded. */
+#if defined(_WIN32)
+
+static INIT_ONCE topo_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK topo_load_callback(PINIT_ONCE once, PVOID param, PVOID *ctx) {
+    (void)once;
+    (void)param;
+    (void)ctx;
+    topo_load_sorted();
+    return TRUE;
+}
+
+static void topo_load_once(void) {
+    InitOnceExecuteOnce(&topo_once, topo_load_callback, NULL, NULL);
+}
+
+#else
+
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+static void topo_load_once(void) {
+    pthread_once(&topo_once, topo_load_sorted);
+}
+
+#endif
+
+
+
+/*==============================================================================
+ * Topology
+ *============================================================================*/
+
+u32 yy_topo_get_cpu_count(void) {
+    topo_load_once();
+    return topo_cpu_count;
+}
+
+const yy_topo_cpu *yy_topo_get_cpu(u32 idx) {
+    topo_load_once();
+    return idx < topo_cpu_count ? topo_cpus + idx : NULL;
+}
+
+u32 yy_topo_get_core_count(void) {
+    topo_load_once();
+    return topo_core_count;
+}
+
+u32 yy_topo_get_package_count(void) {
+    topo_load_once();
+    return topo_package_count;
+}
+
+u32 yy_topo_get_node_count(void) {
+    topo_load_once();
+    return topo_node_count;
+}
+
+u32 yy_topo_get_cache_count(void) {
+    topo_load_once();
+    return topo_cache_count;
+}
+
+const yy_topo_cache *yy_topo_get_cache(u32 idx) {
+    topo_load_once();
+    return idx < topo_cache_count ? topo_caches + idx : NULL;
+}
+
+int yy_topo_get_cache_level_count(void) {
+    int max = 0;
+    topo_load_once();
+    for (u32 i = 0; i < topo_cache_count; i++) {
+        if (topo_caches[i].level > max) max = topo_caches[i].level;
+    }
+    return max;
+}
+
+u64 yy_topo_get_cache_size(int level) {
+    topo_load_once();
+    for (u32 i = 0; i < topo_cache_count; i++) {
+        yy_topo_cache *cache = topo_caches + i;
+        if (cache->level == level &&
+            cache->type != YY_TOPO_CACHE_INSTRUCTION) return cache->size;
+    }
+    return 0;
+}
+
+u32 yy_topo_get_cache_line_size(void) {
+    topo_load_once();
+    for (u32 i = 0; i < topo_cache_count; i++) {
+        if (topo_caches[i].line_size) return topo_caches[i].line_size;
+    }
+    return 64;
+}
+
+usize yy_topo_get_working_set(yy_topo_level level) {
+    if (level == YY_TOPO_DRAM) {
+        u64 llc = yy_topo_get_cache_size(yy_topo_get_cache_level_count());
+        u64 size = llc * 4;
+        if (size < (u64)64 * 1024 * 1024) size = (u64)64 * 1024 * 1024;
+        return (usize)size;
+    }
+    return (usize)(yy_topo_get_cache_size((int)level) / 2);
+}
+
+const char *yy_topo_get_desc(void) {
+    static char desc[512] = { 0 };
+    static bool finished = false;
+    char size[32];
+    usize len;
+
+    if (finished) return desc;
+    topo_load_once();
+    if (!topo_cpu_count) {
+        snprintf(desc, sizeof(desc), "Unknown topology");
+        finished = true;
+        return desc;
+    }
+    snprintf(desc, sizeof(desc), "%u package%s, %u core%s, %u thread%s, %u NUMA node%s",
+             topo_package_count, topo_package_count == 1 ? "" : "s",
+             topo_core_count, topo_core_count == 1 ? "" : "s",
+             topo_cpu_count, topo_cpu_count == 1 ? "" : "s",
+             topo_node_count, topo_node_count == 1 ? "" : "s");
+    for (u32 i = 0; i < topo_cache_count; i++) {
+        yy_topo_cache *cache = topo_caches + i;
+        bool dup = false;
+        for (u32 j = 0; j < i; j++) {
+            if (topo_caches[j].level == cache->level &&
+                topo_caches[j].type == cache->type) dup = true;
+        }
+        if (dup) continue;
+        topo_format_size(size, sizeof(size), cache->size);
+        len = strlen(desc);
+        snprintf(desc + len, sizeof(desc) - len, ", L%d%s %s", cache->level,
+                 cache->type == YY_TOPO_CACHE_DATA ? "d" :
+                 cache->type == YY_TOPO_CACHE_INSTRUCTION ? "i" : "", size);
+    }
+    finished = true;
+    return desc;
+}
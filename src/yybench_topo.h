@@ -0,0 +1,123 @@
+/*==============================================================================
+ * Copyright (C) 2020 YaoYuan <ibireme@gmail.com>.
+ * Released under the MIT license (MIT).
+ *============================================================================*/
+
+#ifndef yybench_topo_h
+#define yybench_topo_h
+
+#include "yybench_def.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*==============================================================================
+ * CPU Topology
+
+ The topology is read once on first call and cached. Data sources:
+ Linux/Android: /sys/devices/system/cpu, /sys/devices/system/node
+ macOS/iOS: sysctl hw.*
+ Windows: GetLogicalProcessorInformation()
+
+ Usage:
+
+     // size benchmark inputs for each level of memory hierarchy
+     usize l1 = yy_topo_get_working_set(YY_TOPO_L1);
+     usize l2 = yy_topo_get_working_set(YY_TOPO_L2);
+     usize l3 = yy_topo_get_working_set(YY_TOPO_L3);
+     usize mem = yy_topo_get_working_set(YY_TOPO_DRAM);
+
+ *============================================================================*/
+
+/** Cache type */
+typedef enum yy_topo_cache_type {
+    YY_TOPO_CACHE_UNIFIED = 0,
+    YY_TOPO_CACHE_DATA,
+    YY_TOPO_CACHE_INSTRUCTION,
+} yy_topo_cache_type;
+
+/** Memory hierarchy level */
+typedef enum yy_topo_level {
+    YY_TOPO_L1 = 1,
+    YY_TOPO_L2 = 2,
+    YY_TOPO_L3 = 3,
+    YY_TOPO_DRAM = 4,
+} yy_topo_level;
+
+/** A logical CPU (hardware thread). */
+typedef struct yy_topo_cpu {
+    int id; /* logical cpu id, same as yy_cpu_pin_thread() */
+    int core; /* core index, unique in system, from 0 to core_count - 1 */
+    int package; /* physical package id */
+    int node; /* NUMA node id, 0 if unknown */
+    int smt; /* thread index in its core, 0 for the first SMT sibling */
+} yy_topo_cpu;
+
+/** A cache instance. */
+typedef struct yy_topo_cache {
+    int level; /* cache level, such as 1 for L1 */
+    yy_topo_cache_type type; /* cache type */
+    u64 size; /* cache size in bytes */
+    u32 line_size; /* cache line size in bytes, 0 if unknown */
+    u32 ways; /* ways of associativity, 0 if unknown */
+    u32 sets; /* number of sets, 0 if unknown */
+    u32 cpu_count; /* number of logical cpus sharing this cache */
+    const char *shared_cpus; /* logical cpus sharing this cache, such as "0-3" */
+} yy_topo_cache;
+
+/** Returns logical CPU count, or 0 if the topology is unknown. */
+u32 yy_topo_get_cpu_count(void);
+
+/** Returns a logical CPU by index (not cpu id), or NULL if out of range. */
+const yy_topo_cpu *yy_topo_get_cpu(u32 idx);
+
+/** Returns physical core count. */
+u32 yy_topo_get_core_count(void);
+
+/** Returns physical package count. */
+u32 yy_topo_get_package_count(void);
+
+/** Returns NUMA node count. */
+u32 yy_topo_get_node_count(void);
+
+/** Returns count of distinct cache instances. */
+u32 yy_topo_get_cache_count(void);
+
+/** Returns a cache instance by index, or NULL if out of range.
+    The caches are sorted by level and type. */
+const yy_topo_cache *yy_topo_get_cache(u32 idx);
+
+/** Returns the max cache level, such as 3 for L3, or 0 if unknown. */
+int yy_topo_get_cache_level_count(void);
+
+/** Returns the size of data (or unified) cache of a level in bytes,
+    or 0 if the level does not exist. */
+u64 yy_topo_get_cache_size(int level);
+
+/** Returns the cache line size in bytes, or 64 if unknown. */
+u32 yy_topo_get_cache_line_size(void);
+
+/** Returns a working set size in bytes which is resident in a level:
+    half of the data cache size for cache levels, or 4 times of the last level
+    cache size (at least 64MB) for DRAM.
+    Returns 0 if the cache level does not exist. */
+usize yy_topo_get_working_set(yy_topo_level level);
+
+/** Returns topology description, such as
+    "1 package, 4 cores, 8 threads, 1 NUMA node, L1d 32K, L1i 32K, L2 256K, L3 8M" */
+const char *yy_topo_get_desc(void);
+
+/** Parse a cpu list in sysfs format, such as "0-3,8,10-11", the spaces and
+    the trailing newline are ignored.
+    @param flags Optional, receives flags[cpu] = 1 for each cpu less than max.
+    @return The cpu count in the list. */
+u32 yy_topo_parse_cpu_list(const char *str, u8 *flags, u32 max);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,20 @@
 #include "yybench.h"
 
 
+static u32 test_fail_count = 0;
+
+static void test_check(bool cond, const char *desc) {
+    if (!cond) {
+        printf("check fail: %s\n", desc);
+        test_fail_count++;
+    }
+}
+
+static bool test_near(f64 val, f64 expect, f64 eps) {
+    return fabs(val - expect) <= eps;
+}
+
+
 static void test_env(void) {
     printf("prepare...\n");
     yy_cpu_measure_freq();
@@ -20,6 +34,10 @@ static void test_env(void) {
 static void test_perf(void) {
     printf("pref test:\n");
     if (yy_perf_load(true) == false) return;
+    if (yy_perf_is_software_only()) {
+        printf("hardware perf events are not available\n\n");
+        return;
+    }
     
     // create perf object
     yy_perf *perf = yy_perf_new();
@@ -31,6 +49,7 @@ static void test_perf(void) {
     yy_perf_add_event(perf, YY_PERF_EVENT_BRANCH_MISSES);
     if (!yy_perf_open(perf)) {
         printf("perf open fail\n");
+        yy_perf_free(perf);
         return;
     }
     
@@ -60,7 +79,19 @@ static void test_perf(void) {
     printf("Cycles: %llu(PMU), %llu(Tick), accuracy:%.3f%%\n",
            counters[0], yy_cpu_tick_to_cycle(tick),
            (f64)yy_cpu_tick_to_cycle(tick) / counters[0] * 100);
-    printf("IPC: %.3f\n", (f64)counters[1] / (f64)counters[0]);
+
+    // derived metrics, 100000000 operations
+    yy_metric_ctx ctx;
+    yy_metric_ctx_init_with_perf(&ctx, perf, 100000000, 0);
+    yy_metric_std stds[] = {
+        YY_METRIC_IPC, YY_METRIC_BRANCH_MPKI, YY_METRIC_CYCLES_PER_OP
+    };
+    for (u32 i = 0; i < sizeof(stds) / sizeof(stds[0]); i++) {
+        yy_metric *metric = yy_metric_new_std(stds[i]);
+        printf("%s: %.3f\n", yy_metric_get_name(metric),
+               yy_metric_eval(metric, &ctx));
+        yy_metric_free(metric);
+    }
     
     // close perf and free resources
     yy_perf_close(perf);
@@ -70,6 +101,480 @@ static void test_perf(void) {
 }
 
 
+static bool test_cpu_flags(const u8 *flags, const char *expect) {
+    for (u32 i = 0; expect[i]; i++) {
+        if (flags[i] != (expect[i] == '1')) return false;
+    }
+    return true;
+}
+
+static void test_topo(void) {
+    printf("topo test:\n");
+    u32 fail_count = test_fail_count;
+    u8 flags[16];
+
+    // ranges and single cpus
+    memset(flags, 0, sizeof(flags));
+    test_check(yy_topo_parse_cpu_list("0-3,8,10-11", flags, 16) == 7 &&
+               test_cpu_flags(flags, "1111000010110000"), "cpu list ranges");
+
+    // sysfs files end with a newline, spaces around the separators
+    memset(flags, 0, sizeof(flags));
+    test_check(yy_topo_parse_cpu_list("0-1,4\n", flags, 16) == 3 &&
+               test_cpu_flags(flags, "1100100000000000"), "cpu list newline");
+    memset(flags, 0, sizeof(flags));
+    test_check(yy_topo_parse_cpu_list(" 2 - 3 , 5 ,\t7\n", flags, 16) == 4 &&
+               test_cpu_flags(flags, "0011010100000000"), "cpu list spaces");
+
+    // the cpus not less than max are counted but not flagged
+    memset(flags, 0xFF, sizeof(flags));
+    memset(flags, 0, 4);
+    test_check(yy_topo_parse_cpu_list("1,3-5,100", flags, 4) == 5 &&
+               test_cpu_flags(flags, "0101"), "cpu list out of range");
+    test_check(flags[4] == 0xFF, "cpu list no overflow");
+    test_check(yy_topo_parse_cpu_list("5-3", NULL, 0) == 0, "cpu list reversed");
+
+    // empty input
+    memset(flags, 0, sizeof(flags));
+    test_check(yy_topo_parse_cpu_list("", flags, 16) == 0 &&
+               yy_topo_parse_cpu_list("\n", flags, 16) == 0 &&
+               yy_topo_parse_cpu_list(NULL, flags, 16) == 0 &&
+               test_cpu_flags(flags, "0000000000000000"), "cpu list empty");
+
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+
+#if YY_PERF_AVAILABLE_LINUX
+
+/* PMU descriptor files of the sysfs fixture: "yytest" PMU with type 42. */
+static const char *test_sysfs_files[][2] = {
+    { "type", "42\n" },
+    { "format/event", "config:0-7\n" },
+    { "format/umask", "config:8-15\n" },
+    { "format/inv", "config:23\n" },
+    { "format/ext", "config:0-7,32-35\n" },
+    { "format/ldlat", "config1:0-15\n" },
+    { "format/offcore", "config2:0-63\n" },
+    { "events/loads", "event=0xcd,umask=0x1\n" }
+};
+
+static bool test_sysfs_event(const char *name, u64 config, u64 config1, u64 config2) {
+    u32 type = 0;
+    u64 configs[3] = { 0 };
+    if (!yy_perf_parse_event_name_linux(name, &type, configs)) return false;
+    return type == 42 && configs[0] == config &&
+           configs[1] == config1 && configs[2] == config2;
+}
+
+static void test_perf_sysfs(void) {
+    printf("perf sysfs test:\n");
+    u32 fail_count = test_fail_count;
+    const char *root = "yybench_test.sysfs";
+    const char *dirs[] = { "", "/yytest", "/yytest/format", "/yytest/events" };
+    u32 file_count = sizeof(test_sysfs_files) / sizeof(test_sysfs_files[0]);
+    char path[256];
+    bool suc = true;
+
+    for (u32 i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s%s", root, dirs[i]);
+        mkdir(path, 0755);
+    }
+    for (u32 i = 0; i < file_count; i++) {
+        const char *str = test_sysfs_files[i][1];
+        snprintf(path, sizeof(path), "%s/yytest/%s", root, test_sysfs_files[i][0]);
+        suc &= yy_file_write(path, (u8 *)str, strlen(str));
+    }
+    test_check(suc, "sysfs fixture");
+    yy_perf_set_sysfs_path_linux(root);
+
+    // terms are packed into the bit fields of config, config1 and config2
+    test_check(test_sysfs_event("yytest/event=0x3c,umask=0x2/", 0x023c, 0, 0),
+               "sysfs terms");
+    test_check(test_sysfs_event("yytest/ext=0xabc/", 0xbc | ((u64)0xa << 32), 0, 0),
+               "sysfs split range");
+    test_check(test_sysfs_event("yytest/event=0x1ff/", 0xff, 0, 0),
+               "sysfs value truncated");
+    test_check(test_sysfs_event("yytest/event=0xd1,ldlat=30,offcore=0x123456789/",
+                                0xd1, 30, 0x123456789ULL), "sysfs config1 config2");
+
+    // a term without value is a flag, or a named event of the PMU
+    test_check(test_sysfs_event("yytest/event=0xc4,inv/", 0xc4 | (1 << 23), 0, 0),
+               "sysfs flag");
+    test_check(test_sysfs_event("yytest/loads/", 0x01cd, 0, 0), "sysfs named term");
+    test_check(test_sysfs_event("loads", 0x01cd, 0, 0), "sysfs event name");
+
+    // a later term overrides the bits of an earlier one
+    test_check(test_sysfs_event("yytest/event=0x11,event=0x22/", 0x22, 0, 0),
+               "sysfs override");
+    test_check(test_sysfs_event("yytest/loads,umask=0x3/", 0x03cd, 0, 0),
+               "sysfs override named");
+
+    // unknown PMU or term, bad syntax
+    test_check(!test_sysfs_event("nopmu/event=0x1/", 0x1, 0, 0) &&
+               !test_sysfs_event("yytest/bogus=1/", 0, 0, 0) &&
+               !test_sysfs_event("yytest/event=0x1", 0x1, 0, 0) &&
+               !test_sysfs_event("yytest/event=x/", 0, 0, 0), "sysfs invalid");
+
+    yy_perf_set_sysfs_path_linux(NULL);
+    for (u32 i = 0; i < file_count; i++) {
+        snprintf(path, sizeof(path), "%s/yytest/%s", root, test_sysfs_files[i][0]);
+        yy_file_delete(path);
+    }
+    for (u32 i = sizeof(dirs) / sizeof(dirs[0]); i > 0; i--) {
+        snprintf(path, sizeof(path), "%s%s", root, dirs[i - 1]);
+        yy_file_delete(path);
+    }
+
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+#else
+
+static void test_perf_sysfs(void) {
+}
+
+#endif
+
+
+static f64 test_metric_eval(const char *expr, const yy_metric_ctx *ctx) {
+    yy_metric *metric = yy_metric_new(NULL, expr);
+    f64 val = yy_metric_eval(metric, ctx);
+    yy_metric_free(metric);
+    return val;
+}
+
+static bool test_metric_invalid(const char *expr) {
+    yy_metric *metric = yy_metric_new(NULL, expr);
+    bool invalid = metric == NULL;
+    yy_metric_free(metric);
+    return invalid;
+}
+
+static void test_metric(void) {
+    printf("metric test:\n");
+    u32 fail_count = test_fail_count;
+
+    const char *names[] = { "a", "b", "a-b", "cycles", "zero" };
+    const u64 values[] = { 7, 3, 100, 200, 0 };
+    yy_metric_ctx ctx;
+    ctx.count = 5;
+    ctx.names = names;
+    ctx.values = values;
+    ctx.ops = 4;
+    ctx.bytes = 50;
+
+    // precedence, left associativity and unary minus
+    test_check(test_metric_eval("1 + 2 * 3", &ctx) == 7.0, "metric precedence");
+    test_check(test_metric_eval("(1 + 2) * 3", &ctx) == 9.0, "metric parentheses");
+    test_check(test_metric_eval("10 - 4 - 3", &ctx) == 3.0 &&
+               test_metric_eval("8 / 4 / 2", &ctx) == 1.0, "metric left assoc");
+    test_check(test_metric_eval("-a + 10", &ctx) == 3.0 &&
+               test_metric_eval("2 * -b", &ctx) == -6.0 &&
+               test_metric_eval("-(a - b)", &ctx) == -4.0, "metric unary minus");
+    test_check(test_metric_eval("1e3 * b / 0.5", &ctx) == 6000.0, "metric numbers");
+    test_check(test_metric_eval("bytes / ops", &ctx) == 12.5, "metric variables");
+
+    // a name may contain '-', the subtraction is written with spaces
+    test_check(test_metric_eval("a-b", &ctx) == 100.0, "metric dash name");
+    test_check(test_metric_eval("a - b", &ctx) == 4.0, "metric subtraction");
+
+    // alias of the event names
+    test_check(test_metric_eval("cpu-cycles", &ctx) == 200.0, "metric alias");
+
+    // NaN for missing names and division by zero
+    test_check(isnan(test_metric_eval("missing", &ctx)) &&
+               isnan(test_metric_eval("a / missing", &ctx)), "metric missing name");
+    test_check(isnan(test_metric_eval("a / zero", &ctx)) &&
+               isnan(test_metric_eval("1 / 0", &ctx)), "metric divide by zero");
+
+    // syntax errors
+    test_check(test_metric_invalid("(") && test_metric_invalid("1 +") &&
+               test_metric_invalid("a b") && test_metric_invalid("") &&
+               test_metric_invalid("(a))"), "metric syntax error");
+
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+
+static int test_u64_cmp(const void *a, const void *b) {
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void test_stats(void) {
+    printf("stats test:\n");
+    u32 fail_count = test_fail_count;
+
+    // percentile with linear interpolation, on 1..10 (shuffled)
+    u64 arr[10] = { 5, 1, 9, 3, 7, 2, 8, 4, 6, 10 };
+    test_check(yy_stats_percentile(arr, 10, 0.0) == 1.0, "percentile p0");
+    test_check(yy_stats_percentile(arr, 10, 1.0) == 10.0, "percentile p100");
+    test_check(test_near(yy_stats_percentile(arr, 10, 0.25), 3.25, 1e-9), "percentile p25");
+    test_check(test_near(yy_stats_percentile(arr, 10, 0.9), 9.1, 1e-9), "percentile p90");
+    test_check(yy_stats_median(arr, 10) == 5.5, "median even count");
+    test_check(yy_stats_median(arr, 9) == 5.0, "median odd count");
+
+    // percentile should match the sorted samples, with duplicates
+    u64 vals[101], sorted[101];
+    yy_random_reset();
+    for (u32 i = 0; i < 101; i++) vals[i] = sorted[i] = yy_random32_uniform(20);
+    qsort(sorted, 101, sizeof(u64), test_u64_cmp);
+    bool match = true;
+    for (u32 i = 0; i <= 20; i++) {
+        f64 p = i / 20.0, pos = p * 100;
+        u32 k = (u32)pos;
+        f64 expect = (f64)sorted[k];
+        if (k < 100) expect += ((f64)sorted[k + 1] - (f64)sorted[k]) * (pos - k);
+        if (!test_near(yy_stats_percentile(vals, 101, p), expect, 1e-9)) match = false;
+    }
+    test_check(match, "percentile vs sort");
+
+    // MAD: median(|x - median(x)|)
+    u64 mad_arr[7] = { 1, 1, 2, 2, 4, 6, 9 };
+    test_check(yy_stats_mad(mad_arr, 7) == 1.0, "mad odd count");
+    test_check(yy_stats_mad(arr, 10) == 2.5, "mad half median");
+
+    // Mann-Whitney U with ties: U counts the pairs a > b, ties count half,
+    // p-value is the normal approximation with tie and continuity correction
+    u64 a[6] = { 1, 2, 2, 3, 3, 4 };
+    u64 b[7] = { 2, 3, 4, 4, 5, 6, 7 };
+    yy_stats_mwu mwu;
+    test_check(yy_stats_mann_whitney(a, 6, b, 7, &mwu), "mann whitney run");
+    test_check(mwu.u == 7.0, "mann whitney u");
+    test_check(test_near(mwu.z, -1.961169, 1e-5), "mann whitney z");
+    test_check(test_near(mwu.p_value, 0.049859, 1e-5), "mann whitney p");
+    test_check(test_near(mwu.effect, 7.0 / 42.0, 1e-9), "mann whitney effect");
+    yy_stats_mann_whitney(b, 7, a, 6, &mwu);
+    test_check(mwu.u == 35.0 && test_near(mwu.p_value, 0.049859, 1e-5), "mann whitney swap");
+    yy_stats_mann_whitney(a, 6, a, 6, &mwu);
+    test_check(mwu.u == 18.0 && mwu.p_value == 1.0, "mann whitney same");
+
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+
+static void bench_sum(void *ctx, u64 iters) {
+    const u32 *arr = (const u32 *)ctx;
+    for (u64 i = 0; i < iters; i++) {
+        u32 sum = 0;
+        for (u32 k = 0; k < 256; k++) sum += arr[k];
+        yy_bench_keep(&sum);
+    }
+}
+
+static void bench_sum_parallel(void *ctx, u32 thread, u64 iters) {
+    (void)thread;
+    bench_sum(ctx, iters);
+}
+
+static void test_bench(void) {
+    printf("bench test:\n");
+    u32 fail_count = test_fail_count;
+    u32 arr[256];
+    for (u32 i = 0; i < 256; i++) arr[i] = i;
+
+    yy_bench_options op;
+    yy_bench_options_init(&op);
+    yy_bench_result result;
+    if (!yy_bench_run("sum256", bench_sum, arr, NULL, &result)) {
+        printf("bench run fail\n");
+        test_fail_count++;
+        return;
+    }
+    printf("%s: %llu iters, median %.2f ns [%.2f, %.2f] (%.2f cycles), "
+           "p99 %.2f ns, %u outliers\n",
+           result.name, (unsigned long long)result.iters, result.ns.median,
+           result.median_ci.low, result.median_ci.high,
+           result.cycles.median, result.ns.p99, result.outlier_count);
+    test_check(result.iters > 0, "bench iters");
+    test_check(result.sample_count == op.repetitions, "bench sample count");
+    test_check(result.ns.min <= result.ns.median &&
+               result.ns.median <= result.ns.p90 &&
+               result.ns.p90 <= result.ns.p99, "bench summary order");
+    test_check(result.median_ci.low <= result.ns.median &&
+               result.ns.median <= result.median_ci.high, "bench median ci");
+    test_check(result.cycles.median > 0, "bench cycles");
+    yy_bench_result_release(&result);
+
+    // scaling with 1, 2, ..., 8 threads, then powers of 2 up to max_threads
+    op.min_time = 0.001;
+    op.repetitions = 5;
+#if defined(_WIN32)
+    const u32 threads[] = { 1 };
+#else
+    const u32 threads[] = { 1, 2, 3, 4, 5, 6, 7, 8, 12 };
+#endif
+    u32 thread_count = sizeof(threads) / sizeof(threads[0]);
+    yy_bench_parallel_result *results;
+    u32 count = yy_bench_run_scaling("sum256", bench_sum_parallel, arr,
+                                     12, &op, &results);
+    bool match = count == thread_count;
+    u32 unpinned = 0;
+    for (u32 i = 0; i < count; i++) {
+        printf("%s: %.2f M/s, efficiency %.2f, start skew %.0f ns\n",
+               results[i].name, results[i].throughput / 1e6,
+               results[i].efficiency, results[i].start_skew);
+        if (i < thread_count && results[i].thread_count != threads[i]) match = false;
+        unpinned += results[i].unpinned_count;
+    }
+    test_check(match, "scaling thread counts");
+    test_check(count > 0 && results[0].efficiency == 1.0, "scaling efficiency");
+
+    // the threads are pinned if the calling thread can be pinned
+    bool can_pin = false;
+    for (u32 i = 0; i < yy_topo_get_cpu_count() && !can_pin; i++) {
+        int cpu = yy_topo_get_cpu(i)->id;
+        yy_cpu_pin_scope scope;
+        if (yy_cpu_is_allowed(cpu) && yy_cpu_pin_scope_begin(&scope, cpu)) {
+            yy_cpu_pin_scope_end(&scope);
+            can_pin = true;
+        }
+    }
+    test_check(!can_pin || unpinned == 0, "scaling pinned");
+    yy_bench_scaling_free(results, count);
+
+#if !defined(_WIN32)
+    // more threads than cpus, the threads share cpus
+    yy_bench_parallel_result over;
+    u32 over_count = yy_topo_get_cpu_count() + 1;
+    test_check(yy_bench_run_parallel("sum256/over", bench_sum_parallel, arr,
+                                     over_count, &op, &over) &&
+               over.thread_count == over_count, "parallel over cpus");
+    yy_bench_parallel_result_release(&over);
+#endif
+
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+
+static void bench_sum_arg(void *ctx, u64 arg, u64 iters) {
+    const u32 *arr = (const u32 *)ctx;
+    for (u64 i = 0; i < iters; i++) {
+        u32 sum = 0;
+        for (u64 k = 0; k < arg; k++) sum += arr[k];
+        yy_bench_keep(&sum);
+    }
+}
+
+static bool test_sweep_args(yy_bench_sweep *sweep, const u64 *expect, u32 count) {
+    bool match = sweep && yy_bench_sweep_get_arg_count(sweep) == count;
+    for (u32 i = 0; match && i < count; i++) {
+        match = yy_bench_sweep_get_args(sweep)[i] == expect[i];
+    }
+    yy_bench_sweep_free(sweep);
+    return match;
+}
+
+static void test_sweep(void) {
+    printf("sweep test:\n");
+    u32 fail_count = test_fail_count;
+
+    // arguments: end is inclusive if reached, never exceeded
+    u64 pow2_full[7] = { 16, 32, 64, 128, 256, 512, 1024 };
+    test_check(test_sweep_args(yy_bench_sweep_new_pow2("pow2", 16, 1024), pow2_full, 7),
+               "sweep pow2 inclusive end");
+    test_check(test_sweep_args(yy_bench_sweep_new_pow2("pow2", 16, 1000), pow2_full, 6),
+               "sweep pow2 non-pow2 end");
+    u64 single[1] = { 24 };
+    test_check(test_sweep_args(yy_bench_sweep_new_pow2("pow2", 24, 24), single, 1),
+               "sweep pow2 single");
+    yy_bench_sweep *sweep = yy_bench_sweep_new_pow2("pow2", 1, UINT64_MAX);
+    test_check(sweep && yy_bench_sweep_get_arg_count(sweep) == 64 &&
+               yy_bench_sweep_get_args(sweep)[63] == (u64)1 << 63, "sweep pow2 no overflow");
+    yy_bench_sweep_free(sweep);
+    test_check(!yy_bench_sweep_new_pow2("pow2", 0, 16) &&
+               !yy_bench_sweep_new_pow2("pow2", 32, 16), "sweep pow2 invalid");
+    u64 linear[4] = { 1, 4, 7, 10 };
+    test_check(test_sweep_args(yy_bench_sweep_new_linear("linear", 1, 10, 3), linear, 4) &&
+               test_sweep_args(yy_bench_sweep_new_linear("linear", 1, 12, 3), linear, 4),
+               "sweep linear");
+
+    // a short run over 16..64
+    u32 arr[64];
+    for (u32 i = 0; i < 64; i++) arr[i] = i;
+    yy_bench_options op;
+    yy_bench_options_init(&op);
+    op.min_time = 0.001;
+    op.repetitions = 5;
+    sweep = yy_bench_sweep_new_pow2("sum", 16, 64);
+    test_check(yy_bench_sweep_run(sweep, "sum", bench_sum_arg, arr, &op), "sweep run");
+    test_check(yy_bench_sweep_get_impl_count(sweep) == 1, "sweep impl count");
+    const yy_bench_result *result = yy_bench_sweep_get_result(sweep, 0, 2);
+    test_check(result && strcmp(result->name, "sum/64") == 0 &&
+               !yy_bench_sweep_get_result(sweep, 0, 3), "sweep result");
+    yy_bench_sweep_free(sweep);
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+
+static void test_baseline_result(yy_bench_result *result, const char *name,
+                                 f64 median, f64 low, f64 high) {
+    memset(result, 0, sizeof(yy_bench_result));
+    result->name = (char *)name;
+    result->iters = 1000;
+    result->sample_count = 10;
+    result->ns.median = median;
+    result->ns.mean = median;
+    result->ns.min = low;
+    result->median_ci.low = low;
+    result->median_ci.high = high;
+}
+
+static void test_baseline(void) {
+    printf("baseline test:\n");
+    u32 fail_count = test_fail_count;
+    const char *path = "yybench_test.baseline";
+    yy_bench_result result;
+    yy_bench_diff diff;
+
+    // save 3 entries: median 100 ns, CI [98, 102]
+    yy_bench_baseline *base = yy_bench_baseline_new();
+    const char *names[3] = { "same", "faster", "slower" };
+    for (u32 i = 0; i < 3; i++) {
+        test_baseline_result(&result, names[i], 100, 98, 102);
+        yy_bench_baseline_add(base, &result);
+    }
+    test_check(yy_bench_baseline_save(base, path), "baseline save");
+    yy_bench_baseline_free(base);
+
+    base = yy_bench_baseline_load(path);
+    test_check(base != NULL, "baseline load");
+    if (!base) return;
+    test_check(yy_bench_baseline_env_match(base), "baseline env");
+
+    test_baseline_result(&result, "same", 101, 97, 103);
+    yy_bench_baseline_compare(base, &result, 0, &diff);
+    test_check(diff.status == YY_BENCH_STATUS_SAME && diff.pass, "baseline same");
+    test_check(diff.base_median == 100 && diff.base_low == 98 &&
+               diff.base_high == 102, "baseline round trip");
+
+    test_baseline_result(&result, "faster", 80, 79, 81);
+    yy_bench_baseline_compare(base, &result, 0, &diff);
+    test_check(diff.status == YY_BENCH_STATUS_FASTER && diff.pass, "baseline faster");
+    test_check(diff.speedup == 1.25, "baseline speedup");
+
+    test_baseline_result(&result, "slower", 120, 118, 122);
+    yy_bench_baseline_compare(base, &result, 0, &diff);
+    test_check(diff.status == YY_BENCH_STATUS_SLOWER && !diff.pass, "baseline slower");
+
+    // slower than the threshold, but the confidence intervals overlap
+    test_baseline_result(&result, "slower", 105, 100, 110);
+    yy_bench_baseline_compare(base, &result, 0, &diff);
+    test_check(diff.status == YY_BENCH_STATUS_SAME, "baseline overlap");
+
+    test_baseline_result(&result, "new", 100, 98, 102);
+    yy_bench_baseline_compare(base, &result, 0, &diff);
+    test_check(diff.status == YY_BENCH_STATUS_NEW && isnan(diff.base_median), "baseline new");
+
+    yy_bench_baseline_free(base);
+    remove(path);
+    test_check(yy_bench_baseline_load(path) == NULL, "baseline load missing");
+    printf("%s\n\n", test_fail_count > fail_count ? "fail" : "ok");
+}
+
+
 static void test_chart(void) {
     // Create a report, add some infos.
     yy_report *report = yy_report_new();
@@ -189,7 +694,7 @@ static void test_chart(void) {
     }
     
     
-    if (yy_perf_load(false)) {
+    if (yy_perf_load(false) && !yy_perf_is_software_only()) {
         // branch misprediction penalty
         printf("test branch misprediction penalty...\n");
         
@@ -202,8 +707,8 @@ static void test_chart(void) {
         yy_perf *perf = yy_perf_new();
         yy_perf_add_event(perf, YY_PERF_EVENT_CYCLES);
         yy_perf_add_event(perf, YY_PERF_EVENT_BRANCH_MISSES);
-        yy_perf_open(perf);
-        for (int iter = 0; iter < ITERAT_NUM; iter++) {
+        bool opened = yy_perf_open(perf);
+        for (int iter = 0; opened && iter < ITERAT_NUM; iter++) {
             for (int s = 0; s <= SAMPLE_NUM; s++) {
                 yy_perf_start_counting(perf);
                 for (int i = 0; i < BRANCH_NUM; i++) {
@@ -220,6 +725,10 @@ static void test_chart(void) {
                 yy_perf_stop_counting(perf);
                 
                 u64 *vals = yy_perf_get_counters(perf);
+                if (!vals) {
+                    opened = false;
+                    break;
+                }
                 u64 cycle = vals[0];
                 u64 miss = vals[1];
                 cycles[s] += cycle;
@@ -275,7 +784,8 @@ static void test_chart(void) {
         
         
         // Add chart to report, and free the chart.
-        yy_report_add_chart(report, chart);
+        if (opened) yy_report_add_chart(report, chart);
+        else printf("perf open fail\n");
         yy_chart_free(chart);
         
         
@@ -294,5 +804,13 @@ static void test_chart(void) {
 int main(void) {
     test_env();
     test_perf();
+    test_perf_sysfs();
+    test_topo();
+    test_metric();
+    test_stats();
+    test_bench();
+    test_sweep();
+    test_baseline();
     test_chart();
+    return test_fail_count ? 1 : 0;
 }